@@ -0,0 +1,176 @@
+/**
+ * Host benchmark - BMP180 pressure and altitude paths
+ *
+ * double:  datasheet compensation in double precision followed by the barometric formula
+ *          with pow(), the way SFE_BMP180 + sealevel()/altitude() work
+ * integer: the integer compensation from bmp180_math.h followed by the altitude lookup table
+ *
+ * reports time and cycles per sample for both paths and how far the integer path is from
+ * the double path in pressure and altitude
+ *
+ * pio run -e native && .pio/build/native/program
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "bmp180_math.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+static inline uint64_t cycles() { return __rdtsc(); }
+#else
+#define HAVE_CYCLE_COUNTER 0
+static inline uint64_t cycles() { return 0; }
+#endif
+
+#define SAMPLES         200000
+#define REPEATS         10
+#define OVERSAMPLING    3
+#define SEA_LEVEL_PA    101325.0
+
+// calibration example from the datasheet, section 3.5
+static const bmp180_calibration_t CALIBRATION = {408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868};
+
+typedef struct {
+    int32_t UT;
+    int32_t UP;
+} raw_sample_t;
+
+/**
+ * datasheet compensation without the integer truncation
+*/
+static double pressureDouble(const bmp180_calibration_t& c, int32_t UT, int32_t UP, uint8_t oss) {
+    double X1 = (UT - (double) c.AC6) * c.AC5 / 32768.0;
+    double X2 = c.MC * 2048.0 / (X1 + c.MD);
+    double B5 = X1 + X2;
+    double B6 = B5 - 4000.0;
+    X1 = c.B2 * (B6 * B6 / 4096.0) / 2048.0;
+    X2 = c.AC2 * B6 / 2048.0;
+    double X3 = X1 + X2;
+    double B3 = ((c.AC1 * 4.0 + X3) * (1 << oss) + 2.0) / 4.0;
+    X1 = c.AC3 * B6 / 8192.0;
+    X2 = c.B1 * (B6 * B6 / 4096.0) / 65536.0;
+    X3 = (X1 + X2 + 2.0) / 4.0;
+    double B4 = c.AC4 * (X3 + 32768.0) / 32768.0;
+    double B7 = (UP - B3) * (50000.0 / (1 << oss));
+    double p = B7 * 2.0 / B4;
+    X1 = (p / 256.0) * (p / 256.0);
+    X1 = X1 * 3038.0 / 65536.0;
+    X2 = -7357.0 * p / 65536.0;
+    return p + (X1 + X2 + 3791.0) / 16.0;
+}
+
+static double altitudeDouble(double p, double p0) {
+    return 44330.0 * (1.0 - pow(p / p0, 1.0 / 5.255));
+}
+
+/**
+ * uncompensated pressure giving pressure_pa at the given UT - bisection, the compensation is monotonic
+*/
+static int32_t findUP(int32_t UT, double pressure_pa) {
+    int32_t lo = 0, hi = (1 << (16 + OVERSAMPLING)) - 1;
+    int32_t B5 = bmp180ComputeB5(CALIBRATION, UT);
+
+    while(hi - lo > 1) {
+        int32_t mid = (lo + hi) / 2;
+        if(bmp180Pressure(CALIBRATION, mid, OVERSAMPLING, B5) < pressure_pa) lo = mid; else hi = mid;
+    }
+
+    return hi;
+}
+
+int main() {
+    std::vector<raw_sample_t> samples(SAMPLES);
+
+    // synthetic flight: ground at ~1500 m (85 kPa) up to ~4500 m (58 kPa) and back, temperature drifting
+    int32_t UT_ground = 27898;
+    int32_t up_ground = findUP(UT_ground, 85000.0);
+    int32_t up_apogee = findUP(UT_ground, 58000.0);
+    for(int i = 0; i < SAMPLES; i++) {
+        double phase = (double) i / SAMPLES;
+        double profile = sin(phase * M_PI);
+        samples[i].UT = UT_ground - (int32_t) (profile * 800) + (i % 7);
+        samples[i].UP = up_ground + (int32_t) ((up_apogee - up_ground) * profile) + (i % 13) - 6;
+    }
+
+    BMP180AltitudeTable table;
+    table.setBaseline(SEA_LEVEL_PA);
+
+    // accuracy of the integer path against the double path
+    double max_dp = 0, sum_dp2 = 0, max_da = 0, sum_da2 = 0;
+    for(int i = 0; i < SAMPLES; i++) {
+        double p_ref = pressureDouble(CALIBRATION, samples[i].UT, samples[i].UP, OVERSAMPLING);
+        double a_ref = altitudeDouble(p_ref, SEA_LEVEL_PA);
+
+        int32_t B5 = bmp180ComputeB5(CALIBRATION, samples[i].UT);
+        int32_t p = bmp180Pressure(CALIBRATION, samples[i].UP, OVERSAMPLING, B5);
+        float a = table.altitude((float) p);
+
+        double dp = fabs(p - p_ref), da = fabs(a - a_ref);
+        if(dp > max_dp) max_dp = dp;
+        if(da > max_da) max_da = da;
+        sum_dp2 += dp * dp;
+        sum_da2 += da * da;
+    }
+
+    // the table on its own against pow() over its whole range
+    double max_table = 0;
+    for(double p = 46000.0; p < 106000.0; p += 0.25) {
+        double e = fabs(table.altitude((float) p) - altitudeDouble(p, SEA_LEVEL_PA));
+        if(e > max_table) max_table = e;
+    }
+
+    // timing
+    volatile double sink_double = 0;
+    volatile float sink_float = 0;
+    double best_double_ns = 1e30, best_integer_ns = 1e30;
+    uint64_t best_double_cycles = UINT64_MAX, best_integer_cycles = UINT64_MAX;
+
+    for(int r = 0; r < REPEATS; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t c0 = cycles();
+        double acc_d = 0;
+        for(int i = 0; i < SAMPLES; i++) {
+            double p = pressureDouble(CALIBRATION, samples[i].UT, samples[i].UP, OVERSAMPLING);
+            acc_d += altitudeDouble(p, SEA_LEVEL_PA);
+        }
+        uint64_t c1 = cycles();
+        auto t1 = std::chrono::steady_clock::now();
+        sink_double = acc_d;
+
+        float acc_f = 0;
+        for(int i = 0; i < SAMPLES; i++) {
+            int32_t B5 = bmp180ComputeB5(CALIBRATION, samples[i].UT);
+            int32_t p = bmp180Pressure(CALIBRATION, samples[i].UP, OVERSAMPLING, B5);
+            acc_f += table.altitude((float) p);
+        }
+        uint64_t c2 = cycles();
+        auto t2 = std::chrono::steady_clock::now();
+        sink_float = acc_f;
+
+        double ns_double = std::chrono::duration<double, std::nano>(t1 - t0).count() / SAMPLES;
+        double ns_integer = std::chrono::duration<double, std::nano>(t2 - t1).count() / SAMPLES;
+        if(ns_double < best_double_ns) best_double_ns = ns_double;
+        if(ns_integer < best_integer_ns) best_integer_ns = ns_integer;
+        if(c1 - c0 < best_double_cycles) best_double_cycles = c1 - c0;
+        if(c2 - c1 < best_integer_cycles) best_integer_cycles = c2 - c1;
+    }
+    (void) sink_double;
+    (void) sink_float;
+
+    printf("BMP180 benchmark: %d samples, oversampling %d, best of %d runs\n", SAMPLES, OVERSAMPLING, REPEATS);
+    printf("%-34s %10s %14s\n", "path", "ns/sample", "cycles/sample");
+    printf("%-34s %10.2f %14.1f\n", "double compensation + pow()", best_double_ns,
+           HAVE_CYCLE_COUNTER ? (double) best_double_cycles / SAMPLES : NAN);
+    printf("%-34s %10.2f %14.1f\n", "integer compensation + table", best_integer_ns,
+           HAVE_CYCLE_COUNTER ? (double) best_integer_cycles / SAMPLES : NAN);
+    printf("speedup: %.1fx\n", best_double_ns / best_integer_ns);
+    printf("pressure difference: max %.2f Pa, rms %.2f Pa\n", max_dp, sqrt(sum_dp2 / SAMPLES));
+    printf("altitude difference: max %.3f m, rms %.3f m\n", max_da, sqrt(sum_da2 / SAMPLES));
+    printf("table vs pow() over the table range: max %.4f m\n", max_table);
+
+    return 0;
+}
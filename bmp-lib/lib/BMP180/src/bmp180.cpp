@@ -0,0 +1,132 @@
+#include "bmp180.h"
+
+// conversion times in ms, datasheet table 8 rounded up
+static const uint8_t PRESSURE_CONVERSION_MS[] = {5, 8, 14, 26};
+#define TEMPERATURE_CONVERSION_MS 5
+
+// constructor
+BMP180::BMP180(uint8_t address) {
+    this->_address = address;
+    this->_oversampling = 0;
+    this->_B5 = 0;
+}
+
+/**
+ * check the chip id and cache the calibration coefficients
+ * Wire must already be started
+ * returns false if the sensor does not answer
+*/
+bool BMP180::begin() {
+    uint8_t buffer[BMP180_CALIBRATION_LENGTH];
+
+    if(!this->readRegisters(BMP180_CHIP_ID, buffer, 1) || buffer[0] != BMP180_CHIP_ID_VALUE) {
+        return false;
+    }
+
+    if(!this->readRegisters(BMP180_CALIBRATION, buffer, BMP180_CALIBRATION_LENGTH)) {
+        return false;
+    }
+
+    this->calibration.AC1 = buffer[0] << 8 | buffer[1];
+    this->calibration.AC2 = buffer[2] << 8 | buffer[3];
+    this->calibration.AC3 = buffer[4] << 8 | buffer[5];
+    this->calibration.AC4 = buffer[6] << 8 | buffer[7];
+    this->calibration.AC5 = buffer[8] << 8 | buffer[9];
+    this->calibration.AC6 = buffer[10] << 8 | buffer[11];
+    this->calibration.B1 = buffer[12] << 8 | buffer[13];
+    this->calibration.B2 = buffer[14] << 8 | buffer[15];
+    this->calibration.MB = buffer[16] << 8 | buffer[17];
+    this->calibration.MC = buffer[18] << 8 | buffer[19];
+    this->calibration.MD = buffer[20] << 8 | buffer[21];
+
+    return true;
+}
+
+bool BMP180::writeRegister(uint8_t reg, uint8_t value) {
+    Wire.beginTransmission(this->_address);
+    Wire.write(reg);
+    Wire.write(value);
+    return Wire.endTransmission(true) == 0;
+}
+
+bool BMP180::readRegisters(uint8_t reg, uint8_t* buffer, uint8_t length) {
+    Wire.beginTransmission(this->_address);
+    Wire.write(reg);
+    if(Wire.endTransmission(false) != 0) {
+        return false;
+    }
+
+    if(Wire.requestFrom(this->_address, length, (uint8_t) true) != length) {
+        return false;
+    }
+
+    for(uint8_t i = 0; i < length; i++) {
+        buffer[i] = Wire.read();
+    }
+
+    return true;
+}
+
+/**
+ * start a temperature conversion
+ * returns the conversion time in ms, 0 on failure
+*/
+char BMP180::startTemperature() {
+    if(!this->writeRegister(BMP180_CONTROL, BMP180_READ_TEMPERATURE)) {
+        return 0;
+    }
+
+    return TEMPERATURE_CONVERSION_MS;
+}
+
+/**
+ * collect the temperature conversion, temperature in 0.1 deg C
+ * also updates the B5 term used by the next pressure readings
+ * returns 1 on success, 0 on failure
+*/
+char BMP180::getTemperature(int16_t& temperature) {
+    uint8_t buffer[2];
+
+    if(!this->readRegisters(BMP180_OUT_MSB, buffer, 2)) {
+        return 0;
+    }
+
+    int32_t UT = (int32_t) buffer[0] << 8 | buffer[1];
+    this->_B5 = bmp180ComputeB5(this->calibration, UT);
+    temperature = bmp180Temperature(this->_B5);
+
+    return 1;
+}
+
+/**
+ * start a pressure conversion, oversampling 0 to 3
+ * returns the conversion time in ms, 0 on failure
+*/
+char BMP180::startPressure(uint8_t oversampling) {
+    if(oversampling > 3) oversampling = 3;
+
+    if(!this->writeRegister(BMP180_CONTROL, BMP180_READ_PRESSURE + (oversampling << 6))) {
+        return 0;
+    }
+
+    this->_oversampling = oversampling;
+    return PRESSURE_CONVERSION_MS[oversampling];
+}
+
+/**
+ * collect the pressure conversion, pressure in Pa
+ * compensated with the latest temperature reading
+ * returns 1 on success, 0 on failure
+*/
+char BMP180::getPressure(int32_t& pressure) {
+    uint8_t buffer[3];
+
+    if(!this->readRegisters(BMP180_OUT_MSB, buffer, 3)) {
+        return 0;
+    }
+
+    int32_t UP = ((int32_t) buffer[0] << 16 | (int32_t) buffer[1] << 8 | buffer[2]) >> (8 - this->_oversampling);
+    pressure = bmp180Pressure(this->calibration, UP, this->_oversampling, this->_B5);
+
+    return 1;
+}
@@ -0,0 +1,47 @@
+// BMP180 barometer driver
+// integer compensation from the datasheet with the calibration coefficients cached at begin()
+#ifndef BMP180_H
+#define BMP180_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "bmp180_math.h"
+
+// BMP180 register definitions
+#define BMP180_ADDRESS          0x77
+#define BMP180_CALIBRATION      0xAA    // 22 bytes, AC1 to MD
+#define BMP180_CALIBRATION_LENGTH 22
+#define BMP180_CHIP_ID          0xD0
+#define BMP180_CONTROL          0xF4
+#define BMP180_OUT_MSB          0xF6
+#define BMP180_READ_TEMPERATURE 0x2E
+#define BMP180_READ_PRESSURE    0x34
+#define BMP180_CHIP_ID_VALUE    0x55
+
+/**
+ * BMP180 driver
+ * start*() trigger a conversion and return the conversion time in ms (0 on bus error),
+ * get*() collect the result once that time has passed
+*/
+class BMP180 {
+    private:
+    uint8_t _address;
+    uint8_t _oversampling; // oversampling of the pressure conversion in flight
+    int32_t _B5; // from the latest temperature reading, used by the pressure compensation
+
+    bool writeRegister(uint8_t reg, uint8_t value);
+    bool readRegisters(uint8_t reg, uint8_t* buffer, uint8_t length);
+
+    public:
+    bmp180_calibration_t calibration;
+
+    BMP180(uint8_t address = BMP180_ADDRESS);
+    bool begin();
+    char startTemperature();
+    char getTemperature(int16_t& temperature);
+    char startPressure(uint8_t oversampling);
+    char getPressure(int32_t& pressure);
+
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "bmp180_async.h"
+
+// constructor
+BMP180Async::BMP180Async(BMP180& sensor, uint8_t oversampling, uint8_t temperature_interval) : _sensor(sensor) {
+    this->_state = IDLE;
+    this->_oversampling = BMP180_MAX_OVERSAMPLING;
+    this->_temperature_interval = BMP180_DEFAULT_TEMPERATURE_INTERVAL;
+    this->_pressure_count = 0; // a temperature reading is needed before the first pressure reading
+    this->_ready_at = 0;
+
+    this->temperature = 0;
+    this->pressure = 0;
+    this->timestamp = 0;
+    this->errors = 0;
+
+    this->setOversampling(oversampling);
+    this->setTemperatureInterval(temperature_interval);
+}
+
+/**
+ * set the pressure oversampling setting, 0 (fastest) to 3 (highest resolution)
+ * takes effect from the next pressure conversion
+*/
+void BMP180Async::setOversampling(uint8_t oversampling) {
+    if(oversampling > BMP180_MAX_OVERSAMPLING) {
+        oversampling = BMP180_MAX_OVERSAMPLING;
+    }
+
+    this->_oversampling = oversampling;
+}
+
+/**
+ * set how many pressure readings are taken per temperature reading
+*/
+void BMP180Async::setTemperatureInterval(uint8_t temperature_interval) {
+    if(temperature_interval == 0) {
+        temperature_interval = 1;
+    }
+
+    this->_temperature_interval = temperature_interval;
+    if(this->_pressure_count > temperature_interval) {
+        this->_pressure_count = temperature_interval;
+    }
+}
+
+uint8_t BMP180Async::getOversampling() {
+    return this->_oversampling;
+}
+
+BMP180Async::State BMP180Async::getState() {
+    return this->_state;
+}
+
+/**
+ * start the next conversion - temperature when it is due, pressure otherwise
+ * a failed start leaves the state machine idle so the next update retries
+*/
+void BMP180Async::start(uint32_t now) {
+    char wait;
+
+    if(this->_pressure_count == 0) {
+        wait = this->_sensor.startTemperature();
+        this->_state = TEMPERATURE_PENDING;
+    } else {
+        wait = this->_sensor.startPressure(this->_oversampling);
+        this->_state = PRESSURE_PENDING;
+    }
+
+    if(wait == 0) {
+        this->errors++;
+        this->_state = IDLE;
+        return;
+    }
+
+    this->_ready_at = now + wait;
+}
+
+/**
+ * advance the state machine
+ * never waits for the sensor - call it whenever msUntilReady() has elapsed
+ * returns true when a new pressure reading has been collected
+*/
+bool BMP180Async::update(uint32_t now) {
+    bool new_pressure = false;
+
+    switch(this->_state) {
+        case IDLE:
+            this->start(now);
+            break;
+
+        case TEMPERATURE_PENDING:
+            if((int32_t)(now - this->_ready_at) < 0) break;
+
+            if(this->_sensor.getTemperature(this->temperature) != 0) {
+                this->_pressure_count = this->_temperature_interval;
+            } else {
+                this->errors++;
+            }
+            this->start(now);
+            break;
+
+        case PRESSURE_PENDING:
+            if((int32_t)(now - this->_ready_at) < 0) break;
+
+            if(this->_sensor.getPressure(this->pressure) != 0) {
+                this->timestamp = this->_ready_at;
+                new_pressure = true;
+            } else {
+                this->errors++;
+            }
+            this->_pressure_count--;
+            this->start(now);
+            break;
+    }
+
+    return new_pressure;
+}
+
+/**
+ * milliseconds until the conversion in flight is complete
+ * 0 when update() has work to do now
+*/
+uint32_t BMP180Async::msUntilReady(uint32_t now) {
+    if(this->_state == IDLE) return 0;
+
+    int32_t remaining = (int32_t)(this->_ready_at - now);
+    return remaining > 0 ? remaining : 0;
+}
@@ -0,0 +1,56 @@
+// non-blocking BMP180 measurement state machine
+#ifndef BMP180_ASYNC_H
+#define BMP180_ASYNC_H
+
+#include <Arduino.h>
+#include "bmp180.h"
+
+#define BMP180_MAX_OVERSAMPLING             3
+#define BMP180_DEFAULT_TEMPERATURE_INTERVAL 10 // pressure readings per temperature reading
+
+/**
+ * Runs the BMP180 temperature/pressure conversions without waiting for them.
+ *
+ * update() starts a conversion and returns straight away. The next update() after the
+ * conversion time has passed collects the result and starts the next conversion, so the
+ * sensor converts back to back while the caller is free to sleep or do other work.
+ *
+ * Temperature only changes slowly, so it is re-measured every temperature_interval
+ * pressure readings instead of before every one.
+*/
+class BMP180Async {
+    public:
+    enum State {
+        IDLE,
+        TEMPERATURE_PENDING,
+        PRESSURE_PENDING
+    };
+
+    private:
+    BMP180& _sensor;
+    State _state;
+    uint8_t _oversampling;
+    uint8_t _temperature_interval;
+    uint8_t _pressure_count; // pressure readings left before the next temperature reading
+    uint32_t _ready_at; // millis() when the conversion in flight completes
+
+    void start(uint32_t now);
+
+    public:
+    int16_t temperature; // 0.1 deg C
+    int32_t pressure; // absolute pressure in Pa
+    uint32_t timestamp; // millis() when the pressure conversion completed - collection can come later
+    uint32_t errors; // failed conversion starts or reads
+
+    BMP180Async(BMP180& sensor, uint8_t oversampling = BMP180_MAX_OVERSAMPLING,
+                uint8_t temperature_interval = BMP180_DEFAULT_TEMPERATURE_INTERVAL);
+    void setOversampling(uint8_t oversampling);
+    void setTemperatureInterval(uint8_t temperature_interval);
+    uint8_t getOversampling();
+    State getState();
+    bool update(uint32_t now);
+    uint32_t msUntilReady(uint32_t now);
+
+};
+
+#endif
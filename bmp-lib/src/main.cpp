@@ -1,9 +1,17 @@
 #include <Arduino.h>
-#include <SFE_BMP180.h>
 #include <Wire.h>
+#include <bmp180.h>
+#include <bmp180_async.h>
 
 // create BMP object 
-SFE_BMP180 altimeter;
+BMP180 altimeter;
+
+// conversions run in the background - oversampling 3, temperature every 10 pressure readings
+BMP180Async baro(altimeter, 3, 10);
+
+// pressure to altitude without a pow() per reading
+BMP180AltitudeTable altitude_table;
+bool baseline_set = false;
 
 #define ALTITUDE 1525.0 // altitude of iPIC building, JKUAT, Juja.
 
@@ -31,6 +39,7 @@ void BMPInit() {
 
 void setup() {
     Serial.begin(115200);
+    Wire.begin();
     delay(100);
 
     BMPInit();
@@ -38,9 +47,17 @@ void setup() {
 }
 
 void loop() {
-    char status;
     double T, P, p0, a; // TODO: make these variables global 
 
+    // collect a finished conversion and start the next one
+    // this never waits on the sensor, loop() is free to do other work between readings
+    if(!baro.update(millis())) {
+        return;
+    }
+
+    T = baro.temperature / 10.0; // 0.1 deg C to deg C
+    P = baro.pressure / 100.0; // Pa to mb
+
     // If you want sea-level-compensated pressure, as used in weather reports,
     // you will need to know the altitude at which your measurements are taken.
     // We're using a constant called ALTITUDE in this sketch:
@@ -49,79 +66,30 @@ void loop() {
     Serial.print(ALTITUDE, 0);
     Serial.print(" meters, ");
 
-    // If you want to measure altitude, and not pressure, you will instead need
-    // to provide a known baseline pressure. This is shown at the end of the sketch.
+    // print out the measurement 
+    Serial.print("temperature: ");
+    Serial.print(T, 2);
+    Serial.print(" \xB0 C, ");
 
-    // You must first get a temperature measurement to perform a pressure reading.
-    
-    // Start a temperature measurement:
-    // If request is successful, the number of ms to wait is returned.
-    // If request is unsuccessful, 0 is returned.
-
-    status = altimeter.startTemperature();
-    if(status !=0 ) {
-        // wait for measurement to complete
-        delay(status);
-
-        // retrieve the completed temperature measurement 
-        // temperature is stored in variable T
-
-        status = altimeter.getTemperature(T);
-        if(status != 0) {
-            // print out the measurement 
-            Serial.print("temperature: ");
-            Serial.print(T, 2);
-            Serial.print(" \xB0 C, ");
-
-            // start pressure measurement 
-            // The parameter is the oversampling setting, from 0 to 3 (highest res, longest wait).
-            // If request is successful, the number of ms to wait is returned.
-            // If request is unsuccessful, 0 is returned.
-            status = altimeter.startPressure(3);
-            if(status != 0) {
-                // wait for the measurement to complete
-                delay(status);
-
-                // Retrieve the completed pressure measurement:
-                // Note that the measurement is stored in the variable P.
-                // Note also that the function requires the previous temperature measurement (T).
-                // (If temperature is stable, you can do one temperature measurement for a number of pressure measurements.)
-                // Function returns 1 if successful, 0 if failure.
-
-                status = altimeter.getPressure(P, T);
-                if(status != 0) {
-                    // print out the measurement
-                    Serial.print("absolute pressure: ");
-                    Serial.print(P, 2);
-                    Serial.print(" mb, "); // in millibars
-
-                    p0 = altimeter.sealevel(P,ALTITUDE);
-                    // If you want to determine your altitude from the pressure reading,
-                    // use the altitude function along with a baseline pressure (sea-level or other).
-                    // Parameters: P = absolute pressure in mb, p0 = baseline pressure in mb.
-                    // Result: a = altitude in m.
-
-                    a = altimeter.altitude(P, p0);
-                    Serial.print("computed altitude: ");
-                    Serial.print(a, 0);
-                    Serial.print(" meters, ");
-
-                } else {
-                    Serial.println("error retrieving pressure measurement\n");
-                } 
-            
-            } else {
-                Serial.println("error starting pressure measurement\n");
-            }
-
-        } else {
-            Serial.println("error retrieving temperature measurement\n");
-        }
+    Serial.print("absolute pressure: ");
+    Serial.print(P, 2);
+    Serial.print(" mb, "); // in millibars
 
-    } else {
-        Serial.println("error starting temperature measurement\n");
+    // the sea level pressure only needs computing once, from the first reading at the known altitude
+    if(!baseline_set) {
+        altitude_table.setBaseline(bmp180Sealevel(baro.pressure, ALTITUDE));
+        baseline_set = true;
     }
+    p0 = altitude_table.getBaseline() / 100.0;
 
-    delay(2000);
+    // altitude above sea level from the lookup table
+    // Result: a = altitude in m.
+    a = altitude_table.altitude(baro.pressure);
+    Serial.print("computed altitude: ");
+    Serial.print(a, 0);
+    Serial.print(" meters, ");
 
-}
\ No newline at end of file
+    Serial.print("errors: ");
+    Serial.print(baro.errors);
+
+}
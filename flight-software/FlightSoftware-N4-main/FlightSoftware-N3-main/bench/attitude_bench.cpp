@@ -0,0 +1,239 @@
+/**
+ * Host benchmark - attitude estimator update cost and accuracy
+ *
+ * runs both estimator modes over two synthetic 1kHz IMU streams:
+ *   z-up   the board flat, a slow roll and pitch motion with noisy, biased gyro and accel
+ *   x-up   the rocket standing on its x axis as it flies, a slow lean that wanders round and a spin
+ *          about the axis
+ * each with a boost phase at 5g along x where the accel correction must be rejected
+ *
+ * reports time and cycles per update against ATTITUDE_CYCLE_BUDGET, and the roll/pitch error
+ * against the true orientation in the estimator's convention: pitch the elevation of x, roll the
+ * spin about x. Host cycles are only indicative of the ESP32 - the budget check
+ * catches a change that makes the update grossly more expensive, not a few percent.
+ * exits non-zero when an update is over budget
+ *
+ * pio run -e bench_attitude && .pio/build/bench_attitude/program
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "attitude.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+static inline uint64_t cycles() { return __rdtsc(); }
+#else
+#define HAVE_CYCLE_COUNTER 0
+static inline uint64_t cycles() { return 0; }
+#endif
+
+#define RATE_HZ         1000
+#define SAMPLES         60000   // one minute of flight
+#define BOOST_START     40000
+#define BOOST_END       43000
+#define REPEATS         10
+#define GYRO_NOISE      0.005f  // rad/s
+#define ACCEL_NOISE     0.01f   // g
+
+typedef struct {
+    float gx, gy, gz;   // rad/s
+    float ax, ay, az;   // g
+    float roll, pitch;  // true angles, degrees
+} synthetic_sample_t;
+
+static float noise(float amplitude) {
+    return amplitude * ((float) rand() / RAND_MAX * 2.0f - 1.0f);
+}
+
+static void addNoise(synthetic_sample_t& s, int i) {
+    if(i >= BOOST_START && i < BOOST_END) {
+        s.ax += 5.0f;
+    }
+    s.gx += noise(GYRO_NOISE);
+    s.gy += noise(GYRO_NOISE);
+    s.gz += noise(GYRO_NOISE);
+    s.ax += noise(ACCEL_NOISE);
+    s.ay += noise(ACCEL_NOISE);
+    s.az += noise(ACCEL_NOISE);
+}
+
+/**
+ * z-up: roll and pitch follow slow sinusoids; the body rates are their derivatives through the
+ * euler kinematics, and the accel is gravity rotated into the body plus thrust along x in boost
+ * with yaw 0 the Z-Y-X roll is the spin about x and the elevation of x is minus the Z-Y-X pitch
+ */
+static void generateZUp(std::vector<synthetic_sample_t>& samples) {
+    const float dt = 1.0f / RATE_HZ;
+    srand(1);
+
+    for(int i = 0; i < SAMPLES; i++) {
+        float t = i * dt;
+        float roll = 20.0f * ATTITUDE_DEG_TO_RAD * sinf(0.5f * t);
+        float pitch = 15.0f * ATTITUDE_DEG_TO_RAD * sinf(0.3f * t);
+        float roll_rate = 20.0f * ATTITUDE_DEG_TO_RAD * 0.5f * cosf(0.5f * t);
+        float pitch_rate = 15.0f * ATTITUDE_DEG_TO_RAD * 0.3f * cosf(0.3f * t);
+
+        // euler rates to body rates, yaw rate 0
+        float p = roll_rate;
+        float q = cosf(roll) * pitch_rate;
+        float r = -sinf(roll) * pitch_rate;
+
+        synthetic_sample_t& s = samples[i];
+        s.gx = p + 0.01f; // uncalibrated bias on x
+        s.gy = q;
+        s.gz = r;
+
+        s.ax = -sinf(pitch);
+        s.ay = sinf(roll) * cosf(pitch);
+        s.az = cosf(roll) * cosf(pitch);
+        addNoise(s, i);
+
+        s.roll = roll * ATTITUDE_RAD_TO_DEG;
+        s.pitch = -pitch * ATTITUDE_RAD_TO_DEG;
+    }
+}
+
+typedef struct {
+    float w, x, y, z;
+} quaternion_t;
+
+static quaternion_t multiply(const quaternion_t& a, const quaternion_t& b) {
+    quaternion_t r;
+    r.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+    r.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+    r.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+    r.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+    return r;
+}
+
+/**
+ * body to earth orientation of the rocket at t: spun by spin about x, then the x axis leaned from
+ * vertical by tilt towards azimuth - the swing carries no spin, so spin is the roll
+ */
+static quaternion_t rocketOrientation(float t, float& tilt, float& spin) {
+    tilt = ATTITUDE_DEG_TO_RAD * (8.0f + 6.0f * sinf(0.3f * t));
+    float azimuth = 0.2f * t;
+    spin = ATTITUDE_DEG_TO_RAD * 60.0f * sinf(0.4f * t);
+
+    // shortest arc from body x to the leaned axis (sin tilt cos azimuth, sin tilt sin azimuth, cos tilt)
+    float dx = sinf(tilt) * cosf(azimuth), dy = sinf(tilt) * sinf(azimuth), dz = cosf(tilt);
+    quaternion_t swing = {1.0f + dx, 0.0f, -dz, dy};
+    float norm = sqrtf(swing.w * swing.w + swing.y * swing.y + swing.z * swing.z);
+    swing.w /= norm;
+    swing.y /= norm;
+    swing.z /= norm;
+
+    quaternion_t twist = {cosf(0.5f * spin), sinf(0.5f * spin), 0.0f, 0.0f};
+    return multiply(swing, twist);
+}
+
+/**
+ * x-up: the orientation is given directly, the body rates come from its derivative
+ * (w = 2 q* dq/dt) and the accel is earth up rotated into the body
+ */
+static void generateXUp(std::vector<synthetic_sample_t>& samples) {
+    const float dt = 1.0f / RATE_HZ;
+    srand(2);
+
+    for(int i = 0; i < SAMPLES; i++) {
+        float t = i * dt;
+        float tilt, spin, other_tilt, other_spin;
+        quaternion_t q = rocketOrientation(t, tilt, spin);
+        quaternion_t before = rocketOrientation(t - 0.5f * dt, other_tilt, other_spin);
+        quaternion_t after = rocketOrientation(t + 0.5f * dt, other_tilt, other_spin);
+
+        quaternion_t q_dot = {(after.w - before.w) / dt, (after.x - before.x) / dt,
+                              (after.y - before.y) / dt, (after.z - before.z) / dt};
+        quaternion_t conjugate = {q.w, -q.x, -q.y, -q.z};
+        quaternion_t rate = multiply(conjugate, q_dot);
+
+        synthetic_sample_t& s = samples[i];
+        s.gx = 2.0f * rate.x;
+        s.gy = 2.0f * rate.y + 0.01f; // uncalibrated bias across the axis - spin about it is not observable
+        s.gz = 2.0f * rate.z;
+
+        // earth z in body axes - the third row of the body to earth rotation
+        s.ax = 2.0f * (q.x * q.z - q.w * q.y);
+        s.ay = 2.0f * (q.y * q.z + q.w * q.x);
+        s.az = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+        addNoise(s, i);
+
+        s.roll = spin * ATTITUDE_RAD_TO_DEG;
+        s.pitch = 90.0f - tilt * ATTITUDE_RAD_TO_DEG;
+    }
+}
+
+static bool run(AttitudeEstimator::Mode mode, const char* name, const std::vector<synthetic_sample_t>& samples) {
+    const float dt = 1.0f / RATE_HZ;
+    AttitudeEstimator estimator(mode);
+
+    // accuracy, skipping the first second while the estimate settles
+    estimator.initFromAccel(samples[0].ax, samples[0].ay, samples[0].az);
+    double max_error = 0, sum_error2 = 0, max_boost_error = 0;
+    int counted = 0;
+    for(int i = 1; i < SAMPLES; i++) {
+        const synthetic_sample_t& s = samples[i];
+        estimator.update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, dt);
+        if(i < RATE_HZ) continue;
+
+        double e_roll = fabs(remainderf(estimator.getRoll() - s.roll, 360.0f));
+        double e_pitch = fabs(estimator.getPitch() - s.pitch);
+        double e = e_roll > e_pitch ? e_roll : e_pitch;
+        if(e > max_error) max_error = e;
+        if(i >= BOOST_START && i < BOOST_END + RATE_HZ && e > max_boost_error) max_boost_error = e;
+        sum_error2 += e * e;
+        counted++;
+    }
+
+    // timing
+    double best_ns = 1e30;
+    uint64_t best_cycles = UINT64_MAX;
+    volatile float sink = 0;
+    for(int r = 0; r < REPEATS; r++) {
+        estimator.reset();
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t c0 = cycles();
+        for(int i = 0; i < SAMPLES; i++) {
+            const synthetic_sample_t& s = samples[i];
+            estimator.update(s.gx, s.gy, s.gz, s.ax, s.ay, s.az, dt);
+        }
+        uint64_t c1 = cycles();
+        auto t1 = std::chrono::steady_clock::now();
+        sink = estimator.q0;
+
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / SAMPLES;
+        if(ns < best_ns) best_ns = ns;
+        if(c1 - c0 < best_cycles) best_cycles = c1 - c0;
+    }
+    (void) sink;
+
+    double cycles_per_update = HAVE_CYCLE_COUNTER ? (double) best_cycles / SAMPLES : NAN;
+    bool within_budget = !HAVE_CYCLE_COUNTER || cycles_per_update <= ATTITUDE_CYCLE_BUDGET;
+
+    printf("%-20s %10.2f %14.1f %10.3f %10.3f %12.3f %s\n", name, best_ns, cycles_per_update,
+           max_error, sqrt(sum_error2 / counted), max_boost_error, within_budget ? "" : "OVER BUDGET");
+
+    return within_budget;
+}
+
+int main() {
+    std::vector<synthetic_sample_t> z_up(SAMPLES), x_up(SAMPLES);
+    generateZUp(z_up);
+    generateXUp(x_up);
+
+    printf("attitude benchmark: %d samples at %d Hz, best of %d runs, budget %d cycles/update\n",
+           SAMPLES, RATE_HZ, REPEATS, ATTITUDE_CYCLE_BUDGET);
+    printf("%-20s %10s %14s %10s %10s %12s\n", "mode", "ns/update", "cycles/update", "max deg", "rms deg", "boost deg");
+
+    bool ok = run(AttitudeEstimator::COMPLEMENTARY, "complementary z-up", z_up);
+    ok = run(AttitudeEstimator::MADGWICK, "madgwick z-up", z_up) && ok;
+    ok = run(AttitudeEstimator::COMPLEMENTARY, "complementary x-up", x_up) && ok;
+    ok = run(AttitudeEstimator::MADGWICK, "madgwick x-up", x_up) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,573 @@
+/**
+ * Benchmark suite - cost of every hot path of the flight software, on the host and on the board
+ *
+ * every benchmark calls one function over a fixed table of BENCH_INPUTS synthetic inputs - the same
+ * inputs on every build (xorshift from a fixed seed), so numbers compare between commits and machines:
+ *   filterData, AltitudeFusion updates, State_machine::checkState over a whole flight,
+ *   MPU6050 burst decode and scaling, getRoll/getPitch, the attitude filter, BMP180 compensation and altitude, telemetry seal and encode,
+ *   the latency stamp and record every sample gets, a deferred debug line
+ *
+ * per benchmark:
+ *   mean       ns and cycles per call, best of BENCH_REPEATS batches of BENCH_CALLS calls
+ *   worst      slowest single call out of BENCH_CALLS timed one by one, counter overhead taken off -
+ *              on the host this includes the odd interrupt, on the board it is the real worst case
+ *   allocations operator new calls made by the function under test - anything but 0 is a bug on a hot path
+ *
+ * host: the results go to a json file (bench-results.json) and a table to stdout. --baseline old.json
+ * adds the old mean and the ratio, and with --tolerance R the run fails if any mean is more than R times
+ * the baseline - the regression check between commits. Cycles come from the TSC, converted to ns with
+ * the TSC rate measured at start.
+ * board (env bench_target): the same json and table on the serial port at boot, timed with the ESP32
+ * cycle counter. Save the json and give it to a host run as --baseline to put host and board side by side.
+ *
+ * pio run -e bench_suite && .pio/build/bench_suite/program [bench-results.json] [--baseline old.json] [--tolerance 1.2]
+ * pio run -e bench_target -t upload && pio device monitor | sed -n '/^{/,/^}/p' > board.json
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <new>
+#include <Arduino.h>
+#include "defs.h"
+#include "kalman.h"
+#include "fusion.h"
+#include "state_machine.h"
+#include "mpu.h"
+#include "telemetry.h"
+#include "delta_codec.h"
+#include "bmp180_math.h"
+#include "latency.h"
+#include "deferred_log.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define BENCH_TARGET 1
+#define HAVE_CYCLE_COUNTER 1
+static inline uint32_t cycles() { return ESP.getCycleCount(); }
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <chrono>
+#define BENCH_TARGET 0
+#define HAVE_CYCLE_COUNTER 1
+static inline uint32_t cycles() { return (uint32_t) __rdtsc(); }
+#else
+#include <chrono>
+#define BENCH_TARGET 0
+#define HAVE_CYCLE_COUNTER 0
+// no counter - the "cycles" are ns
+static inline uint32_t cycles() {
+    return (uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+#define BENCH_INPUTS        256     // power of two
+#define BENCH_CALLS         10000
+#define BENCH_REPEATS       5
+#define BENCH_SEED          0x2545F491
+#define BENCH_MAX           24
+#define PAD_ALTITUDE        1417.0f
+#define PAD_PRESSURE        85000.0f
+
+///////////////////////// ALLOCATION COUNTER /////////////////////////
+
+// every operator new in the program goes through here, the benchmarks read the count around their calls
+static volatile uint32_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations = allocations + 1;
+    void* p = malloc(size ? size : 1);
+    if(p == NULL) abort();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+///////////////////////// INPUTS /////////////////////////
+
+typedef MPU6050<16, 1000> Imu; // the ranges main.cpp flies with
+
+// datasheet calibration example, section 3.5
+static const bmp180_calibration_t CALIBRATION = {408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868};
+
+static struct {
+    float accel[BENCH_INPUTS];              // vertical m/s^2
+    float altitude[BENCH_INPUTS];           // m
+    float velocity[BENCH_INPUTS];           // m/s
+    float flight_altitude[BENCH_INPUTS];    // one flight, pad to landing - the state checks
+    float flight_velocity[BENCH_INPUTS];
+    uint8_t bursts[BENCH_INPUTS][MPU6050_BURST_LENGTH];
+    imu_sample_t imu[BENCH_INPUTS];         // the bursts decoded and scaled
+    int32_t UT[BENCH_INPUTS];
+    int32_t UP[BENCH_INPUTS];
+    float pressure[BENCH_INPUTS];           // Pa
+    telemetry_type_t records[BENCH_INPUTS];
+    uint32_t age[BENCH_INPUTS];             // us from acquisition to the filter
+} inputs;
+
+static uint32_t random_state = BENCH_SEED;
+
+// xorshift32 - the same sequence on every platform, unlike rand()
+static float uniform(float low, float high) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return low + (high - low) * (random_state >> 8) * (1.0f / 16777216.0f);
+}
+
+static void generateInputs() {
+    random_state = BENCH_SEED;
+
+    for(int i = 0; i < BENCH_INPUTS; i++) {
+        inputs.accel[i] = uniform(-15.0f, 60.0f);
+        inputs.altitude[i] = PAD_ALTITUDE + uniform(-5.0f, 3000.0f);
+        inputs.velocity[i] = uniform(-50.0f, 300.0f);
+
+        // big endian counts in output register order, around 1g on x at the 16g range
+        int16_t raw[7] = {(int16_t) uniform(1500, 2600), (int16_t) uniform(-400, 400), (int16_t) uniform(-400, 400),
+                          (int16_t) uniform(-2000, 2000), (int16_t) uniform(-3000, 3000), (int16_t) uniform(-3000, 3000),
+                          (int16_t) uniform(-3000, 3000)};
+        for(int k = 0; k < 7; k++) {
+            inputs.bursts[i][2 * k] = (uint8_t) ((uint16_t) raw[k] >> 8);
+            inputs.bursts[i][2 * k + 1] = (uint8_t) raw[k];
+        }
+        MPU6050Base::decodeBurst(inputs.bursts[i], inputs.imu[i]);
+        Imu::scale(inputs.imu[i]);
+
+        inputs.UT[i] = (int32_t) uniform(27000, 29000);
+        inputs.UP[i] = (int32_t) uniform(21000, 24000) << BMP180_OVERSAMPLING;
+        inputs.pressure[i] = PAD_PRESSURE + uniform(-30000.0f, 1000.0f);
+
+        telemetry_type_t& r = inputs.records[i];
+        memset(&r, 0, sizeof(r));
+        r.ax = inputs.imu[i].ax;
+        r.ay = inputs.imu[i].ay;
+        r.az = inputs.imu[i].az;
+        r.gx = inputs.imu[i].gx;
+        r.gy = inputs.imu[i].gy;
+        r.gz = inputs.imu[i].gz;
+        r.altitude = inputs.altitude[i];
+        r.AGL = r.altitude - PAD_ALTITUDE;
+        r.velocity = inputs.velocity[i];
+        r.pressure = (int32_t) inputs.pressure[i];
+        r.latitude = -1.0957154 + uniform(0.0f, 1e-3f);
+        r.longitude = 37.0144162 + uniform(0.0f, 1e-3f);
+        r.time = i * 100;
+
+        inputs.age[i] = (uint32_t) uniform(0, 20000);
+    }
+
+    // a flight squeezed into the table, so checkState goes through every state instead of
+    // settling in one: pad, boost, coast, free fall, parachute, ground
+    const float dt = 0.1f;
+    float altitude = PAD_ALTITUDE, velocity = 0;
+    for(int i = 0; i < BENCH_INPUTS; i++) {
+        float accel = 0;
+        if(i >= 32 && i < 64) accel = 60.0f;
+        else if(i >= 64 && i < 112) accel = -40.0f;
+        else if(i >= 112 && i < 144) accel = -9.8f;
+        else if(i >= 144 && i < 192) accel = velocity < -10.0f ? 20.0f : 0;
+
+        velocity += accel * dt;
+        altitude += velocity * dt;
+        if(i >= 192) {
+            altitude = PAD_ALTITUDE;
+            velocity = 0;
+        }
+        inputs.flight_altitude[i] = altitude + uniform(-0.3f, 0.3f);
+        inputs.flight_velocity[i] = velocity + uniform(-0.3f, 0.3f);
+    }
+}
+
+///////////////////////// BENCHMARKS /////////////////////////
+
+// results land here so the compiler cannot drop the calls
+static volatile float sink;
+
+static AltitudeFusion fusion(FUSION_ALTITUDE_VARIANCE, FUSION_ACCEL_VARIANCE, FUSION_JERK_PSD);
+static uint32_t fusion_time;
+static State_machine fsm;
+static Imu imu(MPU6050_ADDRESS);
+static uint32_t imu_time;
+static BMP180AltitudeTable altitude_table;
+static TelemetryEncoder encoder;
+static telemetry_frame_t frame;
+static uint8_t encoded[DELTA_MAX_RECORD_LENGTH];
+
+static void setupFilterData() {
+    // the first call sets the filter up
+    filterData(0);
+}
+
+static void benchFilterData(uint32_t i) {
+    sink = filterData(inputs.accel[i]).altitude;
+}
+
+static void setupFusion() {
+    fusion = AltitudeFusion(FUSION_ALTITUDE_VARIANCE, FUSION_ACCEL_VARIANCE, FUSION_JERK_PSD);
+    fusion_time = 1000000;
+    fusion.updateAltitude(PAD_ALTITUDE, fusion_time);
+}
+
+static void benchFusionAcceleration(uint32_t i) {
+    fusion_time += 1000000 / IMU_SAMPLE_RATE_HZ;
+    fusion.updateAcceleration(inputs.accel[i], fusion_time);
+    sink = fusion.getAltitude();
+}
+
+static void benchFusionAltitude(uint32_t i) {
+    fusion_time += 26000;
+    fusion.updateAltitude(inputs.altitude[i], fusion_time);
+    sink = fusion.getAltitude();
+}
+
+static void benchCheckState(uint32_t i) {
+    // states only move forward - a new flight every time round the table
+    if(i == 0) fsm = State_machine();
+    sink = fsm.checkState(inputs.flight_altitude[i], inputs.flight_velocity[i]);
+}
+
+static void benchImuConvert(uint32_t i) {
+    imu_sample_t sample;
+    MPU6050Base::decodeBurst(inputs.bursts[i], sample);
+    Imu::scale(sample);
+    sink = sample.ax + sample.gz + sample.temp;
+}
+
+static void benchRoll(uint32_t i) {
+    sink = imu.getRoll(inputs.imu[i]);
+}
+
+static void benchPitch(uint32_t i) {
+    sink = imu.getPitch(inputs.imu[i]);
+}
+
+static void setupFilterImu() {
+    imu_time = 1000000;
+}
+
+static void benchFilterImu(uint32_t i) {
+    imu_sample_t sample = inputs.imu[i];
+    sample.timestamp = imu_time += 1000000 / IMU_SAMPLE_RATE_HZ;
+    imu.filterImu(sample);
+    sink = imu.attitude.getRoll();
+}
+
+static void benchPressure(uint32_t i) {
+    int32_t B5 = bmp180ComputeB5(CALIBRATION, inputs.UT[i]);
+    sink = bmp180Pressure(CALIBRATION, inputs.UP[i], BMP180_OVERSAMPLING, B5);
+}
+
+static void benchAltitude(uint32_t i) {
+    sink = altitude_table.altitude(inputs.pressure[i]);
+}
+
+static void benchSeal(uint32_t i) {
+    frame.data = inputs.records[i];
+    telemetrySeal(frame, PRE_FLIGHT, i, i);
+    sink = frame.crc;
+}
+
+static void setupEncode() {
+    encoder = TelemetryEncoder();
+}
+
+static void benchEncode(uint32_t i) {
+    sink = encoder.encode(inputs.records[i], encoded, sizeof(encoded));
+}
+
+// a sample stamped at acquisition and recorded by the filter stage - both run once per sample
+static void benchLatency(uint32_t i) {
+    uint64_t now = latencyNow();
+    sample_trace_t trace = latencyStamp((uint32_t) now - inputs.age[i]);
+    latencyRecord(LATENCY_FILTER, trace, trace.acquired, now);
+    sink = trace.sequence;
+}
+
+// the line the altimeter task logs - the drain task's pop is in the time too, it keeps the ring from filling
+static void benchDeferredLog(uint32_t i) {
+    deferred_log_entry_t entry;
+    deferredLog("temperature: %.2f C, absolute pressure: %.2f mb, computed altitude: %.2f meters",
+                inputs.accel[i], inputs.pressure[i], inputs.altitude[i]);
+    if(deferred_log_ring.pop(entry)) sink = entry.args[0].f;
+}
+
+typedef struct {
+    const char* name;
+    void (*setup)();
+    void (*call)(uint32_t input);
+} benchmark_t;
+
+static const benchmark_t benchmarks[] = {
+    {"filterData",                          setupFilterData, benchFilterData},
+    {"AltitudeFusion::updateAcceleration",  setupFusion,     benchFusionAcceleration},
+    {"AltitudeFusion::updateAltitude",      setupFusion,     benchFusionAltitude},
+    {"State_machine::checkState",           NULL,            benchCheckState},
+    {"MPU6050 decodeBurst + scale",         NULL,            benchImuConvert},
+    {"MPU6050Base::getRoll",                NULL,            benchRoll},
+    {"MPU6050Base::getPitch",               NULL,            benchPitch},
+    {"MPU6050Base::filterImu",              setupFilterImu,  benchFilterImu},
+    {"bmp180ComputeB5 + bmp180Pressure",    NULL,            benchPressure},
+    {"BMP180AltitudeTable::altitude",       NULL,            benchAltitude},
+    {"telemetrySeal",                       NULL,            benchSeal},
+    {"TelemetryEncoder::encode",            setupEncode,     benchEncode},
+    {"latencyStamp + latencyRecord",        NULL,            benchLatency},
+    {"deferredLog + pop",                   NULL,            benchDeferredLog},
+};
+
+#define BENCH_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+static_assert(BENCH_COUNT <= BENCH_MAX, "raise BENCH_MAX");
+
+typedef struct {
+    double mean_cycles;
+    double worst_cycles;
+    uint32_t allocations;
+} bench_result_t;
+
+/**
+ * cycles a back to back cycles() pair costs - taken off the single call times
+*/
+static uint32_t cycleOverhead() {
+    uint32_t best = UINT32_MAX;
+    for(int i = 0; i < 1000; i++) {
+        uint32_t c0 = cycles();
+        uint32_t c1 = cycles();
+        if(c1 - c0 < best) best = c1 - c0;
+    }
+    return best;
+}
+
+/**
+ * counter cycles per ns
+*/
+static double cycleRate() {
+#if BENCH_TARGET
+    return ESP.getCpuFreqMHz() / 1000.0;
+#elif HAVE_CYCLE_COUNTER
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = __rdtsc();
+    while(std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(50));
+    uint64_t c1 = __rdtsc();
+    return (c1 - c0) / std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+#else
+    return 1.0;
+#endif
+}
+
+static void run(const benchmark_t& benchmark, uint32_t overhead, bench_result_t& result) {
+    const uint32_t mask = BENCH_INPUTS - 1;
+
+    if(benchmark.setup) benchmark.setup();
+    for(uint32_t i = 0; i < BENCH_INPUTS; i++) benchmark.call(i);
+
+    uint32_t allocations_before = allocations;
+    uint32_t best = UINT32_MAX;
+    for(int r = 0; r < BENCH_REPEATS; r++) {
+        uint32_t c0 = cycles();
+        for(uint32_t i = 0; i < BENCH_CALLS; i++) benchmark.call(i & mask);
+        uint32_t c = cycles() - c0;
+        if(c < best) best = c;
+    }
+    result.allocations = allocations - allocations_before;
+    result.mean_cycles = (double) best / BENCH_CALLS;
+
+    uint32_t worst = 0;
+    for(uint32_t i = 0; i < BENCH_CALLS; i++) {
+        uint32_t c0 = cycles();
+        benchmark.call(i & mask);
+        uint32_t c = cycles() - c0;
+        if(c > worst) worst = c;
+    }
+    result.worst_cycles = worst > overhead ? worst - overhead : 0;
+}
+
+///////////////////////// OUTPUT /////////////////////////
+
+static void (*out)(const char* text);
+
+static void print(const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out(line);
+}
+
+static void printTable(const char* platform, const bench_result_t* results, double rate,
+                       const double* baseline) {
+    print("benchmark suite on %s, %d calls per batch, best of %d batches\n", platform, BENCH_CALLS, BENCH_REPEATS);
+    print("  %-36s %10s %10s %10s %10s %6s", "benchmark", "mean ns", "cycles", "worst ns", "cycles", "allocs");
+    if(baseline) print(" %12s %7s", "baseline ns", "ratio");
+    print("\n");
+
+    for(size_t b = 0; b < BENCH_COUNT; b++) {
+        const bench_result_t& r = results[b];
+        print("  %-36s %10.1f %10.1f %10.1f %10.0f %6u", benchmarks[b].name, r.mean_cycles / rate, r.mean_cycles,
+              r.worst_cycles / rate, r.worst_cycles, (unsigned) r.allocations);
+        if(baseline && !isnan(baseline[b])) print(" %12.1f %6.2fx", baseline[b], r.mean_cycles / rate / baseline[b]);
+        else if(baseline) print(" %12s %7s", "-", "-");
+        print("\n");
+    }
+}
+
+/**
+ * one benchmark per line, so the baseline reader below gets by without a json parser
+*/
+static void printJson(const char* platform, const bench_result_t* results, double rate) {
+    print("{\n");
+    print("  \"platform\": \"%s\",\n", platform);
+    print("  \"cycles_per_ns\": %.4f,\n", rate);
+    print("  \"calls\": %d,\n", BENCH_CALLS);
+    print("  \"repeats\": %d,\n", BENCH_REPEATS);
+    print("  \"benchmarks\": [\n");
+    for(size_t b = 0; b < BENCH_COUNT; b++) {
+        const bench_result_t& r = results[b];
+        print("    {\"name\": \"%s\", \"mean_ns\": %.2f, \"mean_cycles\": %.2f, \"worst_ns\": %.1f, \"worst_cycles\": %.0f, "
+              "\"allocations\": %u}%s\n", benchmarks[b].name, r.mean_cycles / rate, r.mean_cycles, r.worst_cycles / rate,
+              r.worst_cycles, (unsigned) r.allocations, b + 1 < BENCH_COUNT ? "," : "");
+    }
+    print("  ]\n");
+    print("}\n");
+}
+
+static void runAll(bench_result_t* results, double& rate) {
+    generateInputs();
+    rate = cycleRate();
+    uint32_t overhead = cycleOverhead();
+
+    for(size_t b = 0; b < BENCH_COUNT; b++) {
+        run(benchmarks[b], overhead, results[b]);
+    }
+}
+
+#if BENCH_TARGET
+
+static void serialOut(const char* text) {
+    Serial.print(text);
+}
+
+void setup() {
+    Serial.begin(115200);
+    delay(SETUP_DELAY);
+
+    bench_result_t results[BENCH_COUNT];
+    double rate;
+    char platform[48];
+
+    // nothing else is running - the numbers are the functions alone, with a warm cache
+    runAll(results, rate);
+    snprintf(platform, sizeof(platform), "esp32 %u MHz", (unsigned) ESP.getCpuFreqMHz());
+
+    out = serialOut;
+    printTable(platform, results, rate, NULL);
+    printJson(platform, results, rate);
+}
+
+void loop() {
+    delay(1000);
+}
+
+#else
+
+static FILE* out_file;
+
+static void fileOut(const char* text) {
+    fputs(text, out_file);
+}
+
+/**
+ * mean ns of every benchmark in a results file written by this suite, NAN for those it does not have
+*/
+static bool readBaseline(const char* path, double* baseline) {
+    FILE* f = fopen(path, "r");
+    if(f == NULL) return false;
+
+    for(size_t b = 0; b < BENCH_COUNT; b++) baseline[b] = NAN;
+
+    char line[512];
+    while(fgets(line, sizeof(line), f)) {
+        char* name = strstr(line, "\"name\": \"");
+        char* mean = strstr(line, "\"mean_ns\": ");
+        if(name == NULL || mean == NULL) continue;
+
+        name += strlen("\"name\": \"");
+        char* end = strchr(name, '"');
+        if(end == NULL) continue;
+        *end = 0;
+
+        for(size_t b = 0; b < BENCH_COUNT; b++) {
+            if(strcmp(benchmarks[b].name, name) == 0) baseline[b] = strtod(mean + strlen("\"mean_ns\": "), NULL);
+        }
+    }
+    fclose(f);
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* path = "bench-results.json";
+    const char* baseline_path = NULL;
+    double tolerance = INFINITY;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) baseline_path = argv[++i];
+        else if(strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) tolerance = strtod(argv[++i], NULL);
+        else if(argv[i][0] != '-') path = argv[i];
+        else {
+            fprintf(stderr, "usage: %s [results.json] [--baseline old.json] [--tolerance ratio]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    double baseline[BENCH_MAX];
+    if(baseline_path && !readBaseline(baseline_path, baseline)) {
+        fprintf(stderr, "cannot read %s\n", baseline_path);
+        return 1;
+    }
+
+    bench_result_t results[BENCH_COUNT];
+    double rate;
+    runAll(results, rate);
+
+#if HAVE_CYCLE_COUNTER
+    const char* platform = "host tsc";
+#else
+    const char* platform = "host, no cycle counter";
+#endif
+
+    out = fileOut;
+    out_file = stdout;
+    printTable(platform, results, rate, baseline_path ? baseline : NULL);
+
+    out_file = fopen(path, "w");
+    if(out_file == NULL) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+    }
+    printJson(platform, results, rate);
+    fclose(out_file);
+    printf("results written to %s\n", path);
+
+    uint32_t slower = 0, allocating = 0;
+    for(size_t b = 0; b < BENCH_COUNT; b++) {
+        if(results[b].allocations) allocating++;
+        if(baseline_path && !isnan(baseline[b]) && results[b].mean_cycles / rate > baseline[b] * tolerance) slower++;
+    }
+    if(allocating) printf("%u benchmarks allocate\n", (unsigned) allocating);
+    if(isfinite(tolerance)) {
+        printf("within %.2fx of %s: %s (%u slower)\n", tolerance, baseline_path, slower ? "FAIL" : "ok", (unsigned) slower);
+    }
+
+    return slower || allocating ? 1 : 0;
+}
+
+#endif
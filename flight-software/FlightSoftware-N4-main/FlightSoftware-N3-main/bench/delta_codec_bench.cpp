@@ -0,0 +1,213 @@
+/**
+ * Host benchmark - delta codec compression and encode cost
+ *
+ * two record streams, both run through TelemetryEncoder and back through TelemetryDecoder:
+ *   sensor-data.csv     the logged x acceleration at its real timestamps, the other fields held at
+ *                       their pad values as they were during that capture
+ *   log-data/putty.log  one record per telemetry cycle in the log, with the flight states at the
+ *                       points the log reports them. The log carries no sensor values, so the fields
+ *                       follow PuttyProfile for those states with noise drawn from sensor-data.csv
+ *
+ * reports bytes per record against the packed struct (60 bytes), the old sprintf csv line and, for
+ * putty.log, the text the board actually wrote per cycle; the encode time and cycles per record;
+ * and checks every decoded field is within half a step of the input
+ * exits non-zero when a field is out of tolerance
+ *
+ * pio run -e bench_delta_codec && .pio/build/bench_delta_codec/program [sensor-data.csv] [putty.log]
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "delta_codec.h"
+#include "putty_profile.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+static inline uint64_t cycles() { return __rdtsc(); }
+#else
+#define HAVE_CYCLE_COUNTER 0
+static inline uint64_t cycles() { return 0; }
+#endif
+
+#define REPEATS         200
+#define PAD_PRESSURE    84250       // Pa at ~1525 m
+#define PAD_ALTITUDE    1525.0f
+#define PAD_LATITUDE    -1.0957154
+#define PAD_LONGITUDE   37.0144162
+
+static telemetry_type_t padRecord() {
+    telemetry_type_t r;
+    memset(&r, 0, sizeof(r));
+    r.az = 1.0f;
+    r.pressure = PAD_PRESSURE;
+    r.altitude = PAD_ALTITUDE;
+    r.latitude = PAD_LATITUDE;
+    r.longitude = PAD_LONGITUDE;
+    return r;
+}
+
+/**
+ * length of the csv line the old transmitTelemetry built for this record
+*/
+static size_t csvLength(const telemetry_type_t& r, uint32_t id, int state) {
+    char line[256];
+    return snprintf(line, sizeof(line), "%i,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%i,%.16f,%.16f,%i,%i\n",
+                    (int) id, r.ax, r.ay, r.az, r.gx, r.gy, r.gz, r.AGL, r.altitude, r.velocity, (int) r.pressure,
+                    r.latitude, r.longitude, (int) r.time, state);
+}
+
+static bool loadSensorData(const char* path, std::vector<telemetry_type_t>& records, std::vector<float>& noise) {
+    FILE* f = fopen(path, "r");
+    if(f == NULL) return false;
+
+    double t, t0 = -1;
+    float ax, mean = 0;
+    while(fscanf(f, "%lf,%f", &t, &ax) == 2) {
+        if(t0 < 0) t0 = t;
+        telemetry_type_t r = padRecord();
+        r.ax = ax;
+        r.time = (uint32_t) ((t - t0) * 1000.0);
+        records.push_back(r);
+        mean += ax;
+    }
+    fclose(f);
+
+    // residuals around the mean are the noise for the synthetic stream
+    mean /= records.size();
+    for(size_t i = 0; i < records.size(); i++) noise.push_back(records[i].ax - mean);
+
+    return !records.empty();
+}
+
+/**
+ * one record per telemetry cycle of the log, the motion from the flight profile of its states
+ * returns the bytes of text the log spent on those cycles
+*/
+static size_t loadPuttyLog(const char* path, const std::vector<float>& noise, std::vector<telemetry_type_t>& records,
+                           std::vector<int>& states) {
+    PuttyProfile profile;
+    if(!profile.load(path)) return 0;
+
+    states = profile.states;
+    for(size_t i = 0; i < states.size(); i++) {
+        float t = i * PUTTY_CYCLE_MS * 1e-3f;
+        float accel = profile.accel(t);
+
+        telemetry_type_t r = padRecord();
+        float n = noise[i % noise.size()];
+        r.ax = (accel + 9.80665f) / 9.80665f + n * 0.1f;
+        r.ay = 0.01f + n * 0.02f;
+        r.az = 0.02f - n * 0.02f;
+        r.gx = n * 2.0f;
+        r.gy = n;
+        r.gz = -n;
+        r.altitude = PAD_ALTITUDE + profile.height(t) + n;
+        r.AGL = r.altitude - PAD_ALTITUDE;
+        r.velocity = profile.velocity(t);
+        r.pressure = (int32_t) (101325.0f * powf(1.0f - r.altitude / 44330.0f, 5.255f));
+        r.latitude = PAD_LATITUDE + (r.AGL * 1e-7);
+        r.longitude = PAD_LONGITUDE + (r.AGL * 2e-7);
+        r.time = (uint32_t) (i * PUTTY_CYCLE_MS);
+        records.push_back(r);
+    }
+
+    return profile.text;
+}
+
+#define CHECK_FIELD(type, name, format, step) { \
+    double error = fabs((double) decoded.name - (double) input.name); \
+    double tolerance = (double) (type) (step) * 0.5 + fabs((double) input.name) * 1e-7; \
+    if(error > tolerance) { \
+        printf("  %s out of tolerance at record %u: %f vs %f\n", #name, (unsigned) i, (double) decoded.name, (double) input.name); \
+        return false; \
+    } \
+}
+
+static bool run(const char* name, const std::vector<telemetry_type_t>& records, const std::vector<int>* states, size_t text_bytes) {
+    std::vector<uint8_t> stream(records.size() * DELTA_MAX_RECORD_LENGTH);
+
+    // size and round trip
+    TelemetryEncoder encoder;
+    TelemetryDecoder decoder;
+    size_t encoded = 0, csv = 0;
+    for(size_t i = 0; i < records.size(); i++) {
+        encoded += encoder.encode(records[i], &stream[encoded], stream.size() - encoded);
+        csv += csvLength(records[i], i, states ? (*states)[i] : 0);
+    }
+
+    size_t position = 0;
+    for(size_t i = 0; i < records.size(); i++) {
+        telemetry_type_t decoded;
+        size_t used = decoder.decode(&stream[position], encoded - position, decoded);
+        if(used == 0) {
+            printf("%s: decode failed at record %u\n", name, (unsigned) i);
+            return false;
+        }
+        position += used;
+
+        const telemetry_type_t& input = records[i];
+        TELEMETRY_FIELDS(CHECK_FIELD)
+    }
+
+    // encode cost
+    double best_ns = 1e30;
+    uint64_t best_cycles = UINT64_MAX;
+    for(int r = 0; r < REPEATS; r++) {
+        TelemetryEncoder timed;
+        size_t n = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t c0 = cycles();
+        for(size_t i = 0; i < records.size(); i++) {
+            n += timed.encode(records[i], &stream[n], stream.size() - n);
+        }
+        uint64_t c1 = cycles();
+        auto t1 = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / records.size();
+        if(ns < best_ns) best_ns = ns;
+        if(c1 - c0 < best_cycles) best_cycles = c1 - c0;
+    }
+
+    double count = (double) records.size();
+    printf("%s: %u records\n", name, (unsigned) records.size());
+    printf("  %-22s %8.1f bytes/record\n", "packed struct", (double) sizeof(telemetry_type_t));
+    printf("  %-22s %8.1f bytes/record\n", "sprintf csv", csv / count);
+    if(text_bytes) printf("  %-22s %8.1f bytes/record\n", "log text", text_bytes / count);
+    printf("  %-22s %8.1f bytes/record  (%.1fx vs struct, %.1fx vs csv)\n", "delta codec", encoded / count,
+           sizeof(telemetry_type_t) * count / encoded, csv / (double) encoded);
+    printf("  %-22s %8.1f ns/record %8.1f cycles/record\n", "encode", best_ns,
+           HAVE_CYCLE_COUNTER ? (double) best_cycles / count : NAN);
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* sensor_path = argc > 1 ? argv[1] : "sensor-data.csv";
+    const char* putty_path = argc > 2 ? argv[2] : "log-data/putty.log";
+
+    std::vector<telemetry_type_t> sensor_records, putty_records;
+    std::vector<float> noise;
+    std::vector<int> states;
+
+    if(!loadSensorData(sensor_path, sensor_records, noise)) {
+        fprintf(stderr, "cannot read %s\n", sensor_path);
+        return 1;
+    }
+    size_t text = loadPuttyLog(putty_path, noise, putty_records, states);
+    if(putty_records.empty()) {
+        fprintf(stderr, "cannot read %s\n", putty_path);
+        return 1;
+    }
+
+    printf("delta codec benchmark: keyframe every %d records, best of %d runs\n", DELTA_KEYFRAME_INTERVAL, REPEATS);
+    bool ok = run(sensor_path, sensor_records, NULL, 0);
+    ok = run(putty_path, putty_records, &states, text) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/**
+ * Host benchmark - RingBuffer against a locking queue
+ *
+ * one producer thread and one consumer thread pass accel samples through:
+ *   queue:       a bounded queue behind a mutex and condition variable, copying by value -
+ *                the host stand-in for xQueueSend/xQueueReceive and their critical sections
+ *   ring:        RingBuffer push/pop one item at a time
+ *   ring batch:  RingBuffer pushBatch/popBatch, IMU_FIFO_BATCH items at a time
+ *
+ * reports items per second and ns per item for each, and checks every item arrives in order.
+ * the producer yields on a full buffer so no item is lost and the runs are comparable, and the
+ * consumer yields on an empty one, so the benchmark also works on a single core.
+ *
+ * pio run -e bench_ring_buffer && .pio/build/bench_ring_buffer/program
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "ring_buffer.h"
+
+#define ITEMS       1000000
+#define LENGTH      64
+#define BATCH       8
+#define REPEATS     5
+
+typedef struct {
+    float ax;
+    float ay;
+    float az;
+    uint32_t timestamp;
+} sample_t;
+
+/**
+ * bounded FIFO with a lock on every operation, like a FreeRTOS queue
+*/
+class LockingQueue {
+    private:
+    sample_t _slots[LENGTH];
+    uint32_t _head = 0, _tail = 0, _count = 0;
+    std::mutex _lock;
+    std::condition_variable _not_empty, _not_full;
+
+    public:
+    void send(const sample_t& item) {
+        std::unique_lock<std::mutex> guard(this->_lock);
+        this->_not_full.wait(guard, [this] { return this->_count < LENGTH; });
+        this->_slots[this->_head] = item;
+        this->_head = (this->_head + 1) % LENGTH;
+        this->_count++;
+        this->_not_empty.notify_one();
+    }
+
+    void receive(sample_t& item) {
+        std::unique_lock<std::mutex> guard(this->_lock);
+        this->_not_empty.wait(guard, [this] { return this->_count > 0; });
+        item = this->_slots[this->_tail];
+        this->_tail = (this->_tail + 1) % LENGTH;
+        this->_count--;
+        this->_not_full.notify_one();
+    }
+};
+
+static sample_t makeSample(uint32_t i) {
+    sample_t s = {0.01f * i, 0.02f, 1.0f, i};
+    return s;
+}
+
+/**
+ * time one producer/consumer run, returns ns per item, or a negative value if items were lost or reordered
+*/
+template <typename Producer, typename Consumer>
+static double run(Producer producer, Consumer consumer) {
+    bool in_order = true;
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::thread consumer_thread([&] { in_order = consumer(); });
+    producer();
+    consumer_thread.join();
+    auto t1 = std::chrono::steady_clock::now();
+
+    if(!in_order) return -1;
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / ITEMS;
+}
+
+static double benchQueue() {
+    LockingQueue queue;
+
+    return run(
+        [&] {
+            for(uint32_t i = 0; i < ITEMS; i++) queue.send(makeSample(i));
+        },
+        [&] {
+            sample_t s;
+            for(uint32_t i = 0; i < ITEMS; i++) {
+                queue.receive(s);
+                if(s.timestamp != i) return false;
+            }
+            return true;
+        });
+}
+
+static double benchRing() {
+    static RingBuffer<sample_t, LENGTH> ring;
+
+    return run(
+        [&] {
+            for(uint32_t i = 0; i < ITEMS; i++) {
+                sample_t s = makeSample(i);
+                while(!ring.push(s)) std::this_thread::yield();
+            }
+        },
+        [&] {
+            sample_t s;
+            for(uint32_t i = 0; i < ITEMS; i++) {
+                while(!ring.pop(s)) std::this_thread::yield();
+                if(s.timestamp != i) return false;
+            }
+            return true;
+        });
+}
+
+static double benchRingBatch() {
+    static RingBuffer<sample_t, LENGTH> ring;
+
+    return run(
+        [&] {
+            sample_t batch[BATCH];
+            for(uint32_t i = 0; i < ITEMS; i += BATCH) {
+                for(uint32_t k = 0; k < BATCH; k++) batch[k] = makeSample(i + k);
+                uint32_t sent = 0;
+                while(sent < BATCH) {
+                    sent += ring.pushBatch(batch + sent, BATCH - sent);
+                    if(sent < BATCH) std::this_thread::yield();
+                }
+            }
+        },
+        [&] {
+            sample_t batch[BATCH];
+            uint32_t expected = 0;
+            while(expected < ITEMS) {
+                uint32_t n = ring.popBatch(batch, BATCH);
+                if(n == 0) std::this_thread::yield();
+                for(uint32_t k = 0; k < n; k++) {
+                    if(batch[k].timestamp != expected++) return false;
+                }
+            }
+            return true;
+        });
+}
+
+static bool report(const char* name, double (*bench)()) {
+    double best = 1e30;
+    for(int r = 0; r < REPEATS; r++) {
+        double ns = bench();
+        if(ns < 0) {
+            printf("%-12s items lost or out of order\n", name);
+            return false;
+        }
+        if(ns < best) best = ns;
+    }
+
+    printf("%-12s %10.2f %14.2f\n", name, best, 1e3 / best);
+    return true;
+}
+
+int main() {
+    printf("ring buffer benchmark: %d items, length %d, batch %d, best of %d runs\n", ITEMS, LENGTH, BATCH, REPEATS);
+    printf("%-12s %10s %14s\n", "path", "ns/item", "Mitems/s");
+
+    bool ok = report("queue", benchQueue);
+    ok = report("ring", benchRing) && ok;
+    ok = report("ring batch", benchRingBatch) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#ifndef ATTITUDE_H
+#define ATTITUDE_H
+
+#include <stdint.h>
+#include <math.h>
+
+// attitude estimator defaults
+#define ATTITUDE_COMPLEMENTARY_GAIN     1.0f    // proportional accel correction, rad/s per unit error
+#define ATTITUDE_MADGWICK_BETA          0.1f    // gradient descent step, rad/s
+#define ATTITUDE_ACCEL_REJECTION        0.15f   // skip the accel correction when |a| is further than this from 1g
+#define ATTITUDE_CYCLE_BUDGET           4800    // cycles per update: 2% of a 240MHz core at 1kHz
+
+#define ATTITUDE_DEG_TO_RAD             0.017453292f
+#define ATTITUDE_RAD_TO_DEG             57.29578f
+
+/**
+ * Quaternion attitude estimator
+ *
+ * The gyro is integrated at full IMU rate; the accelerometer only pulls roll and pitch back
+ * towards gravity. Under thrust the accelerometer no longer measures gravity, so the correction
+ * is skipped whenever the measured magnitude is more than accel_rejection g away from 1g and the
+ * estimate runs on the gyro alone.
+ *
+ * COMPLEMENTARY: proportional feedback of the accel/gravity cross product into the gyro rate -
+ *                the cheapest correction
+ * MADGWICK:      gradient descent step towards the accel direction (Madgwick 2010, IMU form)
+ *
+ * Body axes follow the MPU6050 markings, earth z is up. The rocket axis is body x, up on the pad, so
+ * the angles are those of the rocket rather than Z-Y-X Euler angles, whose pitch sits at its
+ * singularity when x is vertical:
+ *   pitch  elevation of the x axis above the horizon, +90 upright - the sign of asin(ax/g) from the
+ *          accelerometer alone
+ *   tilt   angle of the x axis from vertical, 90 - pitch
+ *   roll   spin about the x axis, from the twist of the orientation about it
+ *   yaw    Z-Y-X yaw about earth z - only meaningful with the x axis near horizontal
+*/
+class AttitudeEstimator {
+    public:
+    enum Mode {
+        COMPLEMENTARY,
+        MADGWICK
+    };
+
+    private:
+    Mode _mode;
+    float _gain;
+    float _accel_rejection;
+    float _bias_x, _bias_y, _bias_z; // gyro bias in rad/s
+
+    void correctComplementary(float& gx, float& gy, float& gz, float ax, float ay, float az);
+    void integrateMadgwick(float gx, float gy, float gz, float ax, float ay, float az, bool use_accel, float dt);
+
+    public:
+    float q0, q1, q2, q3; // orientation quaternion, body to earth
+
+    AttitudeEstimator(Mode mode = COMPLEMENTARY);
+    void setMode(Mode mode);
+    Mode getMode();
+    void setGain(float gain);
+    void setAccelRejection(float accel_rejection);
+    void setGyroBias(float bias_x, float bias_y, float bias_z);
+    void reset();
+    void initFromAccel(float ax, float ay, float az);
+    void update(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+    float getRoll();
+    float getPitch();
+    float getTilt();
+    float getYaw();
+
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef DATA_TYPES_H
+#define DATA_TYPES_H
+
+#include <stdint.h>
+
+/**
+ * ///////////////////////// DATA TYPES /////////////////////////
+ * shared by the sensor tasks, the sensor bus and the consumers
+*/
+
+/**
+ * identity of a sample, stamped once when it is acquired and carried along with the data
+ * so every stage down the pipeline can tell how old the sample it acts on is, see latency.h
+*/
+typedef struct Sample_Trace {
+    uint64_t acquired; /* 64-bit micros when the sample was taken - never wraps */
+    uint32_t sequence; /* one count for all the sensor streams, so it names a single sample */
+} sample_trace_t;
+
+typedef struct Acceleration_Data{
+    float ax;
+    float ay;
+    float az;
+    uint32_t timestamp; /* micros() when the sample was taken */
+    sample_trace_t trace;
+} accel_type_t;
+
+typedef struct Gyroscope_Data {
+    double gx;
+    double gy;
+    double gz;
+} gyro_type_t;
+
+typedef struct GPS_Data{
+    double latitude;
+    double longitude;
+    uint32_t time;
+} gps_type_t;
+
+typedef struct Altimeter_Data{
+    double pressure;
+    double altitude;
+    double velocity;
+    double AGL; /* altitude above ground level */
+    uint32_t timestamp; /* micros() when the reading was collected */
+    sample_trace_t trace;
+} altimeter_type_t;
+
+/**
+ * telemetry schema - one X(type, name, format, step) per field, in wire order
+ * generates telemetry_type_t here, the field printer of the ground decoder (telemetry.h) and the
+ * fields of the delta codec (delta_codec.h). step is the default quantization step of the codec
+ * changing it changes the frame, so bump TELEMETRY_VERSION with it
+*/
+#define TELEMETRY_FIELDS(X) \
+    X(float, ax, "%.2f", 0.001f) \
+    X(float, ay, "%.2f", 0.001f) \
+    X(float, az, "%.2f", 0.001f) \
+    X(float, gx, "%.2f", 0.01f) \
+    X(float, gy, "%.2f", 0.01f) \
+    X(float, gz, "%.2f", 0.01f) \
+    X(int32_t, pressure, "%d", 1) \
+    X(float, altitude, "%.2f", 0.01f) \
+    X(float, velocity, "%.2f", 0.01f) \
+    X(float, AGL, "%.2f", 0.01f) /* altitude above ground level */ \
+    X(double, latitude, "%.8f", 1e-7) \
+    X(double, longitude, "%.8f", 1e-7) \
+    X(uint32_t, time, "%u", 1)
+
+#define TELEMETRY_DECLARE_FIELD(type, name, format, step) type name;
+
+/* packed so the struct is the wire format - no padding, sent as it lies in memory */
+typedef struct __attribute__((packed)) Telemetry_Data {
+    TELEMETRY_FIELDS(TELEMETRY_DECLARE_FIELD)
+} telemetry_type_t;
+
+/**
+ * ///////////////////////// END OF DATA TYPES /////////////////////////
+*/
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "defs.h"
+#include "ring_buffer.h"
+
+class Print;
+
+#define DEFERRED_LOG_MAX_ARGS       4
+#define DEFERRED_LOG_LINE_LENGTH    128     // a formatted line is cut to this
+
+/* how an argument was stored - 2 bits each in deferred_log_entry_t::types */
+#define DEFERRED_LOG_INT            0
+#define DEFERRED_LOG_UINT           1
+#define DEFERRED_LOG_FLOAT          2
+#define DEFERRED_LOG_STRING         3
+
+typedef union {
+    int32_t i;
+    uint32_t u;
+    float f;
+    const char* s;
+} deferred_log_arg_t;
+
+/**
+ * one debug line as the hot path leaves it - the format and the raw arguments, nothing formatted
+ * format is the printf string itself: a literal lives in flash for the whole run, so its address is
+ * the ID of the line and the drain task formats with it directly
+*/
+typedef struct {
+    const char* format;
+    uint8_t count;
+    uint8_t types;
+    deferred_log_arg_t args[DEFERRED_LOG_MAX_ARGS];
+} deferred_log_entry_t;
+
+/* every task logs into this one, debugLogTask empties it */
+extern MpscRingBuffer<deferred_log_entry_t, DEFERRED_LOG_RING_LENGTH> deferred_log_ring;
+
+/**
+ * Argument packing
+ * one overload per type, so the conversion is picked at compile time and a type the formatter cannot
+ * print (64-bit integers, pointers other than strings) does not compile. Integers are kept to 32 bits
+ * and doubles to float. A string must outlive the line - a literal or static storage, never a buffer
+ * on the stack
+*/
+inline void deferredLogStore(deferred_log_entry_t& entry, uint32_t i, int value) { entry.args[i].i = value; entry.types |= DEFERRED_LOG_INT << (2 * i); }
+inline void deferredLogStore(deferred_log_entry_t& entry, uint32_t i, long value) { entry.args[i].i = (int32_t) value; entry.types |= DEFERRED_LOG_INT << (2 * i); }
+inline void deferredLogStore(deferred_log_entry_t& entry, uint32_t i, unsigned int value) { entry.args[i].u = value; entry.types |= DEFERRED_LOG_UINT << (2 * i); }
+inline void deferredLogStore(deferred_log_entry_t& entry, uint32_t i, unsigned long value) { entry.args[i].u = (uint32_t) value; entry.types |= DEFERRED_LOG_UINT << (2 * i); }
+inline void deferredLogStore(deferred_log_entry_t& entry, uint32_t i, float value) { entry.args[i].f = value; entry.types |= DEFERRED_LOG_FLOAT << (2 * i); }
+inline void deferredLogStore(deferred_log_entry_t& entry, uint32_t i, double value) { entry.args[i].f = (float) value; entry.types |= DEFERRED_LOG_FLOAT << (2 * i); }
+inline void deferredLogStore(deferred_log_entry_t& entry, uint32_t i, const char* value) { entry.args[i].s = value; entry.types |= DEFERRED_LOG_STRING << (2 * i); }
+
+inline void deferredLogPack(deferred_log_entry_t& entry, uint32_t i) {}
+
+template <typename T, typename... Rest>
+inline void deferredLogPack(deferred_log_entry_t& entry, uint32_t i, T value, Rest... rest) {
+    deferredLogStore(entry, i, value);
+    deferredLogPack(entry, i + 1, rest...);
+}
+
+/**
+ * queue a debug line - printf format, up to DEFERRED_LOG_MAX_ARGS arguments
+ * a few stores and one compare and swap, never waits on the UART. A line that finds the ring full is
+ * dropped and counted, the drain task reports how many
+*/
+template <typename... Args>
+inline void deferredLog(const char* format, Args... args) {
+    static_assert(sizeof...(Args) <= DEFERRED_LOG_MAX_ARGS, "too many arguments for a deferred log line");
+
+    deferred_log_entry_t entry;
+    entry.format = format;
+    entry.count = sizeof...(Args);
+    entry.types = 0;
+    deferredLogPack(entry, 0, args...);
+
+    deferred_log_ring.push(entry);
+}
+
+/**
+ * format one line into out, at most size bytes with the terminator
+ * each conversion in the format takes the next argument, converted to what the conversion prints
+*/
+void deferredLogFormat(const deferred_log_entry_t& entry, char* out, size_t size);
+
+/**
+ * format and print up to max_entries queued lines
+ * consumer side - one task only. returns the number of lines printed
+*/
+uint32_t deferredLogDrain(Print& out, uint32_t max_entries);
+
+#endif
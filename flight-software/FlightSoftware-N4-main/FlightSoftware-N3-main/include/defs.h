@@ -4,20 +4,28 @@
 /* debug parameters for use during testing - set to 0 for production */
 #define DEBUG 1
 
+/* debug() and debugln() print right away and wait on the UART - for setup and other cold paths
+ * debugLog(format, ...) only queues the format and its raw arguments, debugLogTask prints them later -
+ * for the task loops, so a debug build keeps the timing of a production build. see deferred_log.h */
 #if DEBUG
 
 #define debug(x) Serial.print(x)
 #define debugln(x) Serial.println(x)
 #define debugf(x, y) Serial.printf(x, y)
+#define debugLog(...) deferredLog(__VA_ARGS__)
 
 #else
 
 #define debug(x)
 #define debugln(x)
 #define debugf(x, y)
+#define debugLog(...)
 
 #endif
 
+#define DEFERRED_LOG_RING_LENGTH 64 // power of two - lines waiting for debugLogTask
+#define DEBUG_LOG_INTERVAL_MS 20 // debugLogTask prints what arrived every this often
+
 /* end of debug parameters */
 
 /* timing constant */
@@ -29,15 +37,111 @@
 #define SEA_LEVEL_PRESSURE 101325 // Assume the sea level pressure is 101325 Pascals - this can change with weather
 #define BASE_ALTITUDE 1417 /* this value is the altitude at rocket launch site */
 
-/* tasks constants */
+/* flight state detection - State_machine::checkState on the fused altitude (m) and vertical velocity (m/s)
+ * the ground altitude is learned on the pad, heights below are above it
+ */
+#define GROUND_ALTITUDE_FILTER 0.02 // share of each pad estimate in the learned ground altitude
+#define LIFTOFF_ALTITUDE 2 // height and climb rate that mean lift off
+#define LIFTOFF_VELOCITY 5
+#define BURNOUT_VELOCITY_DROP 2 // climb rate lost from its peak once the motor is out
+#define PARACHUTE_VELOCITY_RISE 3 // fall rate lost from its peak once the parachute is open
+#define PARACHUTE_DESCENT_RATE 35 // a fall that stops speeding up below this rate is under a parachute
+#define PARACHUTE_SPEED_UP 0.5 // "stopped speeding up": gained less than this over PARACHUTE_WINDOW_CHECKS
+#define PARACHUTE_WINDOW_CHECKS 10
+#define LANDED_VELOCITY 2 // still within this long enough on the ground means landed
+#define LANDED_ALTITUDE 30
+#define LANDED_TIME_MS 1000
+
+/* tasks constants
+ * where each task runs is set in the task table in main.cpp
+ * the Wi-Fi and Bluetooth stacks run on core 0 (PRO_CPU), setup() and loop() on core 1 (APP_CPU)
+ */
 #define STACK_SIZE 2048
+#define ACQUISITION_CORE 1 // sensors, fusion and the flight state
+#define SERVICE_CORE 0 // logging, statistics, telemetry and the network
 #define ALTIMETER_QUEUE_LENGTH 10 // todo: change to 2 items
-#define GYROSCOPE_QUEUE_LENGTH 10
+#define ACCEL_RING_LENGTH 64 // power of two, holds at least one FIFO drain
+#define ALTIMETER_RING_LENGTH 8 // power of two
+#define IMU_QUEUE_LENGTH 32 // holds at least one FIFO drain
+
+/* IMU acquisition
+ * IMU_USE_FIFO 1: the MPU6050 samples on its own clock into its FIFO and the read task
+ * sleeps until IMU_FIFO_BATCH data ready interrupts have arrived, then drains the batch
+ * IMU_USE_FIFO 0: the read task polls the output registers every IMU_POLL_INTERVAL_MS
+ */
+#define IMU_USE_FIFO 1
+#define IMU_SAMPLE_RATE_HZ 1000
+#define IMU_FIFO_BATCH 8
+#define IMU_FIFO_MAX_DRAIN 32 // samples drained per wake-up at most - catches up after a late wake-up
+#define IMU_FIFO_TIMEOUT_MS 20 // recover if interrupt edges were missed
+#define IMU_INT_PIN 27
+#define IMU_POLL_INTERVAL_MS 1 // one tick - the fastest a polling task can wake and still let the core go
+
+/* attitude estimator: AttitudeEstimator::COMPLEMENTARY or AttitudeEstimator::MADGWICK */
+#define ATTITUDE_MODE AttitudeEstimator::COMPLEMENTARY
+
+/* BMP180 acquisition
+ * oversampling 0 (fastest, ~200 Hz) to 3 (highest resolution, ~38 Hz) - can also be changed at runtime
+ * temperature is re-read once every BMP180_TEMPERATURE_INTERVAL pressure readings
+ */
+#define BMP180_OVERSAMPLING 3
+#define BMP180_TEMPERATURE_INTERVAL 10
 #define GPS_QUEUE_LENGTH 24
 #define ALL_TELEMETRY_DATA_QUEUE_LENGTH  10
 #define FILTERED_DATA_QUEUE_LENGTH 10
 #define FLIGHT_STATES_QUEUE_LENGTH 1
 
+/* rates of the tasks reading the sensor bus */
+#define FLIGHT_STATE_INTERVAL_MS 20
+#define DEBUG_INTERVAL_MS 200
+#define TELEMETRY_INTERVAL_MS 100
+
+/* flash logging
+ * the writer drains the log rings every FLASH_LOG_INTERVAL_MS - the IMU ring holds that many samples and more
+ * the programming task wakes at least every FLASH_LOG_ERASE_INTERVAL_MS to keep erasing ahead
+ */
+#define FLASH_LOG_INTERVAL_MS 20
+#define FLASH_LOG_ERASE_INTERVAL_MS 100
+#define LOG_IMU_RING_LENGTH 128 // power of two
+#define LOG_ALTIMETER_RING_LENGTH 16 // power of two
+
+/* pre-trigger - the flash log starts at lift off, with the history of the pad ahead of it
+ * the boost acceleration on LAUNCH_TRIGGER_CHECKS estimates in a row, the climb above the pad if the IMU
+ * is lost, or the state machine past PRE_FLIGHT, whichever comes first
+ */
+#define LAUNCH_TRIGGER_ACCELERATION 20 // m/s^2 vertical, ~2g of thrust on top of gravity
+#define LAUNCH_TRIGGER_CHECKS 3 // logWriterTask estimates, FLASH_LOG_INTERVAL_MS apart
+#define LAUNCH_TRIGGER_ALTITUDE 30 // m above the pad
+
+/* task statistics
+ * the reporter samples every task's loop timing and stack, the fill of the queues and rings and the
+ * sample latency percentiles of the pipeline stages into the flash log every TASK_STATS_INTERVAL_MS
+ */
+#define TASK_STATS_INTERVAL_MS 1000
+#define TASK_LOG_RING_LENGTH 16 // power of two, holds one report of every task
+#define CHANNEL_LOG_RING_LENGTH 8 // power of two
+#define LATENCY_LOG_RING_LENGTH 8 // power of two, holds two reports of every pipeline stage
+
+/* Kalman filter modes
+ * KALMAN_STEADY_STATE: the gain is solved once from the constant model and each sample only runs
+ * the fixed gain predict/update
+ * KALMAN_FULL: covariance, inverse and gain are recomputed on every sample
+ */
+#define KALMAN_FULL 0
+#define KALMAN_STEADY_STATE 1
+#define KALMAN_MODE KALMAN_STEADY_STATE
+#define KALMAN_RICCATI_MAX_ITERATIONS 1000
+#define KALMAN_RICCATI_TOLERANCE 1e-5 // relative change of the gain, ~100 float ulps
+
+/* altitude fusion
+ * measurement variances of the barometric altitude (m^2) and vertical acceleration ((m/s^2)^2)
+ * and the white jerk density driving the process noise
+ */
+#define FUSION_ALTITUDE_VARIANCE 0.25
+#define FUSION_ACCEL_VARIANCE 0.75
+#define FUSION_JERK_PSD 50.0
+#define FUSION_TIMEOUT_MS 50 // still apply barometer samples if the IMU stream stalls
+
 /* MQTT constants */
 #define MQTT_SERVER "192.168.78.19"
 #define MQTT_PORT 1882
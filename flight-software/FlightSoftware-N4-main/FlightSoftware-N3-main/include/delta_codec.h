@@ -0,0 +1,259 @@
+// delta / quantized codec for telemetry records
+// plain C++ with no Arduino dependencies so ground tools and the host benchmark build from the same header
+#ifndef DELTA_CODEC_H
+#define DELTA_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "data_types.h"
+
+#define DELTA_KEYFRAME_INTERVAL     32      // records per keyframe - a lost record is repaired by the next keyframe
+#define DELTA_TAG_KEYFRAME          0x4B    // 'K' - absolute quantized values follow
+#define DELTA_TAG_DELTA             0x44    // 'D' - differences from the previous record follow
+#define DELTA_VARINT_MAX_LENGTH     5       // a 32 bit value takes at most 5 varint bytes
+
+#define DELTA_COUNT_FIELD(type, name, format, step) +1
+#define TELEMETRY_FIELD_COUNT (0 TELEMETRY_FIELDS(DELTA_COUNT_FIELD))
+
+// longest encoded record - tag and every field at full varint length
+#define DELTA_MAX_RECORD_LENGTH (1 + TELEMETRY_FIELD_COUNT * DELTA_VARINT_MAX_LENGTH)
+
+/**
+ * quantization of one field type to a 32 bit integer and back
+ * the step of a field is stored in the field's own type, so integer fields keep integer steps
+*/
+template <typename T> struct DeltaQuantizer;
+
+template <> struct DeltaQuantizer<float> {
+    static float inverse(float step) { return 1.0f / step; }
+    static int32_t quantize(float value, float step, float inv_step) {
+        float q = value * inv_step;
+        if(q > 2.0e9f) q = 2.0e9f;
+        if(q < -2.0e9f) q = -2.0e9f;
+        return (int32_t) (q + (q >= 0 ? 0.5f : -0.5f));
+    }
+    static float restore(int32_t q, float step) { return q * step; }
+};
+
+template <> struct DeltaQuantizer<double> {
+    static double inverse(double step) { return 1.0 / step; }
+    static int32_t quantize(double value, double step, double inv_step) {
+        double q = value * inv_step;
+        if(q > 2.0e9) q = 2.0e9;
+        if(q < -2.0e9) q = -2.0e9;
+        return (int32_t) (q + (q >= 0 ? 0.5 : -0.5));
+    }
+    static double restore(int32_t q, double step) { return q * step; }
+};
+
+template <> struct DeltaQuantizer<int32_t> {
+    static int32_t inverse(int32_t step) { return step; }
+    static int32_t quantize(int32_t value, int32_t step, int32_t inv_step) {
+        if(step <= 1) return value;
+        return (value + (value >= 0 ? step / 2 : -step / 2)) / step;
+    }
+    static int32_t restore(int32_t q, int32_t step) { return step <= 1 ? q : q * step; }
+};
+
+template <> struct DeltaQuantizer<uint32_t> {
+    static uint32_t inverse(uint32_t step) { return step; }
+    // the full 32 bits are kept - deltas wrap, so a counter like millis() stays exact
+    static int32_t quantize(uint32_t value, uint32_t step, uint32_t inv_step) {
+        return (int32_t) (step <= 1 ? value : (value + step / 2) / step);
+    }
+    static uint32_t restore(int32_t q, uint32_t step) { return step <= 1 ? (uint32_t) q : (uint32_t) q * step; }
+};
+
+/**
+ * zigzag maps small negative and positive numbers to small unsigned numbers: 0, -1, 1, -2 -> 0, 1, 2, 3
+*/
+inline uint32_t deltaZigzag(int32_t value) {
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+inline int32_t deltaUnzigzag(uint32_t value) {
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+/**
+ * little endian base 128 - 7 bits per byte, high bit set on all but the last byte
+ * returns the bytes written
+*/
+inline size_t deltaPutVarint(uint8_t* out, uint32_t value) {
+    size_t n = 0;
+    while(value >= 0x80) {
+        out[n++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t) value;
+    return n;
+}
+
+/**
+ * returns the bytes read, 0 if the varint runs past length or is longer than 5 bytes
+*/
+inline size_t deltaGetVarint(const uint8_t* in, size_t length, uint32_t& value) {
+    value = 0;
+    for(size_t n = 0; n < length && n < DELTA_VARINT_MAX_LENGTH; n++) {
+        value |= (uint32_t) (in[n] & 0x7F) << (7 * n);
+        if((in[n] & 0x80) == 0) return n + 1;
+    }
+    return 0;
+}
+
+#define DELTA_DEFAULT_STEP(type, name, format, step) (type) (step),
+
+/**
+ * default quantization steps from the schema
+*/
+inline telemetry_type_t deltaDefaultSteps() {
+    telemetry_type_t steps = { TELEMETRY_FIELDS(DELTA_DEFAULT_STEP) };
+    return steps;
+}
+
+#define DELTA_INVERT_STEP(type, name, format, step) this->_inv_step.name = DeltaQuantizer<type>::inverse(this->_step.name);
+#define DELTA_QUANTIZE_FIELD(type, name, format, step) q[i++] = DeltaQuantizer<type>::quantize(data.name, this->_step.name, this->_inv_step.name);
+#define DELTA_RESTORE_FIELD(type, name, format, step) data.name = DeltaQuantizer<type>::restore(q[i++], this->_step.name);
+
+/**
+ * Streaming encoder - telemetry records to keyframes and quantized deltas
+ *
+ * Every field is quantized to an integer number of steps. A keyframe carries the quantized values,
+ * the records after it only the difference from the previous record, zigzag varint packed - a
+ * field that moved by less than 64 steps costs one byte. The encoder keeps the quantized values it
+ * sent, not the raw ones, so the decoder reconstructs exactly and rounding never accumulates.
+ *
+ * Records are self-delimiting and the encoder never allocates, so the output can go straight into
+ * an MQTT payload or a flash page. Both ends must use the same steps.
+*/
+class TelemetryEncoder {
+    private:
+    telemetry_type_t _step;
+    telemetry_type_t _inv_step;
+    int32_t _previous[TELEMETRY_FIELD_COUNT];
+    uint16_t _keyframe_interval;
+    uint16_t _since_keyframe;
+    bool _keyframe_due;
+
+    public:
+    TelemetryEncoder(uint16_t keyframe_interval = DELTA_KEYFRAME_INTERVAL) {
+        this->_keyframe_interval = keyframe_interval;
+        this->_since_keyframe = 0;
+        this->setSteps(deltaDefaultSteps());
+    }
+
+    /**
+     * set the quantization step of every field, in the units of the field
+     * starts a new keyframe so the decoder is not mixing steps
+    */
+    void setSteps(const telemetry_type_t& steps) {
+        this->_step = steps;
+        TELEMETRY_FIELDS(DELTA_INVERT_STEP)
+        this->forceKeyframe();
+    }
+
+    /**
+     * make the next record a keyframe - e.g. when a new receiver joins or a log segment starts
+    */
+    void forceKeyframe() {
+        this->_keyframe_due = true;
+    }
+
+    /**
+     * encode one record into out
+     * returns the bytes written, 0 if capacity is below DELTA_MAX_RECORD_LENGTH
+    */
+    size_t encode(const telemetry_type_t& data, uint8_t* out, size_t capacity) {
+        if(capacity < DELTA_MAX_RECORD_LENGTH) return 0;
+
+        int32_t q[TELEMETRY_FIELD_COUNT];
+        int i = 0;
+        TELEMETRY_FIELDS(DELTA_QUANTIZE_FIELD)
+
+        bool keyframe = this->_keyframe_due || this->_since_keyframe >= this->_keyframe_interval;
+        size_t n = 0;
+
+        out[n++] = keyframe ? DELTA_TAG_KEYFRAME : DELTA_TAG_DELTA;
+        for(i = 0; i < TELEMETRY_FIELD_COUNT; i++) {
+            // wrapping difference - exact for every pair of 32 bit values
+            int32_t value = keyframe ? q[i] : (int32_t) ((uint32_t) q[i] - (uint32_t) this->_previous[i]);
+            n += deltaPutVarint(&out[n], deltaZigzag(value));
+            this->_previous[i] = q[i];
+        }
+
+        if(keyframe) {
+            this->_keyframe_due = false;
+            this->_since_keyframe = 0;
+        }
+        this->_since_keyframe++;
+
+        return n;
+    }
+
+};
+
+/**
+ * Streaming decoder - the inverse of TelemetryEncoder
+ * deltas before the first keyframe are rejected, so decoding can start anywhere in a stream
+*/
+class TelemetryDecoder {
+    private:
+    telemetry_type_t _step;
+    telemetry_type_t _inv_step;
+    int32_t _previous[TELEMETRY_FIELD_COUNT];
+    bool _synced;
+
+    public:
+    TelemetryDecoder() {
+        this->setSteps(deltaDefaultSteps());
+    }
+
+    void setSteps(const telemetry_type_t& steps) {
+        this->_step = steps;
+        TELEMETRY_FIELDS(DELTA_INVERT_STEP)
+        this->_synced = false;
+    }
+
+    bool isSynced() {
+        return this->_synced;
+    }
+
+    /**
+     * decode one record from in
+     * returns the bytes consumed, 0 if the record is incomplete, malformed or a delta with no keyframe
+     * before it - the caller skips a byte (or waits for more) and tries again
+    */
+    size_t decode(const uint8_t* in, size_t length, telemetry_type_t& data) {
+        if(length < 1) return 0;
+        if(in[0] != DELTA_TAG_KEYFRAME && in[0] != DELTA_TAG_DELTA) return 0;
+
+        bool keyframe = in[0] == DELTA_TAG_KEYFRAME;
+        if(!keyframe && !this->_synced) return 0;
+
+        int32_t q[TELEMETRY_FIELD_COUNT];
+        size_t n = 1;
+        int i;
+        for(i = 0; i < TELEMETRY_FIELD_COUNT; i++) {
+            uint32_t raw;
+            size_t used = deltaGetVarint(&in[n], length - n, raw);
+            if(used == 0) return 0;
+            n += used;
+
+            int32_t value = deltaUnzigzag(raw);
+            q[i] = keyframe ? value : (int32_t) ((uint32_t) this->_previous[i] + (uint32_t) value);
+        }
+
+        for(i = 0; i < TELEMETRY_FIELD_COUNT; i++) {
+            this->_previous[i] = q[i];
+        }
+        this->_synced = true;
+
+        i = 0;
+        TELEMETRY_FIELDS(DELTA_RESTORE_FIELD)
+
+        return n;
+    }
+
+};
+
+#endif
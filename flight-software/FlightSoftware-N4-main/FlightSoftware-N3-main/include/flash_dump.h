@@ -0,0 +1,151 @@
+// serial download protocol for the flash log
+// plain C++ with no Arduino dependencies so the host receiver builds from the same header
+#ifndef FLASH_DUMP_H
+#define FLASH_DUMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "telemetry.h"
+
+#define FLASH_DUMP_VERSION          1
+#define FLASH_DUMP_SYNC             0xD5
+#define FLASH_DUMP_START_BAUD       115200      // every session starts here, then both ends switch
+#define FLASH_DUMP_BAUD             921600      // default download rate - what the devkit's USB UART takes reliably
+#define FLASH_DUMP_CHUNK_SIZE       4096        // flash bytes per chunk frame
+#define FLASH_DUMP_WAIT_MS          250         // window at boot for the host to ask for download mode
+#define FLASH_DUMP_MAX_PAYLOAD      (sizeof(uint32_t) + FLASH_DUMP_CHUNK_SIZE)
+
+/* frame types
+ * host to board */
+#define FLASH_DUMP_HELLO            'H'         // uint32 baud - enter download mode, answered with INFO
+#define FLASH_DUMP_STREAM           'S'         // uint32 offset, uint32 end - send chunks from offset up to end
+#define FLASH_DUMP_CLEAR            'X'         // erase every log, answered with ACK when done
+#define FLASH_DUMP_QUIT             'Q'         // leave download mode - the board restarts
+/* board to host */
+#define FLASH_DUMP_INFO             'I'         // flash_dump_info_t
+#define FLASH_DUMP_CHUNK            'C'         // uint32 offset, then the flash bytes
+#define FLASH_DUMP_ACK              'A'
+
+/**
+ * | sync | type | length | payload | crc |
+ *    1      1       2     length     2
+ *
+ * little endian, crc is CRC-16/CCITT-FALSE over type, length and payload. A bad crc drops the frame
+ * and the host asks for the stream again from the first offset it is missing, so a download
+ * resumes where it stopped instead of starting over - also across runs of the receiver
+*/
+#define FLASH_DUMP_HEADER_LENGTH    4
+#define FLASH_DUMP_CRC_LENGTH       2
+
+typedef struct __attribute__((packed)) Flash_Dump_Info {
+    uint8_t version;                // FLASH_DUMP_VERSION
+    uint32_t capacity;              // flash size in bytes
+    uint32_t log_end;               // the end of a log download - LOG_RECORD_MAX_LENGTH past the last byte written
+    uint32_t chunk_size;            // FLASH_DUMP_CHUNK_SIZE
+    uint32_t baud;                  // rate the board switches to after this frame
+} flash_dump_info_t;
+
+/**
+ * write the frame header into out and return the crc over it
+ * the payload follows, then the crc continued over the payload with telemetryCrc16(payload, length, crc)
+*/
+inline uint16_t flashDumpHeader(uint8_t* out, uint8_t type, uint16_t length) {
+    out[0] = FLASH_DUMP_SYNC;
+    out[1] = type;
+    out[2] = (uint8_t) length;
+    out[3] = (uint8_t) (length >> 8);
+    return telemetryCrc16(out + 1, FLASH_DUMP_HEADER_LENGTH - 1);
+}
+
+/**
+ * a whole frame with its payload into out - for the short frames
+ * returns the frame length
+*/
+inline size_t flashDumpFrame(uint8_t* out, uint8_t type, const void* payload, uint16_t length) {
+    uint16_t crc = flashDumpHeader(out, type, length);
+    memcpy(out + FLASH_DUMP_HEADER_LENGTH, payload, length);
+    crc = telemetryCrc16(out + FLASH_DUMP_HEADER_LENGTH, length, crc);
+    out[FLASH_DUMP_HEADER_LENGTH + length] = (uint8_t) crc;
+    out[FLASH_DUMP_HEADER_LENGTH + length + 1] = (uint8_t) (crc >> 8);
+    return FLASH_DUMP_HEADER_LENGTH + length + FLASH_DUMP_CRC_LENGTH;
+}
+
+/**
+ * Byte at a time frame parser for both ends
+ *
+ * feed() every received byte; it returns true when a frame with a good crc is complete, and the
+ * frame stays in the buffer until the next feed(). Bytes that do not make a frame - boot messages,
+ * noise, a frame cut off by a baud switch - are skipped by hunting for the next sync byte.
+ * The buffer is the caller's, so the board gets by with a few bytes for the host's short frames.
+*/
+class FlashDumpParser {
+    private:
+    uint8_t* _buffer;
+    uint32_t _capacity;
+    uint32_t _position;
+    uint16_t _length;
+
+    public:
+    uint32_t bad_frames;            // crc failures and frames too long for the buffer
+
+    FlashDumpParser(uint8_t* buffer, uint32_t capacity) {
+        this->_buffer = buffer;
+        this->_capacity = capacity;
+        this->_position = 0;
+        this->_length = 0;
+        this->bad_frames = 0;
+    }
+
+    void reset() {
+        this->_position = 0;
+    }
+
+    bool feed(uint8_t byte) {
+        if(this->_position == 0 && byte != FLASH_DUMP_SYNC) return false;
+
+        this->_buffer[this->_position++] = byte;
+        if(this->_position == FLASH_DUMP_HEADER_LENGTH) {
+            this->_length = this->_buffer[2] | (uint16_t) this->_buffer[3] << 8;
+            if(FLASH_DUMP_HEADER_LENGTH + (uint32_t) this->_length + FLASH_DUMP_CRC_LENGTH > this->_capacity) {
+                this->bad_frames++;
+                this->_position = 0;
+            }
+            return false;
+        }
+        if(this->_position < FLASH_DUMP_HEADER_LENGTH + (uint32_t) this->_length + FLASH_DUMP_CRC_LENGTH) return false;
+
+        this->_position = 0;
+        uint32_t crc_at = FLASH_DUMP_HEADER_LENGTH + this->_length;
+        uint16_t crc = this->_buffer[crc_at] | (uint16_t) this->_buffer[crc_at + 1] << 8;
+        if(telemetryCrc16(this->_buffer + 1, crc_at - 1) != crc) {
+            this->bad_frames++;
+            return false;
+        }
+
+        return true;
+    }
+
+    uint8_t type() {
+        return this->_buffer[1];
+    }
+
+    uint16_t length() {
+        return this->_length;
+    }
+
+    const uint8_t* payload() {
+        return this->_buffer + FLASH_DUMP_HEADER_LENGTH;
+    }
+
+};
+
+// board side - src/flash_dump.cpp
+class SPIFlash;
+class HardwareSerial;
+class FlashLogger;
+
+bool flashDumpRequested(HardwareSerial& serial, uint32_t wait_ms, uint32_t& baud);
+void flashDumpServe(SPIFlash& flash, FlashLogger& logger, HardwareSerial& serial, uint32_t baud);
+
+#endif
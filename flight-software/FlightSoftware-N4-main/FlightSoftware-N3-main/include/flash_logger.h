@@ -0,0 +1,258 @@
+#ifndef FLASH_LOGGER_H
+#define FLASH_LOGGER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+
+class SPIFlash;
+
+#define FLASH_PAGE_SIZE             256
+#define FLASH_SECTOR_SIZE           4096
+#define FLASH_LOG_BUFFER_SIZE       (8 * FLASH_PAGE_SIZE)   // one RAM buffer, page aligned
+#define FLASH_LOG_ERASE_AHEAD       (4 * FLASH_SECTOR_SIZE) // erased space kept ahead of the write head
+#define FLASH_LOG_HISTORY_SIZE      (40 * 1024)             // pre-trigger history - ~2 s of IMU records at 1 kHz with the barometer
+#define FLASH_LOG_INDEX_INTERVAL    FLASH_SECTOR_SIZE       // record bytes between index records
+#define FLASH_LOG_VERSION           1
+#define FLASH_LOG_STATE_COUNT       7                       // PRE_FLIGHT to POST_FLIGHT
+#define FLASH_LOG_NO_ADDRESS        0xFFFFFFFF              // erased - the state was not reached, or its record left the pre-trigger history
+
+/* log record types - the first byte of every record
+ * erased flash reads 0xFF, so LOG_RECORD_ERASED marks the end of a boot's records. Each boot starts
+ * LOG_RECORD_MAX_LENGTH bytes after the last byte written before it - a reader skips a run of up to that
+ * many 0xFF bytes between boots, and a longer run is the end of the log */
+#define LOG_RECORD_IMU              0x01
+#define LOG_RECORD_ALTIMETER        0x02
+#define LOG_RECORD_FILTERED         0x03
+#define LOG_RECORD_STATE            0x04
+#define LOG_RECORD_INDEX            0x05    // written by the logger itself
+#define LOG_RECORD_HEADER           0x06    // first record of every boot
+#define LOG_RECORD_TASK             0x07    // task statistics, see task_stats.h
+#define LOG_RECORD_CHANNEL          0x08    // queue and ring statistics, see task_stats.h
+#define LOG_RECORD_LATENCY          0x09    // sample age per pipeline stage, see latency.h
+#define LOG_RECORD_ERASED           0xFF
+#define LOG_RECORD_MAX_LENGTH       48      // no record is longer - a new boot leaves this gap after the last one
+
+/**
+ * log record payloads - packed, written to flash as they lie in memory
+ * every payload starts with its micros() timestamp, the index records take their time from it
+*/
+typedef struct __attribute__((packed)) Log_IMU {
+    uint32_t timestamp;             // micros()
+    int16_t ax, ay, az;             // raw accelerometer counts
+    int16_t gx, gy, gz;             // raw gyroscope counts
+} log_imu_t;
+
+typedef struct __attribute__((packed)) Log_Altimeter {
+    uint32_t timestamp;             // micros()
+    int32_t pressure;               // Pa
+    int16_t temperature;            // 0.1 deg C
+} log_altimeter_t;
+
+typedef struct __attribute__((packed)) Log_Filtered {
+    uint32_t timestamp;             // micros()
+    float altitude;
+    float velocity;
+    float acceleration;
+} log_filtered_t;
+
+typedef struct __attribute__((packed)) Log_State {
+    uint32_t timestamp;             // micros()
+    uint8_t state;
+} log_state_t;
+
+/**
+ * loop statistics of one task over one reporting interval
+ * histogram bucket 0 counts wake-to-wake periods under 2^LOG_TASK_BUCKET_SHIFT us, bucket k the periods
+ * from 2^(k + LOG_TASK_BUCKET_SHIFT - 1) us up to twice that, and the last bucket everything longer
+*/
+#define LOG_TASK_NAME_LENGTH        8       // task names are cut to this, not terminated when full
+#define LOG_TASK_BUCKETS            12
+#define LOG_TASK_BUCKET_SHIFT       8       // 256 us - the last bucket starts at 262 ms
+
+typedef struct __attribute__((packed)) Log_Task {
+    uint32_t timestamp;             // micros()
+    char name[LOG_TASK_NAME_LENGTH];
+    uint16_t stack_free;            // least free stack since the task started - uxTaskGetStackHighWaterMark
+    uint16_t cpu;                   // 0.1 % of the interval between the task's wake-up and the end of its work
+    uint16_t loops;                 // wake-ups in the interval
+    uint32_t max_period;            // longest wake-to-wake period in the interval, us
+    uint16_t histogram[LOG_TASK_BUCKETS]; // wake-to-wake periods in the interval
+    uint8_t core;                   // the core the task registered on - see the task table in main.cpp
+} log_task_t;
+
+/**
+ * fill statistics of one queue or ring, both since boot
+*/
+typedef struct __attribute__((packed)) Log_Channel {
+    uint32_t timestamp;             // micros()
+    char name[LOG_TASK_NAME_LENGTH];
+    uint16_t capacity;
+    uint16_t high_water;            // most items ever waiting
+    uint32_t drops;                 // items lost because it was full
+} log_channel_t;
+
+/**
+ * how old the samples were when one pipeline stage acted on them, over one reporting interval
+ * age is from the acquisition of the sample, hop from its hand-over by the stage before - the two are
+ * the same for the filter, which takes the samples straight from the sensor tasks. Percentiles are the
+ * upper end of their histogram bucket, at most 25 % above the exact value; max is exact
+*/
+#define LOG_LATENCY_PERCENTILES     4       // p50, p90, p99, max
+
+typedef struct __attribute__((packed)) Log_Latency {
+    uint32_t timestamp;             // micros()
+    uint8_t stage;                  // latency_stage_t
+    uint16_t samples;               // samples the stage acted on in the interval
+    uint32_t sequence;              // sequence ID of the last of them
+    uint32_t age[LOG_LATENCY_PERCENTILES];  // us
+    uint32_t hop[LOG_LATENCY_PERCENTILES];  // us
+} log_latency_t;
+
+/**
+ * seek point, one every FLASH_LOG_INDEX_INTERVAL bytes of records
+ * address is where the record itself sits in the flash, so a reader dropped at any address finds the
+ * next record boundary by looking for an index record that names its own address
+*/
+typedef struct __attribute__((packed)) Log_Index {
+    uint32_t timestamp;             // micros() of the record after it
+    uint32_t address;               // flash address of this index record
+    uint8_t state;                  // flight state at this point
+} log_index_t;
+
+/**
+ * start of a boot's records
+ * transitions holds the address of the state record that first entered each flight state. They are
+ * left erased when the header is written and programmed in place as the states are reached - flash
+ * bits only go from 1 to 0, so each one is written once without erasing the header
+*/
+typedef struct __attribute__((packed)) Log_Header {
+    uint8_t version;                // FLASH_LOG_VERSION
+    uint32_t transitions[FLASH_LOG_STATE_COUNT];
+    uint32_t index_interval;        // FLASH_LOG_INDEX_INTERVAL
+    uint32_t address;               // flash address of this header record - never all 0xFF, so it ends the record
+} log_header_t;
+
+/**
+ * length of a whole record of the given type, type byte included
+ * 0 for a type this firmware does not write
+*/
+static_assert(1 + sizeof(log_header_t) <= LOG_RECORD_MAX_LENGTH, "LOG_RECORD_MAX_LENGTH is too small");
+static_assert(1 + sizeof(log_task_t) <= LOG_RECORD_MAX_LENGTH, "LOG_RECORD_MAX_LENGTH is too small");
+static_assert(1 + sizeof(log_latency_t) <= LOG_RECORD_MAX_LENGTH, "LOG_RECORD_MAX_LENGTH is too small");
+
+inline uint32_t logRecordLength(uint8_t type) {
+    switch(type) {
+        case LOG_RECORD_IMU:        return 1 + sizeof(log_imu_t);
+        case LOG_RECORD_ALTIMETER:  return 1 + sizeof(log_altimeter_t);
+        case LOG_RECORD_FILTERED:   return 1 + sizeof(log_filtered_t);
+        case LOG_RECORD_STATE:      return 1 + sizeof(log_state_t);
+        case LOG_RECORD_INDEX:      return 1 + sizeof(log_index_t);
+        case LOG_RECORD_HEADER:     return 1 + sizeof(log_header_t);
+        case LOG_RECORD_TASK:       return 1 + sizeof(log_task_t);
+        case LOG_RECORD_CHANNEL:    return 1 + sizeof(log_channel_t);
+        case LOG_RECORD_LATENCY:    return 1 + sizeof(log_latency_t);
+        default:                    return 0;
+    }
+}
+
+/**
+ * true if bytes hold an index record that sits at address - the way a reader finds a record boundary
+ * after jumping into the middle of a log
+*/
+inline bool logIsIndexAt(const uint8_t* bytes, uint32_t length, uint32_t address) {
+    if(length < 1 + sizeof(log_index_t) || bytes[0] != LOG_RECORD_INDEX) return false;
+
+    log_index_t index;
+    memcpy(&index, bytes + 1, sizeof(index));
+    return index.address == address && index.state < FLASH_LOG_STATE_COUNT;
+}
+
+/**
+ * Log-structured writer on the raw SPI flash
+ *
+ * Records are appended back to back from a start address - no filesystem, no open/close per record.
+ * Two page aligned RAM buffers take turns: the filling side (append) copies records into one while
+ * the programming side (program) writes the other out, so a slow page program or sector erase never
+ * holds up the records arriving meanwhile. Sectors are erased ahead of the write head, so programming
+ * only ever waits on the erase of a sector it has outrun.
+ *
+ * append and program are meant for two different tasks; each buffer is owned by one side at a time
+ * and handed over with an atomic flag. If both buffers are waiting to be programmed the record is
+ * dropped and counted - the caller never blocks.
+ *
+ * Boot: the end of the earlier logs is found by a binary search over written and erased pages, and
+ * logging continues after it. Only the sectors just ahead of the write head are erased, by the
+ * programming task, so boot does not wait for a chip erase and earlier flights are kept until clear() -
+ * the clear command of the download mode.
+ *
+ * Index: every boot starts with a header record holding the address of each flight state transition,
+ * and an index record (timestamp, its own address, flight state) follows every FLASH_LOG_INDEX_INTERVAL
+ * bytes of records. A post-flight tool reads the header to jump straight to e.g. APOGEE, or reads the
+ * flash at any address and scans at most FLASH_LOG_INDEX_INTERVAL bytes forward for the next index
+ * record to binary search by time, without downloading the whole log.
+ *
+ * Pre-trigger: while armed, records go into a RAM history ring instead of the flash, the oldest
+ * records making way for new ones, so the pad wait costs no flash. trigger() freezes the history and
+ * reserves flash space for it ahead of everything appended after, so the log holds the last
+ * FLASH_LOG_HISTORY_SIZE bytes before the trigger followed by the live stream without a gap.
+*/
+class FlashLogger {
+    private:
+    SPIFlash& _flash;
+    uint8_t _buffers[2][FLASH_LOG_BUFFER_SIZE] __attribute__((aligned(4)));
+    uint32_t _lengths[2];
+    std::atomic<bool> _full[2];     // set by the filling side, cleared by the programming side
+    uint8_t _fill;                  // buffer being filled
+    uint8_t _program;               // next buffer to program
+    uint32_t _write_address;        // next flash address to program
+    uint32_t _erased_until;         // flash from _write_address up to here is erased
+    uint32_t _log_end;              // flash address after the last record appended, filling side only
+    uint32_t _capacity;
+    bool _started;
+
+    uint32_t _header_address;
+    uint32_t _transitions[FLASH_LOG_STATE_COUNT]; // filling side writes, programming side patches the header
+    std::atomic<uint32_t> _transitions_pending;  // one bit per state waiting to be programmed into the header
+    uint32_t _since_index;          // record bytes appended since the last index record, filling side only
+    uint8_t _state;                 // last state logged, filling side only
+
+    uint8_t _history[FLASH_LOG_HISTORY_SIZE];
+    uint32_t _history_head;         // free running offset after the newest history record
+    uint32_t _history_tail;         // free running offset of the oldest history record
+    bool _pretrigger;               // records go to the history, filling side only
+    std::atomic<bool> _history_pending; // frozen history waiting to be programmed
+
+    bool handOver();
+    bool eraseTo(uint32_t address);
+    bool isPageErased(uint32_t page);
+    bool writeHeader(uint32_t address);
+    void noteTransition(uint8_t state, uint32_t address);
+    void programTransitions();
+    bool appendRecord(uint8_t type, const void* payload, uint8_t length);
+    void appendHistory(uint8_t type, const void* payload, uint8_t length);
+    void programHistory();
+
+    public:
+    uint32_t records;               // records accepted
+    uint32_t dropped;               // records lost because both buffers were waiting or the flash is full
+    uint32_t errors;                // failed page programs or sector erases
+
+    FlashLogger(SPIFlash& flash);
+    bool begin();
+    uint32_t findLogEnd();
+    bool clear();
+    bool append(uint8_t type, const void* payload, uint8_t length);
+    bool sync();
+    bool armPretrigger();
+    bool trigger();
+    bool isPretrigger();
+    bool pending();
+    uint32_t program();
+    uint32_t getWriteAddress();
+    bool isFull();
+
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <stdint.h>
+#include "kalman.h"
+
+/**
+ * Altitude and vertical velocity from the barometer and the accelerometer
+ *
+ * States are altitude, vertical velocity and vertical acceleration. Each sensor sample is applied
+ * as soon as it arrives, on its own, as a scalar update: the filter is first predicted forward to
+ * the sample's timestamp with the real elapsed time, so the fast accelerometer keeps the estimate
+ * current between the slow barometer readings.
+ *
+ * Process noise is the constant-acceleration model driven by white jerk of density jerk_psd.
+ * A sample older than the filter time (e.g. a barometer reading that waited in its queue while
+ * newer IMU samples were applied) is applied at the filter time.
+*/
+class AltitudeFusion {
+    private:
+    KalmanFilter<3, 2> _filter;
+    float _jerk_psd;
+    uint32_t _time; // timestamp of the estimate in micros()
+    bool _initialized;
+
+    void predictTo(uint32_t timestamp);
+
+    public:
+    static const int ALTITUDE = 0;
+    static const int ACCELERATION = 1;
+
+    AltitudeFusion(float altitude_variance, float accel_variance, float jerk_psd);
+    void updateAltitude(float altitude, uint32_t timestamp);
+    void updateAcceleration(float acceleration, uint32_t timestamp);
+    bool isInitialized();
+    uint32_t getTime();
+    float getAltitude();
+    float getVelocity();
+    float getAcceleration();
+
+};
+
+#endif
@@ -1,12 +1,242 @@
-
 #pragma once
 
+#include <math.h>
+#include <stdint.h>
+#include "data_types.h"
+
 /* define struct to hold filtered data*/
 struct Filtered_Data{
     float x_acceleration;
+    float altitude;
+    float velocity;
+    uint32_t timestamp; /* micros() of the newest sample in the estimate */
+    sample_trace_t trace; /* the newest sample in the estimate */
+    uint64_t published; /* 64-bit micros when the estimate was handed on */
 };
 
 
 /* this function returns Kalman-filtered data */
 struct Filtered_Data filterData(float);
 
+/* select KALMAN_FULL or KALMAN_STEADY_STATE - see defs.h */
+void setFilterMode(int);
+
+/**
+ * Linear Kalman filter with NX states and NZ measurements
+ *
+ * All storage is inside the instance and sized at compile time - no heap, no globals - so
+ * separate filters can run in separate tasks. The loops have compile-time bounds and are
+ * unrolled by the compiler.
+ *
+ * Measurements are assumed independent (diagonal R) and are applied one row at a time,
+ * which gives the same result as the joint update without a matrix inverse, and lets a
+ * single sensor update the filter on its own.
+*/
+template <int NX, int NZ>
+class KalmanFilter {
+    private:
+    float _K_ss[NX][NZ]; // steady state gain
+    bool _steady_state;
+
+    public:
+    float x[NX];        // state estimate
+    float P[NX][NX];    // estimate error covariance
+    float A[NX][NX];    // state transition
+    float Q[NX][NX];    // process noise covariance
+    float H[NZ][NX];    // measurement model, one row per measurement
+    float R[NZ];        // measurement noise variance of each measurement
+
+    KalmanFilter() {
+        for(int i = 0; i < NX; i++) {
+            this->x[i] = 0;
+            for(int j = 0; j < NX; j++) {
+                this->P[i][j] = (i == j) ? 1.0f : 0.0f;
+                this->A[i][j] = (i == j) ? 1.0f : 0.0f;
+                this->Q[i][j] = 0;
+            }
+            for(int j = 0; j < NZ; j++) {
+                this->_K_ss[i][j] = 0;
+            }
+        }
+
+        for(int i = 0; i < NZ; i++) {
+            this->R[i] = 1.0f;
+            for(int j = 0; j < NX; j++) {
+                this->H[i][j] = 0;
+            }
+        }
+
+        this->_steady_state = false;
+    }
+
+    /**
+     * Predicted state and covariance
+     * x = A x, P = A P A' + Q
+    */
+    void predict() {
+        float x_minus[NX];
+        float AP[NX][NX];
+
+        for(int i = 0; i < NX; i++) {
+            x_minus[i] = 0;
+            for(int k = 0; k < NX; k++) {
+                x_minus[i] += this->A[i][k] * this->x[k];
+            }
+        }
+        for(int i = 0; i < NX; i++) {
+            this->x[i] = x_minus[i];
+        }
+
+        if(this->_steady_state) return;
+
+        for(int i = 0; i < NX; i++) {
+            for(int j = 0; j < NX; j++) {
+                AP[i][j] = 0;
+                for(int k = 0; k < NX; k++) {
+                    AP[i][j] += this->A[i][k] * this->P[k][j];
+                }
+            }
+        }
+
+        for(int i = 0; i < NX; i++) {
+            for(int j = 0; j < NX; j++) {
+                float sum = this->Q[i][j];
+                for(int k = 0; k < NX; k++) {
+                    sum += AP[i][k] * this->A[j][k];
+                }
+                this->P[i][j] = sum;
+            }
+        }
+    }
+
+    /**
+     * Update with measurement row m only
+     * K = P h' / (h P h' + r), x += K (z - h x), P -= K h P
+    */
+    void updateScalar(int m, float z) {
+        float PH[NX]; // P h'
+        float S = this->R[m];
+        float y = z;
+
+        for(int i = 0; i < NX; i++) {
+            PH[i] = 0;
+            for(int k = 0; k < NX; k++) {
+                PH[i] += this->P[i][k] * this->H[m][k];
+            }
+            S += this->H[m][i] * PH[i];
+            y -= this->H[m][i] * this->x[i];
+        }
+
+        float S_inv = 1.0f / S;
+        for(int i = 0; i < NX; i++) {
+            float K = PH[i] * S_inv;
+            this->x[i] += K * y;
+
+            // P is symmetric, so h P is PH' - update one triangle and mirror it to keep it symmetric
+            for(int j = i; j < NX; j++) {
+                this->P[i][j] -= K * PH[j];
+                this->P[j][i] = this->P[i][j];
+            }
+        }
+    }
+
+    /**
+     * Update with all NZ measurements
+     * uses the fixed gain in steady state mode
+    */
+    void update(const float z[NZ]) {
+        if(!this->_steady_state) {
+            for(int m = 0; m < NZ; m++) {
+                this->updateScalar(m, z[m]);
+            }
+            return;
+        }
+
+        float y[NZ];
+        for(int m = 0; m < NZ; m++) {
+            y[m] = z[m];
+            for(int k = 0; k < NX; k++) {
+                y[m] -= this->H[m][k] * this->x[k];
+            }
+        }
+
+        for(int i = 0; i < NX; i++) {
+            for(int m = 0; m < NZ; m++) {
+                this->x[i] += this->_K_ss[i][m] * y[m];
+            }
+        }
+    }
+
+    /**
+     * one full filter cycle
+    */
+    void step(const float z[NZ]) {
+        this->predict();
+        this->update(z);
+    }
+
+    /**
+     * Solve the discrete Riccati equation by iterating the covariance recursion until the gain settles
+     * The gain for all measurements together is K = P H' R^-1 with P the updated covariance.
+     * P is left at the steady state covariance so the full filter can take over without a transient.
+     * tolerance is relative - the largest change of a gain element against the largest element. An
+     * absolute one would have to be below the float resolution of the bigger gains to mean anything
+     * returns false if the gain did not settle within max_iterations
+    */
+    bool solveSteadyStateGain(int max_iterations, float tolerance) {
+        bool steady_state = this->_steady_state;
+        bool converged = false;
+        float x_saved[NX];
+
+        for(int i = 0; i < NX; i++) x_saved[i] = this->x[i];
+        this->_steady_state = false;
+
+        for(int n = 0; n < max_iterations && !converged; n++) {
+            this->predict();
+            for(int m = 0; m < NZ; m++) {
+                // the covariance update does not depend on the measurement value
+                this->updateScalar(m, 0);
+            }
+
+            float change = 0, largest = 0;
+            for(int i = 0; i < NX; i++) {
+                for(int m = 0; m < NZ; m++) {
+                    float K = 0;
+                    for(int k = 0; k < NX; k++) {
+                        K += this->P[i][k] * this->H[m][k];
+                    }
+                    K /= this->R[m];
+
+                    float delta = fabsf(K - this->_K_ss[i][m]);
+                    if(delta > change) change = delta;
+                    if(fabsf(K) > largest) largest = fabsf(K);
+                    this->_K_ss[i][m] = K;
+                }
+            }
+
+            converged = change <= tolerance * largest;
+        }
+
+        for(int i = 0; i < NX; i++) this->x[i] = x_saved[i];
+        this->_steady_state = steady_state;
+
+        return converged;
+    }
+
+    /**
+     * switch between the full filter and the fixed gain filter
+     * solveSteadyStateGain() must have been called before enabling steady state mode
+    */
+    void setSteadyState(bool steady_state) {
+        this->_steady_state = steady_state;
+    }
+
+    bool isSteadyState() {
+        return this->_steady_state;
+    }
+
+    float gain(int i, int m) {
+        return this->_K_ss[i][m];
+    }
+
+};
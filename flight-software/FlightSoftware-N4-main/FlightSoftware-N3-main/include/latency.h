@@ -0,0 +1,78 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <atomic>
+#include "data_types.h"
+#include "flash_logger.h"
+
+/* histogram buckets - values under LATENCY_SUB_BUCKETS us have a bucket each, every octave above is
+ * split into LATENCY_SUB_BUCKETS, so a bucket is at most 25 % wide. The last one starts at ~1.8 s */
+#define LATENCY_SUB_BUCKET_BITS     2
+#define LATENCY_SUB_BUCKETS         (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKETS             80
+
+/**
+ * the stages a sample passes on its way from the sensor to a decision
+ * the flight state machine is the end of the apogee-to-deploy path, its age is the end-to-end latency
+*/
+typedef enum {
+    LATENCY_FILTER = 0,     // fuseAltitudeTask applied the sample
+    LATENCY_FSM,            // flight_state_check stepped the state machine on an estimate holding it
+    LATENCY_LOGGER,         // logWriterTask put that estimate in the flash log
+    LATENCY_TELEMETRY,      // transmitTelemetry sent it
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+/**
+ * distribution of one latency
+ *
+ * One task adds, the reporter takes the counts since its last take and clears them. Both sides touch
+ * the same counters, so the adds are atomic increments - a relaxed fetch_add per sample.
+*/
+class LatencyHistogram {
+    private:
+    std::atomic<uint32_t> _buckets[LATENCY_BUCKETS];
+    std::atomic<uint32_t> _max;
+
+    public:
+    LatencyHistogram();
+    void add(uint32_t us);
+
+    /**
+     * p50, p90, p99 and max since the last take into percentiles, reporter side only
+     * returns the number of values they were taken from
+    */
+    uint32_t take(uint32_t percentiles[LOG_LATENCY_PERCENTILES]);
+
+    static uint32_t bucketOf(uint32_t us);
+    static uint32_t bucketTop(uint32_t bucket);
+
+};
+
+/**
+ * 64-bit micros - the clock the samples are stamped with
+*/
+uint64_t latencyNow();
+
+/**
+ * stamp a sample at acquisition
+ * timestamp is its micros(), extended to 64 bits against the current time, so a sample read out of
+ * the IMU FIFO keeps the instant it was measured at
+*/
+sample_trace_t latencyStamp(uint32_t timestamp);
+
+/**
+ * a stage acted on a sample at now
+ * handed_over is when the stage before made it available - the acquisition for the first stage
+ * one task per stage
+*/
+void latencyRecord(latency_stage_t stage, const sample_trace_t& trace, uint64_t handed_over, uint64_t now);
+
+/**
+ * one record per stage that saw samples since the last call
+ * returns the number of records written
+*/
+uint32_t latencyReport(log_latency_t* records, uint32_t max_records);
+
+#endif
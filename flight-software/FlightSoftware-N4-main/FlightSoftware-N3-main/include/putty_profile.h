@@ -0,0 +1,134 @@
+#ifndef PUTTY_PROFILE_H
+#define PUTTY_PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "defs.h"
+
+#define PUTTY_CYCLE_MS          100         // one telemetry cycle per "Gyro data ready for sending" line
+#define PUTTY_FALL_ACCEL        4.9f        // m/s^2 - drag holds the fall from apogee to half of g
+#define PUTTY_DESCENT_RATE      15.0f       // m/s under the parachute
+#define PUTTY_OPENING_S         0.5f        // the canopy takes the fall down to the descent rate in this long
+
+/**
+ * Flight profile of log-data/putty.log for the host tools - flight_replay and the delta codec benchmark
+ *
+ * the log has the state the board reported every cycle but no sensor values, so the motion is built to
+ * match the states: a boost from powered flight to coasting, a coast under gravity and drag that stops
+ * exactly at apogee, a drag limited fall from apogee to parachute descent, the canopy slowing the fall
+ * to PUTTY_DESCENT_RATE and touchdown when the board reports post-flight, then still on the ground.
+ * Ballistic descent only marks time in the fall. The apogee is worked back from the landing, and the
+ * acceleration is constant in each phase, so height and velocity are exact at any time.
+ *
+ * load() fails when the log cannot be read or does not report powered flight, coasting, apogee,
+ * parachute descent and post-flight in that order.
+*/
+class PuttyProfile {
+    private:
+    enum { PAD, BOOST, COAST, FALL, OPENING, CHUTE, GROUND, PHASES };
+
+    float _start[PHASES];       // s from the first cycle
+    float _accel[PHASES];       // m/s^2 vertical
+    float _velocity[PHASES];    // m/s at the start of the phase
+    float _height[PHASES];      // m above the pad at the start of the phase
+
+    int phase(float t) const {
+        int p = PAD;
+        while(p + 1 < PHASES && t >= this->_start[p + 1]) p++;
+        return p;
+    }
+
+    public:
+    std::vector<int> states;    // the state of every cycle
+    size_t text;                // bytes of text the log spent on the cycles
+
+    bool load(const char* path) {
+        FILE* f = fopen(path, "r");
+        if(f == NULL) return false;
+
+        char line[512];
+        int state = 0;
+        bool state_next = false;
+        this->states.clear();
+        this->text = 0;
+        while(fgets(line, sizeof(line), f)) {
+            if(state_next) {
+                state = atoi(line);
+                state_next = false;
+            }
+            if(strstr(line, "FLIGHT:") || strstr(line, "COASTING:") || strstr(line, "APOGEE:") ||
+               strstr(line, "DESCENT:") || strstr(line, "DEPLOY:")) {
+                state_next = true;
+            }
+            if(strstr(line, "Gyro data ready for sending")) this->states.push_back(state);
+            if(!this->states.empty()) this->text += strlen(line);
+        }
+        fclose(f);
+
+        // when each state was first reported
+        float begins[POST_FLIGHT + 1];
+        for(int s = 0; s <= POST_FLIGHT; s++) begins[s] = -1;
+        for(size_t i = 0; i < this->states.size(); i++) {
+            int s = this->states[i];
+            if(s >= 0 && s <= POST_FLIGHT && begins[s] < 0) begins[s] = i * PUTTY_CYCLE_MS * 1e-3f;
+        }
+        const int needed[] = {POWERED_FLIGHT, COASTING, APOGEE, PARACHUTE_DESCENT, POST_FLIGHT};
+        for(int i = 0; i < 5; i++) {
+            if(begins[needed[i]] < 0 || (i > 0 && begins[needed[i]] <= begins[needed[i - 1]])) return false;
+        }
+
+        float burn = begins[COASTING] - begins[POWERED_FLIGHT];
+        float coast = begins[APOGEE] - begins[COASTING];
+        float fall = begins[PARACHUTE_DESCENT] - begins[APOGEE];
+        float chute = begins[POST_FLIGHT] - begins[PARACHUTE_DESCENT];
+        float opening = chute / 2 < PUTTY_OPENING_S ? chute / 2 : PUTTY_OPENING_S;
+
+        // from the ground up: the height the parachute needs to land on time, the fall above it, and the
+        // climb that reaches that apogee with the burnout velocity the coast stops in time
+        float fall_velocity = PUTTY_FALL_ACCEL * fall;
+        float deploy = (fall_velocity + PUTTY_DESCENT_RATE) * opening / 2 + PUTTY_DESCENT_RATE * (chute - opening);
+        float apogee = deploy + PUTTY_FALL_ACCEL * fall * fall / 2;
+        float burnout_velocity = 2 * apogee / (burn + coast);
+
+        const float start[PHASES] = {0, begins[POWERED_FLIGHT], begins[COASTING], begins[APOGEE],
+                                     begins[PARACHUTE_DESCENT], begins[PARACHUTE_DESCENT] + opening, begins[POST_FLIGHT]};
+        const float accel[PHASES] = {0, burnout_velocity / burn, -burnout_velocity / coast, -PUTTY_FALL_ACCEL,
+                                     (fall_velocity - PUTTY_DESCENT_RATE) / opening, 0, 0};
+        memcpy(this->_start, start, sizeof(start));
+        memcpy(this->_accel, accel, sizeof(accel));
+
+        this->_velocity[PAD] = 0;
+        this->_height[PAD] = 0;
+        for(int p = BOOST; p < PHASES; p++) {
+            float t = this->_start[p] - this->_start[p - 1];
+            this->_velocity[p] = this->_velocity[p - 1] + this->_accel[p - 1] * t;
+            this->_height[p] = this->_height[p - 1] + this->_velocity[p - 1] * t + this->_accel[p - 1] * t * t / 2;
+        }
+        this->_velocity[GROUND] = 0;
+        this->_height[GROUND] = 0;
+
+        return !this->states.empty();
+    }
+
+    // vertical acceleration in m/s^2 at t s from the first cycle
+    float accel(float t) const {
+        return this->_accel[this->phase(t)];
+    }
+
+    float velocity(float t) const {
+        int p = this->phase(t);
+        return this->_velocity[p] + this->_accel[p] * (t - this->_start[p]);
+    }
+
+    // m above the pad
+    float height(float t) const {
+        int p = this->phase(t);
+        float dt = t - this->_start[p];
+        return this->_height[p] + this->_velocity[p] * dt + this->_accel[p] * dt * dt / 2;
+    }
+};
+
+#endif
@@ -0,0 +1,276 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+// the indices are written by different cores - keep them on separate cache lines
+#ifndef RING_BUFFER_CACHE_LINE
+#define RING_BUFFER_CACHE_LINE 64
+#endif
+
+// forced inline so a push from an IRAM_ATTR interrupt handler stays in IRAM
+#define RING_BUFFER_INLINE inline __attribute__((always_inline))
+
+/**
+ * Lock-free single producer / single consumer ring buffer
+ *
+ * One task (or interrupt handler) pushes, one task pops. Neither side takes a lock or enters a
+ * critical section: the producer only writes _head, the consumer only writes _tail, and each
+ * publishes its index with a release store after the slot is written or read.
+ *
+ * N must be a power of two. Indices run freely and are masked on access, so all N slots are
+ * usable and full/empty need no extra flag.
+ *
+ * The buffer never blocks. A push into a full buffer is dropped and counted in overflows -
+ * sensor data is replaced by a newer sample soon, so waiting for space is never the right choice.
+ * A consumer that wants to sleep until data arrives pairs the buffer with a task notification.
+*/
+template <typename T, uint32_t N>
+class RingBuffer {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "RingBuffer size must be a power of two");
+
+    private:
+    static const uint32_t MASK = N - 1;
+
+    alignas(RING_BUFFER_CACHE_LINE) std::atomic<uint32_t> _head; // next slot to write, producer owned
+    alignas(RING_BUFFER_CACHE_LINE) std::atomic<uint32_t> _tail; // next slot to read, consumer owned
+    alignas(RING_BUFFER_CACHE_LINE) std::atomic<uint32_t> _overflows; // pushes dropped because the buffer was full
+    std::atomic<uint32_t> _high_water; // most items ever waiting, producer owned like _overflows
+    T _slots[N];
+
+    RING_BUFFER_INLINE void noteDepth(uint32_t depth) {
+        if(depth > this->_high_water.load(std::memory_order_relaxed)) {
+            this->_high_water.store(depth, std::memory_order_relaxed);
+        }
+    }
+
+    public:
+    RingBuffer() : _head(0), _tail(0), _overflows(0), _high_water(0) {}
+
+    /**
+     * add one item
+     * producer side only
+     * returns false and counts an overflow if the buffer is full
+    */
+    RING_BUFFER_INLINE bool push(const T& item) {
+        uint32_t head = this->_head.load(std::memory_order_relaxed);
+        uint32_t tail = this->_tail.load(std::memory_order_acquire);
+
+        if(head - tail >= N) {
+            this->_overflows.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        this->_slots[head & MASK] = item;
+        this->_head.store(head + 1, std::memory_order_release);
+        this->noteDepth(head + 1 - tail);
+        return true;
+    }
+
+    /**
+     * add up to count items with a single index update
+     * producer side only
+     * returns the number of items added - the rest are counted as overflows
+    */
+    RING_BUFFER_INLINE uint32_t pushBatch(const T* items, uint32_t count) {
+        uint32_t head = this->_head.load(std::memory_order_relaxed);
+        uint32_t tail = this->_tail.load(std::memory_order_acquire);
+        uint32_t space = N - (head - tail);
+        uint32_t n = count < space ? count : space;
+
+        for(uint32_t i = 0; i < n; i++) {
+            this->_slots[(head + i) & MASK] = items[i];
+        }
+        this->_head.store(head + n, std::memory_order_release);
+        this->noteDepth(head + n - tail);
+
+        if(n < count) {
+            this->_overflows.fetch_add(count - n, std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    /**
+     * take the oldest item
+     * consumer side only
+     * returns false if the buffer is empty
+    */
+    RING_BUFFER_INLINE bool pop(T& item) {
+        uint32_t tail = this->_tail.load(std::memory_order_relaxed);
+        uint32_t head = this->_head.load(std::memory_order_acquire);
+
+        if(head == tail) {
+            return false;
+        }
+
+        item = this->_slots[tail & MASK];
+        this->_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * take up to max_count of the oldest items with a single index update
+     * consumer side only
+     * returns the number of items taken
+    */
+    RING_BUFFER_INLINE uint32_t popBatch(T* items, uint32_t max_count) {
+        uint32_t tail = this->_tail.load(std::memory_order_relaxed);
+        uint32_t head = this->_head.load(std::memory_order_acquire);
+        uint32_t available = head - tail;
+        uint32_t n = max_count < available ? max_count : available;
+
+        for(uint32_t i = 0; i < n; i++) {
+            items[i] = this->_slots[(tail + i) & MASK];
+        }
+        this->_tail.store(tail + n, std::memory_order_release);
+
+        return n;
+    }
+
+    /**
+     * number of items waiting
+     * exact from the consumer, a lower bound of the free space from the producer
+    */
+    uint32_t size() const {
+        return this->_head.load(std::memory_order_acquire) - this->_tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return this->size() == 0;
+    }
+
+    static constexpr uint32_t capacity() {
+        return N;
+    }
+
+    uint32_t overflows() const {
+        return this->_overflows.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * most items ever waiting, as seen by the producer after its pushes
+    */
+    uint32_t highWater() const {
+        return this->_high_water.load(std::memory_order_relaxed);
+    }
+
+};
+
+/**
+ * Lock-free multiple producer / single consumer ring buffer
+ *
+ * Any number of tasks push, one task pops. Every slot carries a sequence number that says whose turn
+ * it is: a producer claims the slot at _head with one compare and swap, writes the item and hands the
+ * slot to the consumer by advancing the slot's sequence; the consumer hands it back to the producers
+ * of the next lap the same way. A producer preempted between the claim and the hand-over only holds
+ * up the consumer at that slot - the other producers carry on with the slots after it.
+ *
+ * Same rules as RingBuffer otherwise: N a power of two, never blocks, a push into a full buffer is
+ * dropped and counted in overflows.
+*/
+template <typename T, uint32_t N>
+class MpscRingBuffer {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscRingBuffer size must be a power of two");
+
+    private:
+    static const uint32_t MASK = N - 1;
+
+    struct Slot {
+        std::atomic<uint32_t> sequence; // index of the push that may write it, that + 1 once written
+        T item;
+    };
+
+    alignas(RING_BUFFER_CACHE_LINE) std::atomic<uint32_t> _head; // next slot to claim, shared by the producers
+    alignas(RING_BUFFER_CACHE_LINE) std::atomic<uint32_t> _tail; // next slot to read, consumer owned
+    alignas(RING_BUFFER_CACHE_LINE) std::atomic<uint32_t> _overflows; // pushes dropped because the buffer was full
+    std::atomic<uint32_t> _high_water; // most items ever waiting
+    Slot _slots[N];
+
+    public:
+    MpscRingBuffer() : _head(0), _tail(0), _overflows(0), _high_water(0) {
+        for(uint32_t i = 0; i < N; i++) {
+            this->_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * add one item
+     * any task
+     * returns false and counts an overflow if the buffer is full
+    */
+    RING_BUFFER_INLINE bool push(const T& item) {
+        uint32_t head = this->_head.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        while(true) {
+            slot = &this->_slots[head & MASK];
+            int32_t turn = (int32_t) (slot->sequence.load(std::memory_order_acquire) - head);
+
+            if(turn == 0) {
+                // free for this lap - claim it, or retry from the head another producer moved to
+                if(this->_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) break;
+            } else if(turn < 0) {
+                // the consumer has not read it since the last lap
+                this->_overflows.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                head = this->_head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->item = item;
+        slot->sequence.store(head + 1, std::memory_order_release);
+
+        uint32_t depth = head + 1 - this->_tail.load(std::memory_order_relaxed);
+        uint32_t high_water = this->_high_water.load(std::memory_order_relaxed);
+        while(depth > high_water && !this->_high_water.compare_exchange_weak(high_water, depth, std::memory_order_relaxed));
+        return true;
+    }
+
+    /**
+     * take the oldest item
+     * consumer side only
+     * returns false if the buffer is empty, or its oldest slot is claimed but not written yet
+    */
+    RING_BUFFER_INLINE bool pop(T& item) {
+        uint32_t tail = this->_tail.load(std::memory_order_relaxed);
+        Slot& slot = this->_slots[tail & MASK];
+
+        if(slot.sequence.load(std::memory_order_acquire) != tail + 1) {
+            return false;
+        }
+
+        item = slot.item;
+        slot.sequence.store(tail + N, std::memory_order_release);
+        this->_tail.store(tail + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * take up to max_count of the oldest items
+     * consumer side only
+     * returns the number of items taken
+    */
+    RING_BUFFER_INLINE uint32_t popBatch(T* items, uint32_t max_count) {
+        uint32_t n = 0;
+        while(n < max_count && this->pop(items[n])) n++;
+        return n;
+    }
+
+    static constexpr uint32_t capacity() {
+        return N;
+    }
+
+    uint32_t overflows() const {
+        return this->_overflows.load(std::memory_order_relaxed);
+    }
+
+    uint32_t highWater() const {
+        return this->_high_water.load(std::memory_order_relaxed);
+    }
+
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef SENSOR_BUS_H
+#define SENSOR_BUS_H
+
+#include <stdint.h>
+#include <atomic>
+#include "data_types.h"
+#include "kalman.h"
+
+// a reader gives up after this many torn reads and keeps its previous snapshot
+// bounds the spin when a higher priority reader preempts the writer on the same core
+#define SENSOR_BUS_READ_RETRIES 8
+
+/**
+ * Latest value of one data stream behind a seqlock
+ *
+ * One writer publishes, any number of readers take snapshots at their own rate. The writer never
+ * waits for readers: it makes the sequence odd, writes the value and makes it even again. A reader
+ * copies the value between two reads of the sequence and retries if the sequence was odd or has
+ * moved, so a snapshot is never a mix of two publications.
+ *
+ * Unlike a queue a read does not consume anything - every reader sees the latest value, and
+ * intermediate values a slow reader misses are simply skipped.
+*/
+template <typename T>
+class Topic {
+    private:
+    std::atomic<uint32_t> _sequence; // odd while a write is in progress
+    T _value;
+
+    public:
+    Topic() : _sequence(0), _value() {}
+
+    /**
+     * replace the value
+     * one writer per topic
+    */
+    void publish(const T& value) {
+        uint32_t sequence = this->_sequence.load(std::memory_order_relaxed);
+
+        this->_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        this->_value = value;
+
+        this->_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /**
+     * copy out a consistent snapshot of the latest value
+     * returns false if nothing has been published yet or the writer kept the value busy for
+     * SENSOR_BUS_READ_RETRIES attempts - value is left untouched then
+    */
+    bool read(T& value) const {
+        for(int attempt = 0; attempt < SENSOR_BUS_READ_RETRIES; attempt++) {
+            uint32_t before = this->_sequence.load(std::memory_order_acquire);
+            if(before == 0) return false;
+            if(before & 1) continue;
+
+            T snapshot = this->_value;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(this->_sequence.load(std::memory_order_relaxed) == before) {
+                value = snapshot;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * number of values published so far
+     * a reader compares it with the count at its last read to tell whether the value is new
+    */
+    uint32_t count() const {
+        return this->_sequence.load(std::memory_order_acquire) / 2;
+    }
+
+};
+
+/**
+ * all the topics shared between the tasks
+ * the producer of each topic is noted beside it
+*/
+struct SensorBus {
+    Topic<accel_type_t> accel;              // readAccelerationTask
+    Topic<gyro_type_t> gyro;                // readAccelerationTask
+    Topic<altimeter_type_t> altimeter;      // readAltimeter
+    Topic<gps_type_t> gps;                  // readGPS
+    Topic<struct Filtered_Data> filtered;   // fuseAltitudeTask
+    Topic<int32_t> flight_state;            // flight_state_check
+};
+
+#endif
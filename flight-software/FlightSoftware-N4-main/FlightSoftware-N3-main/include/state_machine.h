@@ -1,16 +1,42 @@
 #ifndef STATE_MACHINE_H
 #define STATE_MACHINE_H
 
+#include <stdint.h>
 #include "defs.h"
 
+/**
+ * Flight state from the fused altitude and vertical velocity
+ *
+ * checkState is stepped with the newest estimate every FLIGHT_STATE_INTERVAL_MS and returns the state
+ * of the flight. States only move forward: pre-flight, powered flight, coasting, apogee, ballistic
+ * descent, parachute descent, post-flight. Apogee is returned once, on the estimate the climb ended at.
+ * A parachute is seen either way it shows: slowing a fall that was faster than its descent rate, or
+ * stopping a slower fall - one opened at apogee - from speeding up. A descent without a parachute goes
+ * from ballistic descent to post-flight.
+*/
 class State_machine{
+    private:
+        int32_t _state;
+        float _ground_altitude;     // learned on the pad
+        float _max_altitude;
+        float _peak_velocity;       // fastest climb in powered flight, fastest fall in ballistic descent
+        float _fall[PARACHUTE_WINDOW_CHECKS];  // last velocities in ballistic descent
+        uint32_t _fall_checks;
+        uint32_t _still_checks;     // checks in a row on the ground and not moving
+        bool _initialized;
+
+        bool liftOff(float height, float velocity);
+        bool burnout(float velocity);
+        bool apogee(float velocity);
+        bool parachuteOpen(float velocity);
+        bool landed(float height, float velocity);
 
     public:
-        int32_t checkState(float, float);
+        State_machine();
+        int32_t checkState(float altitude, float velocity);
+        int32_t getState();
+        float getGroundAltitude();
+        float getMaxAltitude();
 };
 
-int32_t State_machine::checkState(float, float){
-    return PRE_FLIGHT;
-}
-
 #endif
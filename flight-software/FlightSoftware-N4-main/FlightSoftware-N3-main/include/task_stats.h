@@ -0,0 +1,98 @@
+#ifndef TASK_STATS_H
+#define TASK_STATS_H
+
+#include <stdint.h>
+#include <atomic>
+#include "flash_logger.h"
+
+#define TASK_STATS_MAX_TASKS        12
+
+/**
+ * Loop timing of one task
+ *
+ * The task calls begin() when it wakes up and end() when the work of that wake-up is done. begin()
+ * files the period since the last wake-up into a log2 histogram and keeps the longest one; end() adds
+ * the time since begin() to the busy time the CPU share comes from. The busy time is wall time, so it
+ * includes any preemption by higher priority tasks.
+ *
+ * Only the task writes its counters and the reporter only reads them, apart from taking the longest
+ * period, so there is no lock - two micros() calls and a few relaxed stores per loop.
+*/
+class TaskStats {
+    private:
+    void* _handle;                  // TaskHandle_t
+    char _name[LOG_TASK_NAME_LENGTH];
+    uint8_t _core;
+    uint32_t _wake;                 // micros() of the last begin()
+    bool _started;
+    std::atomic<uint32_t> _loops;
+    std::atomic<uint32_t> _busy;    // us
+    std::atomic<uint32_t> _max_period; // us, taken and cleared by the reporter
+    std::atomic<uint32_t> _histogram[LOG_TASK_BUCKETS];
+
+    // reporter side - the counters at the last report
+    uint32_t _reported_loops;
+    uint32_t _reported_busy;
+    uint32_t _reported_histogram[LOG_TASK_BUCKETS];
+    uint32_t _reported_time;
+
+    public:
+    TaskStats();
+    void attach(void* handle, const char* name, uint8_t core, uint32_t now);
+    void begin();
+    void end();
+    void report(uint32_t now, log_task_t& record);
+
+};
+
+/**
+ * fill statistics of a FreeRTOS queue
+ * the ring buffers count their own, a queue is watched from the outside: the producer counts the sends
+ * that failed and the consumer notes how many items were waiting when it took one
+*/
+class ChannelStats {
+    private:
+    std::atomic<uint32_t> _high_water;
+    std::atomic<uint32_t> _drops;
+
+    public:
+    ChannelStats() : _high_water(0), _drops(0) {}
+
+    void depth(uint32_t waiting) {
+        if(waiting > this->_high_water.load(std::memory_order_relaxed)) {
+            this->_high_water.store(waiting, std::memory_order_relaxed);
+        }
+    }
+
+    void drop() {
+        this->_drops.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t highWater() const {
+        return this->_high_water.load(std::memory_order_relaxed);
+    }
+
+    uint32_t drops() const {
+        return this->_drops.load(std::memory_order_relaxed);
+    }
+
+};
+
+/**
+ * statistics slot for the calling task - called once at the start of the task function
+ * past TASK_STATS_MAX_TASKS the slot is a shared one that is never reported
+*/
+TaskStats* taskStatsRegister();
+
+/**
+ * one record per registered task with its loops since the last call
+ * returns the number of records written
+*/
+uint32_t taskStatsReport(log_task_t* records, uint32_t max_records);
+
+/**
+ * channel record from the numbers of a queue or ring
+*/
+log_channel_t taskStatsChannel(uint32_t timestamp, const char* name, uint32_t capacity, uint32_t high_water, uint32_t drops);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef TASK_TABLE_H
+#define TASK_TABLE_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * one task of the flight software - where it runs and how often
+ * the entry itself is the task's parameter, so a periodic task takes its period from the table
+*/
+typedef struct {
+    TaskFunction_t function;
+    const char* name;
+    uint32_t stack;                 // stack depth as xTaskCreatePinnedToCore takes it
+    UBaseType_t priority;
+    BaseType_t core;                // ACQUISITION_CORE, SERVICE_CORE or tskNO_AFFINITY
+    uint32_t period_ms;             // wake-up period, 0 for a task woken by its data
+} task_config_t;
+
+/**
+ * create every task of table in order
+ * returns the number created - the failures are printed
+*/
+uint32_t startTasks(const task_config_t* table, uint32_t count);
+
+/**
+ * the period of the calling task, from the table entry it was given as its parameter
+*/
+inline TickType_t taskPeriod(void* parameters) {
+    return pdMS_TO_TICKS(((const task_config_t*) parameters)->period_ms);
+}
+
+#endif
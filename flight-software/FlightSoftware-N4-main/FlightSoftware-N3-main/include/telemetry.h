@@ -0,0 +1,121 @@
+// binary telemetry frame
+// plain C++ with no Arduino dependencies so the ground decoder builds from the same header
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "data_types.h"
+
+#define TELEMETRY_SYNC      0x5AA5  // first two bytes of every frame, 0xA5 0x5A on the wire
+#define TELEMETRY_VERSION   1
+
+/**
+ * one telemetry frame exactly as it goes on the wire - little endian, no padding
+ * the ESP32 and the ground station are both little endian, so the struct is sent and read in place
+ *
+ * | sync | version | flight state | sequence | timestamp | telemetry_type_t | crc |
+ *    2       1           1             4          4             60             2   = 74 bytes
+ *
+ * crc is CRC-16/CCITT-FALSE over everything from version up to the crc
+*/
+typedef struct __attribute__((packed)) Telemetry_Frame {
+    uint16_t sync;
+    uint8_t version;
+    uint8_t flight_state;
+    uint32_t sequence;      // frames sent since boot - gaps show lost frames
+    uint32_t timestamp;     // millis() when the frame was sealed
+    telemetry_type_t data;
+    uint16_t crc;
+} telemetry_frame_t;
+
+static_assert(sizeof(telemetry_type_t) == 60, "telemetry_type_t layout changed - bump TELEMETRY_VERSION");
+static_assert(sizeof(telemetry_frame_t) == 74, "telemetry frame layout changed - bump TELEMETRY_VERSION");
+
+// decode results
+#define TELEMETRY_OK            0
+#define TELEMETRY_SHORT         1   // fewer bytes than a frame
+#define TELEMETRY_BAD_SYNC      2
+#define TELEMETRY_BAD_VERSION   3
+#define TELEMETRY_BAD_CRC       4
+
+/**
+ * CRC-16/CCITT-FALSE, poly 0x1021, init 0xFFFF
+ * a nibble table - 32 bytes of flash instead of 512, two lookups per byte
+ * pass the crc of the bytes before as crc to continue it over data sent in pieces
+*/
+inline uint16_t telemetryCrc16(const uint8_t* data, size_t length, uint16_t crc = 0xFFFF) {
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    };
+
+    for(size_t i = 0; i < length; i++) {
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)];
+    }
+
+    return crc;
+}
+
+/**
+ * bytes covered by the crc
+*/
+inline const uint8_t* telemetryCrcStart(const telemetry_frame_t& frame) {
+    return (const uint8_t*) &frame + offsetof(telemetry_frame_t, version);
+}
+
+#define TELEMETRY_CRC_LENGTH (offsetof(telemetry_frame_t, crc) - offsetof(telemetry_frame_t, version))
+
+/**
+ * fill in the header and crc of a frame whose data has been written in place
+ * the frame is then sent as is: (const uint8_t*) &frame, sizeof(frame)
+*/
+inline void telemetrySeal(telemetry_frame_t& frame, uint8_t flight_state, uint32_t sequence, uint32_t timestamp) {
+    frame.sync = TELEMETRY_SYNC;
+    frame.version = TELEMETRY_VERSION;
+    frame.flight_state = flight_state;
+    frame.sequence = sequence;
+    frame.timestamp = timestamp;
+    frame.crc = telemetryCrc16(telemetryCrcStart(frame), TELEMETRY_CRC_LENGTH);
+}
+
+/**
+ * check a received frame in place
+ * on success frame points into buffer - nothing is copied
+ * returns TELEMETRY_OK or the reason the bytes are not a valid frame
+*/
+inline int telemetryDecode(const uint8_t* buffer, size_t length, const telemetry_frame_t*& frame) {
+    if(length < sizeof(telemetry_frame_t)) return TELEMETRY_SHORT;
+
+    // the frame struct is packed, so any byte offset is a valid frame address
+    const telemetry_frame_t* candidate = (const telemetry_frame_t*) buffer;
+
+    if(candidate->sync != TELEMETRY_SYNC) return TELEMETRY_BAD_SYNC;
+    if(candidate->version != TELEMETRY_VERSION) return TELEMETRY_BAD_VERSION;
+    if(telemetryCrc16(telemetryCrcStart(*candidate), TELEMETRY_CRC_LENGTH) != candidate->crc) return TELEMETRY_BAD_CRC;
+
+    frame = candidate;
+    return TELEMETRY_OK;
+}
+
+#define TELEMETRY_PRINT_NAME(type, name, format, step) fputs("," #name, out);
+#define TELEMETRY_PRINT_FIELD(type, name, format, step) { type value = frame.data.name; fprintf(out, "," format, value); }
+
+/**
+ * csv header and rows for ground tools, columns generated from the schema
+*/
+inline void telemetryPrintHeader(FILE* out) {
+    fputs("sequence,timestamp,flight_state", out);
+    TELEMETRY_FIELDS(TELEMETRY_PRINT_NAME)
+    fputc('\n', out);
+}
+
+inline void telemetryPrintFrame(FILE* out, const telemetry_frame_t& frame) {
+    fprintf(out, "%u,%u,%u", (unsigned) frame.sequence, (unsigned) frame.timestamp, (unsigned) frame.flight_state);
+    TELEMETRY_FIELDS(TELEMETRY_PRINT_FIELD)
+    fputc('\n', out);
+}
+
+#endif
@@ -0,0 +1,151 @@
+// host shim of the ESP32 Arduino core - just what the flight software uses
+// see native/README for what is simulated and what is not
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0x01
+#define OUTPUT          0x03
+#define INPUT_PULLUP    0x05
+#define RISING          0x01
+#define FALLING         0x02
+#define CHANGE          0x03
+
+// pins_arduino.h of the esp32doit-devkit-v1 - constants, not macros, as in the core
+static const uint8_t LED_BUILTIN = 2;
+static const uint8_t SDA = 21;
+static const uint8_t SCL = 22;
+static const uint8_t SS = 5;
+static const uint8_t RX = 3;
+static const uint8_t TX = 1;
+
+#define DEC             10
+#define HEX             16
+#define SERIAL_8N1      0x800001c
+
+#define IRAM_ATTR
+#define digitalPinToInterrupt(pin) (pin)
+
+/* time - counted from the start of the process */
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+/* gpio - outputs are remembered, inputs read low, interrupts never fire */
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+
+/**
+ * Arduino String on std::string
+*/
+class String {
+    private:
+    std::string _s;
+
+    public:
+    String(const char* s = "") : _s(s) {}
+    String(const std::string& s) : _s(s) {}
+    String(char c) : _s(1, c) {}
+    String(int value, unsigned char base = DEC);
+    String(unsigned int value, unsigned char base = DEC);
+    String(long value, unsigned char base = DEC);
+    String(unsigned long value, unsigned char base = DEC);
+    String(float value, unsigned char decimals = 2);
+    String(double value, unsigned char decimals = 2);
+
+    const char* c_str() const { return this->_s.c_str(); }
+    unsigned int length() const { return this->_s.length(); }
+    String& operator+=(const String& other) { this->_s += other._s; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a._s + b._s); }
+    friend String operator+(const String& a, const char* b) { return String(a._s + b); }
+    bool operator==(const String& other) const { return this->_s == other._s; }
+};
+
+/**
+ * text and binary output - print() formats the way the Arduino core does
+*/
+class Print {
+    public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t byte) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+
+    size_t print(const char* s);
+    size_t print(const String& s) { return this->print(s.c_str()); }
+    size_t print(char c) { return this->write((uint8_t) c); }
+    size_t print(int value, int base = DEC) { return this->print(String(value, base)); }
+    size_t print(unsigned int value, int base = DEC) { return this->print(String(value, base)); }
+    size_t print(long value, int base = DEC) { return this->print(String(value, base)); }
+    size_t print(unsigned long value, int base = DEC) { return this->print(String(value, base)); }
+    size_t print(long long value, int base = DEC) { return this->print(String((long) value, base)); }
+    size_t print(double value, int decimals = 2) { return this->print(String(value, decimals)); }
+
+    size_t println() { return this->print("\r\n"); }
+    template <typename T> size_t println(T value) { size_t n = this->print(value); return n + this->println(); }
+    template <typename T> size_t println(T value, int format) { size_t n = this->print(value, format); return n + this->println(); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+    public:
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+    void setTimeout(unsigned long timeout) {}
+    size_t readBytes(uint8_t* buffer, size_t length);
+};
+
+/**
+ * UART 0 writes to stdout, the others are silent
+ * nothing is ever received, so the flash download mode never starts on the host
+*/
+class HardwareSerial : public Stream {
+    private:
+    int _uart;
+
+    public:
+    HardwareSerial(int uart) : _uart(uart) {}
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rx = -1, int8_t tx = -1) {}
+    void end() {}
+    void updateBaudRate(unsigned long baud) {}
+    using Print::write;
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    void flush() override;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+    public:
+    void restart();                 // ends the process
+    uint32_t getFreeHeap() { return 0; }
+};
+
+extern EspClass ESP;
+
+#endif
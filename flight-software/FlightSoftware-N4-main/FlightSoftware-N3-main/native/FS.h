@@ -0,0 +1,19 @@
+// host shim - files open, take writes and keep nothing
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include "Arduino.h"
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+class File : public Stream {
+    public:
+    size_t write(uint8_t byte) override { return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { return size; }
+    void close() {}
+    operator bool() const { return true; }
+};
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef NATIVE_SPIFFS_H
+#define NATIVE_SPIFFS_H
+
+#include "FS.h"
+
+class SPIFFSFS {
+    public:
+    bool begin(bool format_on_fail = false) { return true; }
+    File open(const char* path, const char* mode = FILE_READ) { return File(); }
+};
+
+extern SPIFFSFS SPIFFS;
+
+#endif
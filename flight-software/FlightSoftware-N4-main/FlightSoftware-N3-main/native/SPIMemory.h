@@ -0,0 +1,58 @@
+// host shim of SPIMemory - a NOR flash in RAM
+#ifndef NATIVE_SPIMEMORY_H
+#define NATIVE_SPIMEMORY_H
+
+#include <vector>
+#include "Arduino.h"
+#include "SPI.h"
+
+#define NATIVE_FLASH_CAPACITY   (4 * 1024 * 1024)   // W25Q32 - the board's part
+#define NATIVE_FLASH_SECTOR     4096
+
+/**
+ * erased bytes read 0xFF and programming only clears bits, as on the chip, so a write over
+ * unerased flash corrupts the data the way it would on the board
+ * starts erased; nothing is kept between runs
+*/
+class SPIFlash {
+    private:
+    std::vector<uint8_t> _memory;
+
+    bool inRange(uint32_t address, size_t length) { return address + length <= this->_memory.size(); }
+
+    public:
+    SPIFlash(uint8_t cs = SS, SPIClass* spi = &SPI) : _memory(NATIVE_FLASH_CAPACITY, 0xFF) {}
+
+    bool begin() { return true; }
+    uint32_t getCapacity() { return this->_memory.size(); }
+    uint32_t getMaxPage() { return this->_memory.size() / 256; }
+
+    bool eraseSector(uint32_t address) { return this->eraseBlock(address, NATIVE_FLASH_SECTOR); }
+    bool eraseBlock32K(uint32_t address) { return this->eraseBlock(address, 32 * 1024); }
+    bool eraseBlock64K(uint32_t address) { return this->eraseBlock(address, 64 * 1024); }
+    bool eraseChip() { return this->eraseBlock(0, this->_memory.size()); }
+
+    bool eraseBlock(uint32_t address, uint32_t size) {
+        address -= address % size;
+        if(!this->inRange(address, size)) return false;
+        memset(&this->_memory[address], 0xFF, size);
+        return true;
+    }
+
+    bool writeByteArray(uint32_t address, uint8_t* data, size_t length, bool error_check = true) {
+        if(!this->inRange(address, length)) return false;
+        for(size_t i = 0; i < length; i++) this->_memory[address + i] &= data[i];
+        return !error_check || memcmp(&this->_memory[address], data, length) == 0;
+    }
+
+    bool readByteArray(uint32_t address, uint8_t* data, size_t length, bool fast_read = false) {
+        if(!this->inRange(address, length)) return false;
+        memcpy(data, &this->_memory[address], length);
+        return true;
+    }
+
+    bool writeByte(uint32_t address, uint8_t data, bool error_check = true) { return this->writeByteArray(address, &data, 1, error_check); }
+    uint8_t readByte(uint32_t address, bool fast_read = false) { return this->inRange(address, 1) ? this->_memory[address] : 0xFF; }
+};
+
+#endif
@@ -0,0 +1,28 @@
+// host shim - no GPS fix ever arrives
+#ifndef NATIVE_TINYGPSPLUS_H
+#define NATIVE_TINYGPSPLUS_H
+
+#include "Arduino.h"
+
+class TinyGPSLocation {
+    public:
+    bool isValid() const { return false; }
+    bool isUpdated() const { return false; }
+    double lat() { return 0; }
+    double lng() { return 0; }
+};
+
+class TinyGPSTime {
+    public:
+    bool isValid() const { return false; }
+    uint32_t value() { return 0; }
+};
+
+class TinyGPSPlus {
+    public:
+    TinyGPSLocation location;
+    TinyGPSTime time;
+    bool encode(char c) { return false; }
+};
+
+#endif
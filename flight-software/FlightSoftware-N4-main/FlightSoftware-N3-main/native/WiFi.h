@@ -0,0 +1,22 @@
+// host shim - no network, the station never connects
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include "Arduino.h"
+
+#define WL_IDLE_STATUS      0
+#define WL_CONNECTED        3
+#define WL_DISCONNECTED     6
+
+class WiFiClient {};
+
+class WiFiClass {
+    public:
+    int begin(const char* ssid, const char* password = NULL) { return WL_DISCONNECTED; }
+    int status() { return WL_DISCONNECTED; }
+    const char* localIP() { return "0.0.0.0"; }
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,55 @@
+// host shim of the Arduino I2C master
+#ifndef NATIVE_WIRE_H
+#define NATIVE_WIRE_H
+
+#include "Arduino.h"
+
+#define WIRE_BUFFER_LENGTH  128
+
+/**
+ * a simulated device on the bus
+ * write() gets the bytes of one write transaction, read() fills one read transaction
+*/
+class WireDevice {
+    public:
+    virtual ~WireDevice() {}
+    virtual void write(const uint8_t* data, size_t length) = 0;
+    virtual size_t read(uint8_t* data, size_t length) = 0;
+};
+
+/**
+ * I2C master - transactions go to the device attached at the address, an empty address NACKs
+ * the bus is locked per transaction, so tasks reading different sensors interleave like on the wire
+*/
+class TwoWire : public Stream {
+    private:
+    WireDevice* _devices[128];
+    uint8_t _address;
+    uint8_t _tx[WIRE_BUFFER_LENGTH];
+    size_t _tx_length;
+    uint8_t _rx[WIRE_BUFFER_LENGTH];
+    size_t _rx_length;
+    size_t _rx_position;
+    bool _holding;                  // bus kept by a repeated start
+
+    public:
+    TwoWire(uint8_t bus);
+    void attach(uint8_t address, WireDevice* device);
+
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { return true; }
+    void setClock(uint32_t frequency) {}
+    void beginTransmission(uint8_t address);
+    uint8_t endTransmission(bool send_stop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t length, uint8_t send_stop = true);
+
+    using Print::write;
+    size_t write(uint8_t byte) override;
+    size_t write(const uint8_t* data, size_t length) override;
+    int available() override;
+    int read() override;
+    int peek() override;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,145 @@
+/**
+ * host side of the Arduino core shim - time, gpio, String, Print and Serial
+*/
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <stdarg.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "esp_timer.h"
+
+HardwareSerial Serial(0);
+EspClass ESP;
+
+static const std::chrono::steady_clock::time_point process_start = std::chrono::steady_clock::now();
+static uint8_t pin_levels[64];
+
+unsigned long millis() {
+    return (unsigned long) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - process_start).count();
+}
+
+// 32 bits, wrapping after ~71 minutes like the ESP32's micros()
+unsigned long micros() {
+    return (uint32_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - process_start).count();
+}
+
+int64_t esp_timer_get_time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - process_start).count();
+}
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if(pin < sizeof(pin_levels)) pin_levels[pin] = value;
+}
+
+int digitalRead(uint8_t pin) {
+    return pin < sizeof(pin_levels) ? pin_levels[pin] : LOW;
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {}
+
+void detachInterrupt(uint8_t pin) {}
+
+long random(long max) {
+    return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max) {
+    return max > min ? min + rand() % (max - min) : min;
+}
+
+static std::string formatInteger(unsigned long long value, bool negative, unsigned char base) {
+    char digits[66];
+    int n = sizeof(digits) - 1;
+    digits[n] = '\0';
+    if(base < 2) base = DEC;
+    do {
+        unsigned d = value % base;
+        digits[--n] = d < 10 ? '0' + d : 'A' + d - 10;
+        value /= base;
+    } while(value > 0);
+    if(negative) digits[--n] = '-';
+    return std::string(&digits[n]);
+}
+
+String::String(int value, unsigned char base) : String((long) value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long) value, base) {}
+
+String::String(long value, unsigned char base) {
+    // the Arduino core prints negative numbers in other bases as their two's complement
+    if(base == DEC) this->_s = formatInteger(value < 0 ? -(unsigned long long) value : value, value < 0, base);
+    else this->_s = formatInteger((unsigned long) value, false, base);
+}
+
+String::String(unsigned long value, unsigned char base) : _s(formatInteger(value, false, base)) {}
+
+String::String(float value, unsigned char decimals) : String((double) value, decimals) {}
+
+String::String(double value, unsigned char decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    this->_s = buffer;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while(size--) n += this->write(*buffer++);
+    return n;
+}
+
+size_t Print::print(const char* s) {
+    return this->write((const uint8_t*) s, strlen(s));
+}
+
+size_t Print::printf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if(n < 0) return 0;
+    return this->write((const uint8_t*) buffer, (size_t) n < sizeof(buffer) ? n : sizeof(buffer) - 1);
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+    size_t n = 0;
+    while(n < length) {
+        int c = this->read();
+        if(c < 0) break;
+        buffer[n++] = (uint8_t) c;
+    }
+    return n;
+}
+
+// tasks print from several threads - whole writes stay together as they do on the UART driver
+static std::mutex serial_mutex;
+
+size_t HardwareSerial::write(uint8_t byte) {
+    return this->write(&byte, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    if(this->_uart != 0) return size;
+    std::lock_guard<std::mutex> lock(serial_mutex);
+    return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() {
+    std::lock_guard<std::mutex> lock(serial_mutex);
+    fflush(stdout);
+}
+
+void EspClass::restart() {
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,10 @@
+// host shim of the ESP-IDF high resolution timer - the same process clock micros() counts from
+#ifndef NATIVE_ESP_TIMER_H
+#define NATIVE_ESP_TIMER_H
+
+#include <stdint.h>
+
+/* microseconds since the start of the process, 64 bits - never wraps */
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,253 @@
+/**
+ * FreeRTOS on host threads
+ *
+ * a task is a detached std::thread with a notification count guarded by its own mutex; a queue is a
+ * ring of fixed size items under a mutex with condition variables for the blocking calls. The host
+ * scheduler decides who runs, so priorities and core pinning only hold as far as it happens to honour
+ * them - enough to run the task bodies, not to reproduce on-target timing.
+*/
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+struct NativeTask {
+    std::string name;
+    uint32_t stack_depth;
+    UBaseType_t priority;
+    BaseType_t core;
+    std::mutex mutex;
+    std::condition_variable notified;
+    uint32_t notifications;
+};
+
+struct NativeQueue {
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::vector<uint8_t> items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+// the thread running setup() and loop() is the Arduino loop task
+static NativeTask loop_task = {"loopTask", 8192, 1, 1, {}, {}, 0};
+static thread_local NativeTask* current_task = &loop_task;
+
+static std::chrono::steady_clock::time_point deadline(TickType_t ticks) {
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks * portTICK_PERIOD_MS);
+}
+
+BaseType_t xPortGetCoreID() {
+    return current_task->core == tskNO_AFFINITY ? 0 : current_task->core;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    NativeTask* task = new NativeTask();
+    task->name = name;
+    task->stack_depth = stack_depth;
+    task->priority = priority;
+    task->core = core;
+    task->notifications = 0;
+
+    if(handle != NULL) *handle = task;
+
+    std::thread([task, function, parameters]() {
+        current_task = task;
+        function(parameters);
+    }).detach();
+
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stack_depth, parameters, priority, handle, tskNO_AFFINITY);
+}
+
+/**
+ * only a task deleting itself is supported - the thread blocks for good
+*/
+void vTaskDelete(TaskHandle_t task) {
+    if(task == NULL || task == current_task) {
+        while(true) std::this_thread::sleep_for(std::chrono::hours(1));
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if(ticks == 0) {
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+void vTaskDelayUntil(TickType_t* previous_wake, TickType_t period) {
+    *previous_wake += period;
+    TickType_t now = xTaskGetTickCount();
+    if((int32_t) (*previous_wake - now) > 0) {
+        vTaskDelay(*previous_wake - now);
+    }
+}
+
+void taskYIELD() {
+    std::this_thread::yield();
+}
+
+TickType_t xTaskGetTickCount() {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return (TickType_t) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return current_task;
+}
+
+const char* pcTaskGetName(TaskHandle_t task) {
+    return (task == NULL ? current_task : task)->name.c_str();
+}
+
+/**
+ * host threads get the OS stack, so the whole depth is reported free
+*/
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return (task == NULL ? current_task : task)->stack_depth;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    NativeTask* task = current_task;
+    std::unique_lock<std::mutex> lock(task->mutex);
+
+    if(ticks == portMAX_DELAY) {
+        task->notified.wait(lock, [task]() { return task->notifications > 0; });
+    } else {
+        task->notified.wait_until(lock, deadline(ticks), [task]() { return task->notifications > 0; });
+    }
+
+    uint32_t value = task->notifications;
+    if(value > 0) {
+        task->notifications = clear_on_exit ? 0 : value - 1;
+    }
+
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->notified.notify_one();
+
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_priority_task_woken) {
+    xTaskNotifyGive(task);
+    if(higher_priority_task_woken != NULL) *higher_priority_task_woken = pdFALSE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    NativeQueue* queue = new NativeQueue();
+    queue->items.resize((size_t) length * item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->head = 0;
+    queue->count = 0;
+
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+static void copyIn(QueueHandle_t queue, const void* item) {
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->items[(size_t) tail * queue->item_size], item, queue->item_size);
+    queue->count++;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    auto has_room = [queue]() { return queue->count < queue->length; };
+
+    if(ticks == portMAX_DELAY) {
+        queue->not_full.wait(lock, has_room);
+    } else if(!queue->not_full.wait_until(lock, deadline(ticks), has_room)) {
+        return errQUEUE_FULL;
+    }
+
+    copyIn(queue, item);
+    lock.unlock();
+    queue->not_empty.notify_one();
+
+    return pdPASS;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    return xQueueSend(queue, item, ticks);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_priority_task_woken) {
+    if(higher_priority_task_woken != NULL) *higher_priority_task_woken = pdFALSE;
+    return xQueueSend(queue, item, 0);
+}
+
+/**
+ * for length 1 queues - replace the item whether or not it was read
+*/
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item) {
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->head = 0;
+        queue->count = 0;
+        copyIn(queue, item);
+    }
+    queue->not_empty.notify_one();
+
+    return pdPASS;
+}
+
+static BaseType_t take(QueueHandle_t queue, void* item, TickType_t ticks, bool remove) {
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    auto has_item = [queue]() { return queue->count > 0; };
+
+    if(ticks == portMAX_DELAY) {
+        queue->not_empty.wait(lock, has_item);
+    } else if(!queue->not_empty.wait_until(lock, deadline(ticks), has_item)) {
+        return errQUEUE_EMPTY;
+    }
+
+    memcpy(item, &queue->items[(size_t) queue->head * queue->item_size], queue->item_size);
+    if(remove) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        lock.unlock();
+        queue->not_full.notify_one();
+    }
+
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+    return take(queue, item, ticks, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t ticks) {
+    return take(queue, item, ticks, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
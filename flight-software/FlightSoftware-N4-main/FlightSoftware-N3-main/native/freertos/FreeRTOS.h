@@ -0,0 +1,33 @@
+// host shim of FreeRTOS - tasks are threads, see native/freertos.cpp
+#ifndef NATIVE_FREERTOS_H
+#define NATIVE_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdFAIL                  0
+#define pdPASS                  1
+#define errQUEUE_EMPTY          0
+#define errQUEUE_FULL           0
+
+#define configTICK_RATE_HZ      1000
+#define configMAX_PRIORITIES    25
+#define portTICK_PERIOD_MS      (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY           ((TickType_t) 0xFFFFFFFF)
+#define pdMS_TO_TICKS(ms)       ((TickType_t) (((TickType_t) (ms) * configTICK_RATE_HZ) / 1000))
+#define tskNO_AFFINITY          0x7FFFFFFF
+
+// an interrupt never preempts a task on the host, so there is nothing to yield to
+#define portYIELD_FROM_ISR(woken)   ((void) (woken))
+#define portYIELD()                 taskYIELD()
+
+BaseType_t xPortGetCoreID();
+
+#endif
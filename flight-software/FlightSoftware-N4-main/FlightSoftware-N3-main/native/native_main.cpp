@@ -0,0 +1,39 @@
+/**
+ * entry point of the host build - the Arduino core's main: setup() once, then loop()
+ * the simulated sensors are on the bus before setup() runs
+ *
+ * .pio/build/native/program [seconds]     runs for 10 s by default
+*/
+#include "Arduino.h"
+#include "Wire.h"
+#include "SPI.h"
+#include "WiFi.h"
+#include "SPIFFS.h"
+#include "sim_sensors.h"
+
+SPIClass SPI;
+WiFiClass WiFi;
+SPIFFSFS SPIFFS;
+
+SimMpu6050 sim_mpu;
+SimBmp180 sim_bmp;
+
+void setup();
+void loop();
+
+int main(int argc, char** argv) {
+    unsigned long run_ms = (argc > 1 ? strtoul(argv[1], NULL, 10) : 10) * 1000;
+
+    Wire.attach(0x68, &sim_mpu);
+    Wire.attach(0x77, &sim_bmp);
+
+    setup();
+    while(millis() < run_ms) {
+        loop();
+        // loop() is empty on this board - the tasks do the work
+        delay(1);
+    }
+
+    Serial.flush();
+    ESP.restart();
+}
@@ -0,0 +1,225 @@
+#include "sim_sensors.h"
+#include "bmp180_math.h"
+
+// MPU6050 registers used by the driver
+#define MPU_SMPLRT_DIV      0x19
+#define MPU_INT_STATUS      0x3A
+#define MPU_ACCEL_XOUT_H    0x3B
+#define MPU_USER_CTRL       0x6A
+#define MPU_FIFO_COUNT_H    0x72
+#define MPU_FIFO_COUNT_L    0x73
+#define MPU_FIFO_R_W        0x74
+#define MPU_WHO_AM_I        0x75
+#define MPU_FIFO_EN_BIT     0x40
+#define MPU_FIFO_RESET_BIT  0x04
+#define MPU_FIFO_OFLOW_INT  0x10
+#define MPU_RECORD_LENGTH   14
+#define MPU_GYRO_RATE_US    1000    // 1 kHz with the DLPF on
+
+// BMP180
+#define BMP_CHIP_ID         0xD0
+#define BMP_CALIBRATION     0xAA
+#define BMP_CONTROL         0xF4
+#define BMP_OUT_MSB         0xF6
+#define BMP_READ_TEMPERATURE 0x2E
+#define BMP_UT              27898   // 15.0 deg C with the example calibration
+
+RegisterDevice::RegisterDevice() {
+    memset(this->_registers, 0, sizeof(this->_registers));
+    this->_pointer = 0;
+}
+
+void RegisterDevice::write(const uint8_t* data, size_t length) {
+    if(length == 0) return;
+
+    this->_pointer = data[0];
+    for(size_t i = 1; i < length; i++) {
+        this->writeRegister(this->_pointer, data[i]);
+        if(this->autoIncrement(this->_pointer)) this->_pointer++;
+    }
+}
+
+size_t RegisterDevice::read(uint8_t* data, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+        data[i] = this->readRegister(this->_pointer);
+        if(this->autoIncrement(this->_pointer)) this->_pointer++;
+    }
+    return length;
+}
+
+SimMpu6050::SimMpu6050() {
+    this->_registers[MPU_WHO_AM_I] = 0x68;
+    this->_fifo_head = 0;
+    this->_fifo_count = 0;
+    this->_last_sample = 0;
+    this->_noise = 4;
+    // +1g on x at the driver's 16g range, 36.53 deg C
+    this->setMotion(2048, 0, 0, 0, 0, 0);
+    this->_motion[3] = 0;
+}
+
+void SimMpu6050::setMotion(int16_t ax, int16_t ay, int16_t az, int16_t gx, int16_t gy, int16_t gz) {
+    this->_motion[0] = ax;
+    this->_motion[1] = ay;
+    this->_motion[2] = az;
+    this->_motion[4] = gx;
+    this->_motion[5] = gy;
+    this->_motion[6] = gz;
+}
+
+void SimMpu6050::setNoise(uint8_t counts) {
+    this->_noise = counts;
+}
+
+/**
+ * one big endian record in output register order
+*/
+void SimMpu6050::sample(uint8_t* record) {
+    for(int i = 0; i < 7; i++) {
+        int16_t value = this->_motion[i];
+        if(this->_noise > 0 && i != 3) value += (int16_t) random(-this->_noise, this->_noise + 1);
+        record[2 * i] = (uint8_t) (value >> 8);
+        record[2 * i + 1] = (uint8_t) value;
+    }
+}
+
+/**
+ * queue every record the sensor would have sampled since the last access
+*/
+void SimMpu6050::advance() {
+    uint32_t period = (this->_registers[MPU_SMPLRT_DIV] + 1) * MPU_GYRO_RATE_US;
+    uint32_t now = micros();
+
+    if(!(this->_registers[MPU_USER_CTRL] & MPU_FIFO_EN_BIT)) {
+        this->_last_sample = now;
+        return;
+    }
+
+    while(now - this->_last_sample >= period) {
+        this->_last_sample += period;
+
+        uint8_t record[MPU_RECORD_LENGTH];
+        this->sample(record);
+        for(int i = 0; i < MPU_RECORD_LENGTH; i++) {
+            if(this->_fifo_count == sizeof(this->_fifo)) {
+                // the oldest byte is lost, as on the part - the head may now be mid record
+                this->_fifo_head = (this->_fifo_head + 1) % sizeof(this->_fifo);
+                this->_fifo_count--;
+                this->_registers[MPU_INT_STATUS] |= MPU_FIFO_OFLOW_INT;
+            }
+            this->_fifo[(this->_fifo_head + this->_fifo_count) % sizeof(this->_fifo)] = record[i];
+            this->_fifo_count++;
+        }
+    }
+}
+
+void SimMpu6050::writeRegister(uint8_t reg, uint8_t value) {
+    if(reg == MPU_USER_CTRL && (value & MPU_FIFO_RESET_BIT)) {
+        this->_fifo_head = 0;
+        this->_fifo_count = 0;
+        value &= ~MPU_FIFO_RESET_BIT;
+    }
+    if(reg == MPU_USER_CTRL && (value & MPU_FIFO_EN_BIT) && !(this->_registers[reg] & MPU_FIFO_EN_BIT)) {
+        this->_last_sample = micros();
+    }
+    this->_registers[reg] = value;
+}
+
+uint8_t SimMpu6050::readRegister(uint8_t reg) {
+    this->advance();
+
+    if(reg >= MPU_ACCEL_XOUT_H && reg < MPU_ACCEL_XOUT_H + MPU_RECORD_LENGTH) {
+        uint8_t record[MPU_RECORD_LENGTH];
+        this->sample(record);
+        return record[reg - MPU_ACCEL_XOUT_H];
+    }
+
+    switch(reg) {
+        case MPU_INT_STATUS: {
+            // cleared by the read
+            uint8_t status = this->_registers[reg];
+            this->_registers[reg] = 0;
+            return status;
+        }
+        case MPU_FIFO_COUNT_H:
+            return (uint8_t) (this->_fifo_count >> 8);
+        case MPU_FIFO_COUNT_L:
+            return (uint8_t) this->_fifo_count;
+        case MPU_FIFO_R_W: {
+            if(this->_fifo_count == 0) return 0xFF;
+            uint8_t value = this->_fifo[this->_fifo_head];
+            this->_fifo_head = (this->_fifo_head + 1) % sizeof(this->_fifo);
+            this->_fifo_count--;
+            return value;
+        }
+        default:
+            return this->_registers[reg];
+    }
+}
+
+// burst reads of the FIFO stay on the FIFO register
+bool SimMpu6050::autoIncrement(uint8_t reg) {
+    return reg != MPU_FIFO_R_W;
+}
+
+static const int16_t example_calibration[11] = {408, -72, -14383, (int16_t) 32741, (int16_t) 32757, 23153, 6190, 4, -32768, -8711, 2868};
+
+static bmp180_calibration_t exampleCalibration() {
+    bmp180_calibration_t cal;
+    cal.AC1 = example_calibration[0];
+    cal.AC2 = example_calibration[1];
+    cal.AC3 = example_calibration[2];
+    cal.AC4 = (uint16_t) example_calibration[3];
+    cal.AC5 = (uint16_t) example_calibration[4];
+    cal.AC6 = (uint16_t) example_calibration[5];
+    cal.B1 = example_calibration[6];
+    cal.B2 = example_calibration[7];
+    cal.MB = example_calibration[8];
+    cal.MC = example_calibration[9];
+    cal.MD = example_calibration[10];
+    return cal;
+}
+
+SimBmp180::SimBmp180() {
+    this->_registers[BMP_CHIP_ID] = 0x55;
+    for(int i = 0; i < 11; i++) {
+        this->_registers[BMP_CALIBRATION + 2 * i] = (uint8_t) (example_calibration[i] >> 8);
+        this->_registers[BMP_CALIBRATION + 2 * i + 1] = (uint8_t) example_calibration[i];
+    }
+    // standard atmosphere at the 1525 m of the test site
+    this->_pressure = 84436;
+}
+
+void SimBmp180::setPressure(int32_t pressure) {
+    this->_pressure = pressure;
+}
+
+/**
+ * a conversion finishes at once - the driver still waits its conversion time before reading
+*/
+void SimBmp180::writeRegister(uint8_t reg, uint8_t value) {
+    this->_registers[reg] = value;
+    if(reg != BMP_CONTROL) return;
+
+    if(value == BMP_READ_TEMPERATURE) {
+        this->_registers[BMP_OUT_MSB] = (uint8_t) (BMP_UT >> 8);
+        this->_registers[BMP_OUT_MSB + 1] = (uint8_t) BMP_UT;
+        return;
+    }
+
+    // the raw reading the compensation turns into the set pressure - it rises with the raw value
+    bmp180_calibration_t cal = exampleCalibration();
+    uint8_t oss = value >> 6;
+    int32_t B5 = bmp180ComputeB5(cal, BMP_UT);
+    int32_t low = 0, high = (1 << (16 + oss)) - 1;
+    while(low < high) {
+        int32_t middle = (low + high) / 2;
+        if(bmp180Pressure(cal, middle, oss, B5) < this->_pressure) low = middle + 1;
+        else high = middle;
+    }
+
+    uint32_t raw = (uint32_t) low << (8 - oss);
+    this->_registers[BMP_OUT_MSB] = (uint8_t) (raw >> 16);
+    this->_registers[BMP_OUT_MSB + 1] = (uint8_t) (raw >> 8);
+    this->_registers[BMP_OUT_MSB + 2] = (uint8_t) raw;
+}
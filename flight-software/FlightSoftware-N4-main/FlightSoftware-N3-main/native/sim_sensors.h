@@ -0,0 +1,73 @@
+// simulated I2C sensors for the host build
+#ifndef NATIVE_SIM_SENSORS_H
+#define NATIVE_SIM_SENSORS_H
+
+#include "Wire.h"
+
+/**
+ * register file device - the first byte written sets the register pointer, the rest are written
+ * from there on; reads go on from the pointer. Both auto-increment like the real parts
+*/
+class RegisterDevice : public WireDevice {
+    protected:
+    uint8_t _registers[256];
+    uint8_t _pointer;
+
+    virtual void writeRegister(uint8_t reg, uint8_t value) { this->_registers[reg] = value; }
+    virtual uint8_t readRegister(uint8_t reg) { return this->_registers[reg]; }
+    virtual bool autoIncrement(uint8_t reg) { return true; }
+
+    public:
+    RegisterDevice();
+    void write(const uint8_t* data, size_t length) override;
+    size_t read(uint8_t* data, size_t length) override;
+};
+
+/**
+ * MPU6050 - output registers, sample rate divider and the FIFO with its count and overflow flag
+ * records are queued on the sensor's own clock from micros(), so the FIFO fills while the read task
+ * sleeps as it does on the board. The data ready pin is not simulated - the read task drains the FIFO
+ * on its timeout instead
+ * motion is in raw counts at the configured range; the default is the rocket standing on the pad,
+ * x axis up
+*/
+class SimMpu6050 : public RegisterDevice {
+    private:
+    int16_t _motion[7];             // ax, ay, az, temperature, gx, gy, gz
+    uint8_t _fifo[1024];
+    uint16_t _fifo_head;
+    uint16_t _fifo_count;
+    uint32_t _last_sample;
+    uint8_t _noise;
+
+    void sample(uint8_t* record);
+    void advance();
+
+    protected:
+    void writeRegister(uint8_t reg, uint8_t value) override;
+    uint8_t readRegister(uint8_t reg) override;
+    bool autoIncrement(uint8_t reg) override;
+
+    public:
+    SimMpu6050();
+    void setMotion(int16_t ax, int16_t ay, int16_t az, int16_t gx, int16_t gy, int16_t gz);
+    void setNoise(uint8_t counts);
+};
+
+/**
+ * BMP180 - chip id, the datasheet's example calibration and conversions that return the raw
+ * values for the pressure set with setPressure(), so the driver's integer compensation runs as is
+*/
+class SimBmp180 : public RegisterDevice {
+    private:
+    int32_t _pressure;              // Pa
+
+    protected:
+    void writeRegister(uint8_t reg, uint8_t value) override;
+
+    public:
+    SimBmp180();
+    void setPressure(int32_t pressure);
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include <mutex>
+#include "Wire.h"
+
+TwoWire Wire(0);
+
+// held from beginTransmission to the end of the read that follows a repeated start, as the bus would be
+// the receive buffer is shared like the ESP32 core's, read it out before the next transaction
+static std::recursive_mutex bus;
+
+TwoWire::TwoWire(uint8_t bus) {
+    for(int i = 0; i < 128; i++) this->_devices[i] = NULL;
+    this->_address = 0;
+    this->_tx_length = 0;
+    this->_rx_length = 0;
+    this->_rx_position = 0;
+    this->_holding = false;
+}
+
+void TwoWire::attach(uint8_t address, WireDevice* device) {
+    this->_devices[address & 0x7F] = device;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    bus.lock();
+    this->_address = address & 0x7F;
+    this->_tx_length = 0;
+}
+
+/**
+ * returns 0 on success, 2 when no device answers at the address - the codes of the Arduino core
+ * a repeated start keeps the bus for the requestFrom() that follows
+*/
+uint8_t TwoWire::endTransmission(bool send_stop) {
+    WireDevice* device = this->_devices[this->_address];
+    if(device != NULL) {
+        device->write(this->_tx, this->_tx_length);
+    }
+
+    if(send_stop || device == NULL) bus.unlock();
+    else this->_holding = true;
+
+    return device != NULL ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t length, uint8_t send_stop) {
+    std::lock_guard<std::recursive_mutex> lock(bus);
+
+    WireDevice* device = this->_devices[address & 0x7F];
+    if(length > WIRE_BUFFER_LENGTH) length = WIRE_BUFFER_LENGTH;
+
+    this->_rx_length = device != NULL ? device->read(this->_rx, length) : 0;
+    this->_rx_position = 0;
+
+    // release the hold taken by a repeated start
+    if(this->_holding) {
+        this->_holding = false;
+        bus.unlock();
+    }
+
+    return (uint8_t) this->_rx_length;
+}
+
+size_t TwoWire::write(uint8_t byte) {
+    if(this->_tx_length >= WIRE_BUFFER_LENGTH) return 0;
+    this->_tx[this->_tx_length++] = byte;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t length) {
+    size_t n = 0;
+    while(n < length && this->write(data[n])) n++;
+    return n;
+}
+
+int TwoWire::available() {
+    return (int) (this->_rx_length - this->_rx_position);
+}
+
+int TwoWire::read() {
+    return this->_rx_position < this->_rx_length ? this->_rx[this->_rx_position++] : -1;
+}
+
+int TwoWire::peek() {
+    return this->_rx_position < this->_rx_length ? this->_rx[this->_rx_position] : -1;
+}
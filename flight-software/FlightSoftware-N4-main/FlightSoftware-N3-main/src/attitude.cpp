@@ -0,0 +1,228 @@
+#include "attitude.h"
+
+// constructor
+AttitudeEstimator::AttitudeEstimator(Mode mode) {
+    this->_accel_rejection = ATTITUDE_ACCEL_REJECTION;
+    this->_bias_x = this->_bias_y = this->_bias_z = 0;
+    this->setMode(mode);
+    this->reset();
+}
+
+/**
+ * select the accel correction
+ * also resets the gain to the default of that mode
+*/
+void AttitudeEstimator::setMode(Mode mode) {
+    this->_mode = mode;
+    this->_gain = (mode == MADGWICK) ? ATTITUDE_MADGWICK_BETA : ATTITUDE_COMPLEMENTARY_GAIN;
+}
+
+AttitudeEstimator::Mode AttitudeEstimator::getMode() {
+    return this->_mode;
+}
+
+/**
+ * complementary: proportional gain, madgwick: beta
+*/
+void AttitudeEstimator::setGain(float gain) {
+    this->_gain = gain;
+}
+
+/**
+ * accel magnitude tolerance in g around 1g
+*/
+void AttitudeEstimator::setAccelRejection(float accel_rejection) {
+    this->_accel_rejection = accel_rejection;
+}
+
+/**
+ * gyro bias in rad/s, subtracted from every gyro reading
+*/
+void AttitudeEstimator::setGyroBias(float bias_x, float bias_y, float bias_z) {
+    this->_bias_x = bias_x;
+    this->_bias_y = bias_y;
+    this->_bias_z = bias_z;
+}
+
+void AttitudeEstimator::reset() {
+    this->q0 = 1.0f;
+    this->q1 = this->q2 = this->q3 = 0.0f;
+}
+
+/**
+ * start from the orientation given by gravity - the shortest rotation taking the measured up
+ * direction to earth z, so no spin about it
+ * avoids the slow convergence from an identity quaternion on the pad
+*/
+void AttitudeEstimator::initFromAccel(float ax, float ay, float az) {
+    float norm = sqrtf(ax * ax + ay * ay + az * az);
+    if(norm <= 0.0f) {
+        this->reset();
+        return;
+    }
+
+    // shortest arc from up to earth z: (1 + up . z, up x z), normalised
+    float w = 1.0f + az / norm;
+    float x = ay / norm, y = -ax / norm;
+
+    float norm_sq = w * w + x * x + y * y;
+    if(norm_sq < 1e-12f) {
+        // upside down - half a turn about x
+        this->q0 = 0.0f;
+        this->q1 = 1.0f;
+        this->q2 = this->q3 = 0.0f;
+        return;
+    }
+
+    float recip_norm = 1.0f / sqrtf(norm_sq);
+    this->q0 = w * recip_norm;
+    this->q1 = x * recip_norm;
+    this->q2 = y * recip_norm;
+    this->q3 = 0.0f;
+}
+
+/**
+ * feed the gravity error back into the gyro rate
+ * the error is the cross product of the measured and the estimated gravity directions
+*/
+void AttitudeEstimator::correctComplementary(float& gx, float& gy, float& gz, float ax, float ay, float az) {
+    // estimated direction of gravity, halved
+    float halfvx = this->q1 * this->q3 - this->q0 * this->q2;
+    float halfvy = this->q0 * this->q1 + this->q2 * this->q3;
+    float halfvz = this->q0 * this->q0 - 0.5f + this->q3 * this->q3;
+
+    float halfex = ay * halfvz - az * halfvy;
+    float halfey = az * halfvx - ax * halfvz;
+    float halfez = ax * halfvy - ay * halfvx;
+
+    gx += 2.0f * this->_gain * halfex;
+    gy += 2.0f * this->_gain * halfey;
+    gz += 2.0f * this->_gain * halfez;
+}
+
+/**
+ * gyro rate of change of the quaternion with the madgwick gradient step subtracted
+*/
+void AttitudeEstimator::integrateMadgwick(float gx, float gy, float gz, float ax, float ay, float az, bool use_accel, float dt) {
+    float q0 = this->q0, q1 = this->q1, q2 = this->q2, q3 = this->q3;
+
+    // Rate of change of quaternion from gyroscope
+    float qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    float qDot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    float qDot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    float qDot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+    if(use_accel) {
+        float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+        float _4q0 = 4.0f * q0, _4q1 = 4.0f * q1, _4q2 = 4.0f * q2;
+        float _8q1 = 8.0f * q1, _8q2 = 8.0f * q2;
+        float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+        // Gradient decent algorithm corrective step
+        float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+        float s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+        float s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+
+        float norm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+        if(norm > 0.0f) {
+            float scale = this->_gain / sqrtf(norm);
+            qDot0 -= scale * s0;
+            qDot1 -= scale * s1;
+            qDot2 -= scale * s2;
+            qDot3 -= scale * s3;
+        }
+    }
+
+    this->q0 = q0 + qDot0 * dt;
+    this->q1 = q1 + qDot1 * dt;
+    this->q2 = q2 + qDot2 * dt;
+    this->q3 = q3 + qDot3 * dt;
+}
+
+/**
+ * one estimator step
+ * gyro in rad/s, accel in any unit (it is normalized; 1g rejection assumes g), dt in seconds
+*/
+void AttitudeEstimator::update(float gx, float gy, float gz, float ax, float ay, float az, float dt) {
+    gx -= this->_bias_x;
+    gy -= this->_bias_y;
+    gz -= this->_bias_z;
+
+    // only trust the accelerometer as a gravity reference when it reads about 1g
+    float accel_norm_sq = ax * ax + ay * ay + az * az;
+    float low = 1.0f - this->_accel_rejection, high = 1.0f + this->_accel_rejection;
+    bool use_accel = accel_norm_sq > low * low && accel_norm_sq < high * high;
+
+    if(use_accel) {
+        float recip_norm = 1.0f / sqrtf(accel_norm_sq);
+        ax *= recip_norm;
+        ay *= recip_norm;
+        az *= recip_norm;
+    }
+
+    if(this->_mode == MADGWICK) {
+        this->integrateMadgwick(gx, gy, gz, ax, ay, az, use_accel, dt);
+    } else {
+        if(use_accel) {
+            this->correctComplementary(gx, gy, gz, ax, ay, az);
+        }
+
+        // Integrate rate of change of quaternion
+        float half_dt = 0.5f * dt;
+        gx *= half_dt;
+        gy *= half_dt;
+        gz *= half_dt;
+        float qa = this->q0, qb = this->q1, qc = this->q2;
+        this->q0 += (-qb * gx - qc * gy - this->q3 * gz);
+        this->q1 += (qa * gx + qc * gz - this->q3 * gy);
+        this->q2 += (qa * gy - qb * gz + this->q3 * gx);
+        this->q3 += (qa * gz + qb * gy - qc * gx);
+    }
+
+    // Normalise quaternion
+    float recip_norm = 1.0f / sqrtf(this->q0 * this->q0 + this->q1 * this->q1 + this->q2 * this->q2 + this->q3 * this->q3);
+    this->q0 *= recip_norm;
+    this->q1 *= recip_norm;
+    this->q2 *= recip_norm;
+    this->q3 *= recip_norm;
+}
+
+/**
+ * roll angle in degrees - spin about the rocket axis, -180 to 180
+ * twice the angle of the twist of the orientation about body x
+*/
+float AttitudeEstimator::getRoll() {
+    float w = this->q0, x = this->q1;
+    if(w < 0.0f) {
+        w = -w;
+        x = -x;
+    }
+    return 2.0f * atan2f(x, w) * ATTITUDE_RAD_TO_DEG;
+}
+
+/**
+ * pitch angle in degrees - elevation of the rocket axis above the horizon, +90 upright
+*/
+float AttitudeEstimator::getPitch() {
+    // body x in earth axes
+    float xx = 1.0f - 2.0f * (this->q2 * this->q2 + this->q3 * this->q3);
+    float xy = 2.0f * (this->q1 * this->q2 + this->q0 * this->q3);
+    float xz = 2.0f * (this->q1 * this->q3 - this->q0 * this->q2);
+    return atan2f(xz, sqrtf(xx * xx + xy * xy)) * ATTITUDE_RAD_TO_DEG;
+}
+
+/**
+ * tilt angle in degrees - rocket axis from vertical, 0 upright
+*/
+float AttitudeEstimator::getTilt() {
+    return 90.0f - this->getPitch();
+}
+
+/**
+ * yaw angle in degrees - gyro only, drifts
+*/
+float AttitudeEstimator::getYaw() {
+    return atan2f(2.0f * (this->q0 * this->q3 + this->q1 * this->q2),
+                  1.0f - 2.0f * (this->q2 * this->q2 + this->q3 * this->q3)) * ATTITUDE_RAD_TO_DEG;
+}
@@ -0,0 +1,94 @@
+#include <Arduino.h>
+#include "deferred_log.h"
+
+MpscRingBuffer<deferred_log_entry_t, DEFERRED_LOG_RING_LENGTH> deferred_log_ring;
+
+static uint32_t reported_overflows = 0;
+
+/**
+ * one conversion - spec is the text from % to the conversion character, length modifiers dropped
+*/
+static int formatArg(char* out, size_t size, const char* spec, char conversion, uint8_t type, deferred_log_arg_t arg) {
+    switch(conversion) {
+        case 'd': case 'i': case 'c':
+            return snprintf(out, size, spec, type == DEFERRED_LOG_FLOAT ? (int) arg.f : (int) arg.i);
+        case 'u': case 'x': case 'X': case 'o':
+            return snprintf(out, size, spec, type == DEFERRED_LOG_FLOAT ? (unsigned) arg.f : (unsigned) arg.u);
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+            if(type == DEFERRED_LOG_INT) return snprintf(out, size, spec, (double) arg.i);
+            if(type == DEFERRED_LOG_UINT) return snprintf(out, size, spec, (double) arg.u);
+            return snprintf(out, size, spec, (double) arg.f);
+        case 's':
+            return snprintf(out, size, spec, type == DEFERRED_LOG_STRING && arg.s != NULL ? arg.s : "?");
+        default:
+            return snprintf(out, size, "?");
+    }
+}
+
+void deferredLogFormat(const deferred_log_entry_t& entry, char* out, size_t size) {
+    const char* format = entry.format;
+    size_t length = 0;
+    uint32_t next = 0;
+
+    if(size == 0) return;
+
+    while(*format != '\0' && length + 1 < size) {
+        if(*format != '%') {
+            out[length++] = *format++;
+            continue;
+        }
+
+        if(format[1] == '%') {
+            out[length++] = '%';
+            format += 2;
+            continue;
+        }
+
+        // flags, width and precision are kept, length modifiers dropped - the argument is 32 bits
+        char spec[16];
+        size_t spec_length = 0;
+        spec[spec_length++] = *format++;
+        while(*format != '\0' && strchr("-+ #0123456789.hlLzjt", *format) != NULL) {
+            if(strchr("hlLzjt", *format) == NULL && spec_length < sizeof(spec) - 2) spec[spec_length++] = *format;
+            format++;
+        }
+        if(*format == '\0') break;
+
+        char conversion = *format++;
+        spec[spec_length++] = conversion;
+        spec[spec_length] = '\0';
+
+        if(next >= entry.count) {
+            length += snprintf(out + length, size - length, "?");
+        } else {
+            uint8_t type = (entry.types >> (2 * next)) & 3;
+            int written = formatArg(out + length, size - length, spec, conversion, type, entry.args[next]);
+            if(written > 0) length += written;
+            next++;
+        }
+        if(length >= size) length = size - 1;
+    }
+
+    out[length] = '\0';
+}
+
+uint32_t deferredLogDrain(Print& out, uint32_t max_entries) {
+    deferred_log_entry_t entry;
+    char line[DEFERRED_LOG_LINE_LENGTH];
+    uint32_t n = 0;
+
+    while(n < max_entries && deferred_log_ring.pop(entry)) {
+        deferredLogFormat(entry, line, sizeof(line));
+        out.println(line);
+        n++;
+    }
+
+    uint32_t overflows = deferred_log_ring.overflows();
+    if(overflows != reported_overflows) {
+        snprintf(line, sizeof(line), "[-]%u debug lines dropped", (unsigned) (overflows - reported_overflows));
+        out.println(line);
+        reported_overflows = overflows;
+    }
+
+    return n;
+}
@@ -0,0 +1,453 @@
+#include <Arduino.h>
+#include <SPIMemory.h>
+#include "flash_logger.h"
+
+// constructor
+FlashLogger::FlashLogger(SPIFlash& flash) : _flash(flash) {
+    this->_lengths[0] = this->_lengths[1] = 0;
+    this->_full[0] = false;
+    this->_full[1] = false;
+    this->_fill = 0;
+    this->_program = 0;
+    this->_write_address = 0;
+    this->_erased_until = 0;
+    this->_log_end = 0;
+    this->_capacity = 0;
+    this->_started = false;
+
+    this->_header_address = FLASH_LOG_NO_ADDRESS;
+    for(uint8_t i = 0; i < FLASH_LOG_STATE_COUNT; i++) this->_transitions[i] = FLASH_LOG_NO_ADDRESS;
+    this->_transitions_pending = 0;
+    this->_since_index = 0;
+    this->_state = 0;
+
+    this->_history_head = 0;
+    this->_history_tail = 0;
+    this->_pretrigger = false;
+    this->_history_pending = false;
+
+    this->records = 0;
+    this->dropped = 0;
+    this->errors = 0;
+}
+
+/**
+ * start logging after the records already in the flash, with a new header
+ * returns false if the flash reports no capacity or has no room left for the header
+*/
+bool FlashLogger::begin() {
+    this->_capacity = this->_flash.getCapacity();
+    if(this->_capacity == 0) {
+        return false;
+    }
+
+    // the last record may end in 0xFF bytes, so leave room for a whole one. The gap stays shorter
+    // than a page, so written pages stay contiguous and the next boot's search still holds
+    uint32_t end = this->findLogEnd();
+    uint32_t start = end > 0 ? end + LOG_RECORD_MAX_LENGTH : 0;
+    if(start >= this->_capacity) {
+        start = this->_capacity;
+    }
+
+    // the rest of the sector holding the end is erased - the following sectors are erased ahead by program()
+    this->_erased_until = (start + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+    this->_started = this->writeHeader(start);
+
+    return this->_started;
+}
+
+/**
+ * program a header with no transitions at address and start the records after it
+ * only while no task is using the logger - begin()
+*/
+bool FlashLogger::writeHeader(uint32_t address) {
+    uint8_t record[1 + sizeof(log_header_t)];
+    log_header_t header;
+
+    if(address + sizeof(record) > this->_capacity || !this->eraseTo(address + sizeof(record))) {
+        return false;
+    }
+
+    header.version = FLASH_LOG_VERSION;
+    for(uint8_t i = 0; i < FLASH_LOG_STATE_COUNT; i++) header.transitions[i] = FLASH_LOG_NO_ADDRESS;
+    header.index_interval = FLASH_LOG_INDEX_INTERVAL;
+    header.address = address;
+
+    record[0] = LOG_RECORD_HEADER;
+    memcpy(record + 1, &header, sizeof(header));
+    if(!this->_flash.writeByteArray(address, record, sizeof(record), false)) {
+        this->errors++;
+        return false;
+    }
+
+    this->_header_address = address;
+    for(uint8_t i = 0; i < FLASH_LOG_STATE_COUNT; i++) this->_transitions[i] = FLASH_LOG_NO_ADDRESS;
+    this->_transitions_pending = 0;
+    this->_since_index = 0;
+    this->_write_address = address + sizeof(record);
+    this->_log_end = this->_write_address;
+
+    return true;
+}
+
+/**
+ * a page is erased if every byte reads 0xFF
+*/
+bool FlashLogger::isPageErased(uint32_t page) {
+    uint8_t buffer[FLASH_PAGE_SIZE];
+
+    this->_flash.readByteArray(page * FLASH_PAGE_SIZE, buffer, FLASH_PAGE_SIZE);
+    for(uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) {
+        if(buffer[i] != 0xFF) return false;
+    }
+
+    return true;
+}
+
+/**
+ * address just after the last byte written to the flash, 0 for an empty flash
+ * the log is written from address 0 up and everything after it is erased, so the first erased page
+ * is found by binary search - 16 page reads for a 16MB part instead of a scan
+*/
+uint32_t FlashLogger::findLogEnd() {
+    uint32_t pages = this->_flash.getCapacity() / FLASH_PAGE_SIZE;
+    uint32_t low = 0, high = pages; // the first erased page is in [low, high]
+
+    while(low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if(this->isPageErased(middle)) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+
+    if(low == 0) return 0;
+
+    // last written byte of the last written page
+    uint8_t buffer[FLASH_PAGE_SIZE];
+    uint32_t page = low - 1;
+    this->_flash.readByteArray(page * FLASH_PAGE_SIZE, buffer, FLASH_PAGE_SIZE);
+
+    uint32_t last = FLASH_PAGE_SIZE;
+    while(last > 0 && buffer[last - 1] == 0xFF) last--;
+
+    return page * FLASH_PAGE_SIZE + last;
+}
+
+/**
+ * erase every log - the next begin() starts again from address 0
+ * takes as long as a chip erase - only call it on the ground, with no task using the logger.
+ * the download mode calls it for the host's clear command
+*/
+bool FlashLogger::clear() {
+    this->_started = false;
+
+    if(!this->_flash.eraseChip()) {
+        this->errors++;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * hand the buffer being filled to the programming side and start filling the other one
+ * returns false if the other buffer is still waiting to be programmed
+*/
+bool FlashLogger::handOver() {
+    uint8_t next = this->_fill ^ 1;
+    if(this->_full[next].load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    this->_full[this->_fill].store(true, std::memory_order_release);
+    this->_fill = next;
+    this->_lengths[next] = 0;
+
+    return true;
+}
+
+/**
+ * append one record - type byte followed by the payload, which starts with its micros() timestamp
+ * filling side only, never waits on the flash
+ * returns false if the record was dropped
+*/
+bool FlashLogger::append(uint8_t type, const void* payload, uint8_t length) {
+    // an index record goes ahead of the first record past each interval
+    if(this->_since_index >= FLASH_LOG_INDEX_INTERVAL) {
+        log_index_t index;
+        memcpy(&index.timestamp, payload, sizeof(index.timestamp));
+        index.address = this->_log_end; // not known yet for a history record - trigger() fills it in
+        index.state = this->_state;
+        if(this->appendRecord(LOG_RECORD_INDEX, &index, sizeof(index))) {
+            this->_since_index = 0;
+        }
+    }
+
+    uint32_t address = this->_log_end;
+    bool live = !this->_pretrigger;
+    if(!this->appendRecord(type, payload, length)) {
+        return false;
+    }
+
+    if(type == LOG_RECORD_STATE) {
+        this->_state = ((const uint8_t*) payload)[offsetof(log_state_t, state)];
+        if(live) this->noteTransition(this->_state, address);
+    }
+
+    this->_since_index += 1 + length;
+    this->records++;
+
+    return true;
+}
+
+/**
+ * copy one record to the history or the buffer being filled
+*/
+bool FlashLogger::appendRecord(uint8_t type, const void* payload, uint8_t length) {
+    uint32_t record_length = 1 + length;
+
+    if(!this->_started || this->_log_end + record_length > this->_capacity) {
+        this->dropped++;
+        return false;
+    }
+
+    if(this->_pretrigger) {
+        this->appendHistory(type, payload, length);
+        return true;
+    }
+
+    // a record never straddles two buffers, so a dropped buffer never leaves half a record behind
+    if(this->_lengths[this->_fill] + record_length > FLASH_LOG_BUFFER_SIZE && !this->handOver()) {
+        this->dropped++;
+        return false;
+    }
+
+    uint8_t* buffer = this->_buffers[this->_fill] + this->_lengths[this->_fill];
+    buffer[0] = type;
+    memcpy(buffer + 1, payload, length);
+    this->_lengths[this->_fill] += record_length;
+    this->_log_end += record_length;
+
+    return true;
+}
+
+/**
+ * remember where a flight state was first entered, for the programming side to put in the header
+ * filling side only
+*/
+void FlashLogger::noteTransition(uint8_t state, uint32_t address) {
+    if(state >= FLASH_LOG_STATE_COUNT || this->_transitions[state] != FLASH_LOG_NO_ADDRESS) return;
+
+    this->_transitions[state] = address;
+    this->_transitions_pending.fetch_or(1u << state, std::memory_order_release);
+}
+
+/**
+ * copy a record into the history ring, evicting the oldest whole records to make room
+*/
+void FlashLogger::appendHistory(uint8_t type, const void* payload, uint8_t length) {
+    uint32_t record_length = 1 + length;
+
+    while(this->_history_head - this->_history_tail + record_length > FLASH_LOG_HISTORY_SIZE) {
+        this->_history_tail += logRecordLength(this->_history[this->_history_tail % FLASH_LOG_HISTORY_SIZE]);
+    }
+
+    const uint8_t* bytes = (const uint8_t*) payload;
+    this->_history[this->_history_head % FLASH_LOG_HISTORY_SIZE] = type;
+    for(uint32_t i = 0; i < length; i++) {
+        this->_history[(this->_history_head + 1 + i) % FLASH_LOG_HISTORY_SIZE] = bytes[i];
+    }
+    this->_history_head += record_length;
+}
+
+/**
+ * keep records in the RAM history instead of the flash until trigger()
+ * filling side only
+ * returns false until everything appended before has been programmed - sync() first - so the
+ * history can never be programmed ahead of older records
+*/
+bool FlashLogger::armPretrigger() {
+    if(this->_history_pending.load(std::memory_order_acquire) || this->_lengths[this->_fill] != 0 ||
+       this->_full[0].load(std::memory_order_acquire) || this->_full[1].load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    this->_history_head = 0;
+    this->_history_tail = 0;
+    this->_pretrigger = true;
+
+    return true;
+}
+
+/**
+ * stop the pre-trigger history and queue it for the flash ahead of the live stream
+ * filling side only
+ * returns false if the logger was not armed
+*/
+bool FlashLogger::trigger() {
+    if(!this->_pretrigger) return false;
+
+    this->_pretrigger = false;
+
+    uint32_t length = this->_history_head - this->_history_tail;
+    if(this->_log_end + length > this->_capacity) {
+        // keep the newest records that still fit
+        while(this->_history_head - this->_history_tail > this->_capacity - this->_log_end) {
+            this->_history_tail += logRecordLength(this->_history[this->_history_tail % FLASH_LOG_HISTORY_SIZE]);
+        }
+        length = this->_history_head - this->_history_tail;
+    }
+
+    // now the history has a place in the flash: give its index records their addresses and its
+    // state records their transitions
+    uint32_t address = this->_log_end;
+    for(uint32_t offset = this->_history_tail; offset != this->_history_head; ) {
+        uint8_t type = this->_history[offset % FLASH_LOG_HISTORY_SIZE];
+        uint32_t record_address = address + (offset - this->_history_tail);
+
+        if(type == LOG_RECORD_INDEX) {
+            uint32_t field = offset + 1 + offsetof(log_index_t, address);
+            for(uint8_t i = 0; i < sizeof(uint32_t); i++) {
+                this->_history[(field + i) % FLASH_LOG_HISTORY_SIZE] = (uint8_t) (record_address >> (8 * i)); // little endian
+            }
+        } else if(type == LOG_RECORD_STATE) {
+            this->noteTransition(this->_history[(offset + 1 + offsetof(log_state_t, state)) % FLASH_LOG_HISTORY_SIZE], record_address);
+        }
+
+        offset += logRecordLength(type);
+    }
+
+    // the space is reserved before any later buffer is handed over, so the history is programmed first
+    this->_log_end += length;
+    this->_history_pending.store(true, std::memory_order_release);
+
+    return true;
+}
+
+bool FlashLogger::isPretrigger() {
+    return this->_pretrigger;
+}
+
+/**
+ * hand over a partly filled buffer, e.g. before power down
+ * filling side only
+ * returns false if there was nothing to hand over or the other buffer is still waiting
+*/
+bool FlashLogger::sync() {
+    if(this->_lengths[this->_fill] == 0) return false;
+    return this->handOver();
+}
+
+/**
+ * true when a buffer is waiting to be programmed
+*/
+bool FlashLogger::pending() {
+    return this->_history_pending.load(std::memory_order_acquire) ||
+           this->_full[this->_program].load(std::memory_order_acquire);
+}
+
+/**
+ * erase whole sectors until everything below address is erased
+*/
+bool FlashLogger::eraseTo(uint32_t address) {
+    if(address > this->_capacity) address = this->_capacity;
+
+    while(this->_erased_until < address) {
+        if(!this->_flash.eraseSector(this->_erased_until)) {
+            this->errors++;
+            return false;
+        }
+        this->_erased_until += FLASH_SECTOR_SIZE;
+    }
+
+    return true;
+}
+
+/**
+ * program the transitions whose state records are already in the flash into the header
+*/
+void FlashLogger::programTransitions() {
+    uint32_t pending = this->_transitions_pending.load(std::memory_order_acquire);
+
+    for(uint8_t state = 0; pending != 0 && state < FLASH_LOG_STATE_COUNT; state++) {
+        uint32_t bit = 1u << state;
+        if((pending & bit) == 0 || this->_transitions[state] >= this->_write_address) continue;
+
+        uint32_t field = this->_header_address + 1 + offsetof(log_header_t, transitions) + state * sizeof(uint32_t);
+        if(!this->_flash.writeByteArray(field, (uint8_t*) &this->_transitions[state], sizeof(uint32_t), false)) {
+            this->errors++;
+        }
+        this->_transitions_pending.fetch_and(~bit, std::memory_order_release);
+    }
+}
+
+/**
+ * program the frozen history at the write head - oldest record first, in up to two pieces
+ * where the ring wraps
+*/
+void FlashLogger::programHistory() {
+    uint32_t length = this->_history_head - this->_history_tail;
+    uint32_t start = this->_history_tail % FLASH_LOG_HISTORY_SIZE;
+    uint32_t first = length < FLASH_LOG_HISTORY_SIZE - start ? length : FLASH_LOG_HISTORY_SIZE - start;
+
+    if(this->eraseTo(this->_write_address + length)) {
+        if(first > 0 && !this->_flash.writeByteArray(this->_write_address, &this->_history[start], first, false)) {
+            this->errors++;
+        }
+        if(length > first && !this->_flash.writeByteArray(this->_write_address + first, this->_history, length - first, false)) {
+            this->errors++;
+        }
+    }
+
+    this->_write_address += length;
+    this->_history_pending.store(false, std::memory_order_release);
+}
+
+/**
+ * program every buffer that is waiting, then erase ahead of the write head
+ * programming side only - blocks on the flash
+ * returns the bytes programmed
+*/
+uint32_t FlashLogger::program() {
+    uint32_t programmed = 0;
+
+    // the history goes ahead of every buffer handed over after the trigger
+    if(this->_history_pending.load(std::memory_order_acquire)) {
+        programmed += this->_history_head - this->_history_tail;
+        this->programHistory();
+    }
+
+    while(this->_full[this->_program].load(std::memory_order_acquire)) {
+        uint32_t length = this->_lengths[this->_program];
+
+        // catch up if the write head outran the erase
+        if(this->eraseTo(this->_write_address + length)) {
+            if(!this->_flash.writeByteArray(this->_write_address, this->_buffers[this->_program], length, false)) {
+                this->errors++;
+            }
+        }
+
+        this->_write_address += length;
+        programmed += length;
+
+        this->_full[this->_program].store(false, std::memory_order_release);
+        this->_program ^= 1;
+    }
+
+    this->programTransitions();
+
+    // erase ahead while there is time - the sector erase is the slow part
+    this->eraseTo(this->_write_address + FLASH_LOG_ERASE_AHEAD);
+
+    return programmed;
+}
+
+uint32_t FlashLogger::getWriteAddress() {
+    return this->_write_address;
+}
+
+bool FlashLogger::isFull() {
+    return this->_started && this->_write_address >= this->_capacity;
+}
@@ -0,0 +1,95 @@
+#include "fusion.h"
+
+// constructor
+AltitudeFusion::AltitudeFusion(float altitude_variance, float accel_variance, float jerk_psd) {
+    // Relationship between measurement and states
+    this->_filter.H[ALTITUDE][0] = 1.0;
+    this->_filter.H[ACCELERATION][2] = 1.0;
+
+    // Measurement error covariance
+    this->_filter.R[ALTITUDE] = altitude_variance;
+    this->_filter.R[ACCELERATION] = accel_variance;
+
+    this->_jerk_psd = jerk_psd;
+    this->_time = 0;
+    this->_initialized = false;
+}
+
+/**
+ * predict the estimate forward to timestamp
+ * A and Q are rebuilt from the elapsed time
+*/
+void AltitudeFusion::predictTo(uint32_t timestamp) {
+    int32_t elapsed = (int32_t) (timestamp - this->_time);
+    if(elapsed <= 0) return;
+
+    float dt = elapsed * 1e-6f;
+    float dt2 = dt * dt;
+    float dt3 = dt2 * dt;
+    float q = this->_jerk_psd;
+
+    // The system dynamics
+    this->_filter.A[0][1] = dt;
+    this->_filter.A[0][2] = 0.5f * dt2;
+    this->_filter.A[1][2] = dt;
+
+    // Process noise covariance - white jerk integrated over dt
+    this->_filter.Q[0][0] = q * dt3 * dt2 / 20.0f;
+    this->_filter.Q[0][1] = this->_filter.Q[1][0] = q * dt2 * dt2 / 8.0f;
+    this->_filter.Q[0][2] = this->_filter.Q[2][0] = q * dt3 / 6.0f;
+    this->_filter.Q[1][1] = q * dt3 / 3.0f;
+    this->_filter.Q[1][2] = this->_filter.Q[2][1] = q * dt2 / 2.0f;
+    this->_filter.Q[2][2] = q * dt;
+
+    this->_filter.predict();
+    this->_time = timestamp;
+}
+
+/**
+ * apply a barometric altitude in m
+ * the first altitude sample initializes the filter
+*/
+void AltitudeFusion::updateAltitude(float altitude, uint32_t timestamp) {
+    if(!this->_initialized) {
+        this->_filter.x[0] = altitude;
+        this->_filter.x[1] = 0;
+        this->_filter.x[2] = 0;
+        this->_time = timestamp;
+        this->_initialized = true;
+        return;
+    }
+
+    this->predictTo(timestamp);
+    this->_filter.updateScalar(ALTITUDE, altitude);
+}
+
+/**
+ * apply a vertical acceleration in m/s^2, gravity removed
+ * ignored until the barometer has initialized the filter
+*/
+void AltitudeFusion::updateAcceleration(float acceleration, uint32_t timestamp) {
+    if(!this->_initialized) return;
+
+    this->predictTo(timestamp);
+    this->_filter.updateScalar(ACCELERATION, acceleration);
+}
+
+bool AltitudeFusion::isInitialized() {
+    return this->_initialized;
+}
+
+uint32_t AltitudeFusion::getTime() {
+    return this->_time;
+}
+
+float AltitudeFusion::getAltitude() {
+    return this->_filter.x[0];
+}
+
+float AltitudeFusion::getVelocity() {
+    return this->_filter.x[1];
+}
+
+float AltitudeFusion::getAcceleration() {
+    return this->_filter.x[2];
+}
@@ -0,0 +1,81 @@
+#include "defs.h"
+#include "kalman.h"
+
+/**
+ * altitude filter - states are altitude, vertical velocity and vertical acceleration
+ * measurements are altitude and acceleration
+*/
+static KalmanFilter<3, 2> altitude_filter;
+static bool altitude_filter_ready = false;
+
+static void initAltitudeFilter(){
+    const float q = 0.0001;
+    const float dt = 0.1;
+
+    // The system dynamics
+    float A[3][3] = {{1.0, dt, 0.5f * dt * dt},
+                     {0, 1.0, dt},
+                     {0, 0, 1.0}};
+
+    // Relationship between measurement and states
+    float H[2][3] = {{1.0, 0, 0},
+                     {0, 0, 1.0}};
+
+    for(int i = 0; i < 3; i++){
+        for(int j = 0; j < 3; j++){
+            altitude_filter.A[i][j] = A[i][j];
+            // Process noise covariance
+            altitude_filter.Q[i][j] = q;
+            // Initial posteriori estimate error covariance
+            altitude_filter.P[i][j] = (i == j) ? 1.0f : 0.0f;
+        }
+        for(int m = 0; m < 2; m++){
+            altitude_filter.H[m][i] = H[m][i];
+        }
+    }
+
+    // Measurement error covariance
+    altitude_filter.R[0] = 0.25;
+    altitude_filter.R[1] = 0.75;
+
+    altitude_filter.x[0] = 1500.0;
+    altitude_filter.x[1] = 0.0;
+    altitude_filter.x[2] = 0.0;
+
+    altitude_filter_ready = true;
+}
+
+/**
+ * switch between the full filter and the fixed gain filter
+ * KALMAN_FULL or KALMAN_STEADY_STATE
+*/
+void setFilterMode(int mode){
+    if(!altitude_filter_ready) initAltitudeFilter();
+
+    if(mode == KALMAN_STEADY_STATE){
+        altitude_filter.solveSteadyStateGain(KALMAN_RICCATI_MAX_ITERATIONS, KALMAN_RICCATI_TOLERANCE);
+    }
+    altitude_filter.setSteadyState(mode == KALMAN_STEADY_STATE);
+}
+
+/* This filters our altitude and acceleration values */
+struct Filtered_Data filterData(float x_acceleration){
+    /* this struct will store the filtered data values */
+    struct Filtered_Data filtered_values;
+
+    if(!altitude_filter_ready) setFilterMode(KALMAN_MODE);
+
+    // Measurement matrix
+    float Z[2] = {0, x_acceleration};
+
+    altitude_filter.step(Z);
+
+    filtered_values.x_acceleration = altitude_filter.x[2];
+    filtered_values.altitude = altitude_filter.x[0];
+    filtered_values.velocity = altitude_filter.x[1];
+    filtered_values.timestamp = 0;
+    filtered_values.trace = {0, 0};
+    filtered_values.published = 0;
+
+    return filtered_values;
+}
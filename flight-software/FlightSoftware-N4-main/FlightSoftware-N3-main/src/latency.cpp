@@ -0,0 +1,128 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "latency.h"
+
+static const uint32_t percentile_ranks[LOG_LATENCY_PERCENTILES - 1] = {50, 90, 99};
+
+/* the stages of the pipeline, each written by its own task */
+static LatencyHistogram stage_age[LATENCY_STAGE_COUNT];
+static LatencyHistogram stage_hop[LATENCY_STAGE_COUNT];
+static std::atomic<uint32_t> stage_sequence[LATENCY_STAGE_COUNT];
+
+/* shared by every sensor task - a sequence ID names one sample of any stream */
+static std::atomic<uint32_t> next_sequence(0);
+
+// constructor
+LatencyHistogram::LatencyHistogram() : _max(0) {
+    for(int i = 0; i < LATENCY_BUCKETS; i++) {
+        this->_buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+uint32_t LatencyHistogram::bucketOf(uint32_t us) {
+    if(us < LATENCY_SUB_BUCKETS) return us;
+
+    uint32_t octave = 31 - __builtin_clz(us);
+    uint32_t shift = octave - LATENCY_SUB_BUCKET_BITS;
+    uint32_t bucket = (shift + 1) * LATENCY_SUB_BUCKETS + ((us >> shift) & (LATENCY_SUB_BUCKETS - 1));
+
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/**
+ * largest value that falls in bucket
+*/
+uint32_t LatencyHistogram::bucketTop(uint32_t bucket) {
+    if(bucket < LATENCY_SUB_BUCKETS) return bucket;
+
+    uint32_t shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint32_t sub = bucket % LATENCY_SUB_BUCKETS;
+
+    return ((LATENCY_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::add(uint32_t us) {
+    this->_buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t max = this->_max.load(std::memory_order_relaxed);
+    while(us > max && !this->_max.compare_exchange_weak(max, us, std::memory_order_relaxed));
+}
+
+uint32_t LatencyHistogram::take(uint32_t percentiles[LOG_LATENCY_PERCENTILES]) {
+    uint32_t counts[LATENCY_BUCKETS];
+    uint32_t total = 0;
+
+    for(int i = 0; i < LATENCY_BUCKETS; i++) {
+        counts[i] = this->_buckets[i].exchange(0, std::memory_order_relaxed);
+        total += counts[i];
+    }
+    uint32_t max = this->_max.exchange(0, std::memory_order_relaxed);
+
+    // the bucket holding the value of each rank, capped by the exact maximum
+    // a value added between the two exchanges can leave the bucket above the maximum, hence the cap
+    uint32_t bucket = 0, below = 0;
+    for(int p = 0; p < LOG_LATENCY_PERCENTILES - 1; p++) {
+        uint32_t rank = (total * percentile_ranks[p] + 99) / 100;
+        while(bucket < LATENCY_BUCKETS - 1 && below + counts[bucket] < rank) {
+            below += counts[bucket];
+            bucket++;
+        }
+
+        uint32_t top = bucket == LATENCY_BUCKETS - 1 ? max : bucketTop(bucket);
+        percentiles[p] = top < max ? top : max;
+    }
+    percentiles[LOG_LATENCY_PERCENTILES - 1] = max;
+
+    return total;
+}
+
+uint64_t latencyNow() {
+    return (uint64_t) esp_timer_get_time();
+}
+
+sample_trace_t latencyStamp(uint32_t timestamp) {
+    uint64_t now = latencyNow();
+    sample_trace_t trace;
+
+    // micros() is the low 32 bits of the same clock
+    trace.acquired = now - (uint32_t) ((uint32_t) now - timestamp);
+    trace.sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+
+    return trace;
+}
+
+static uint32_t saturate32(uint64_t from, uint64_t to) {
+    if(to <= from) return 0;
+    return to - from > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t) (to - from);
+}
+
+void latencyRecord(latency_stage_t stage, const sample_trace_t& trace, uint64_t handed_over, uint64_t now) {
+    stage_age[stage].add(saturate32(trace.acquired, now));
+    stage_hop[stage].add(saturate32(handed_over, now));
+    stage_sequence[stage].store(trace.sequence, std::memory_order_relaxed);
+}
+
+uint32_t latencyReport(log_latency_t* records, uint32_t max_records) {
+    uint32_t now = micros();
+    uint32_t count = 0;
+
+    for(int stage = 0; stage < LATENCY_STAGE_COUNT && count < max_records; stage++) {
+        log_latency_t& record = records[count];
+        uint32_t age[LOG_LATENCY_PERCENTILES], hop[LOG_LATENCY_PERCENTILES];
+
+        uint32_t samples = stage_age[stage].take(age);
+        stage_hop[stage].take(hop);
+        if(samples == 0) continue;
+
+        // the record is packed - copied in rather than taken by pointer
+        memcpy(record.age, age, sizeof(age));
+        memcpy(record.hop, hop, sizeof(hop));
+        record.timestamp = now;
+        record.stage = stage;
+        record.samples = samples > 0xFFFF ? 0xFFFF : samples;
+        record.sequence = stage_sequence[stage].load(std::memory_order_relaxed);
+        count++;
+    }
+
+    return count;
+}
@@ -10,7 +10,20 @@
 #include "defs.h"
 #include "state_machine.h"
 #include "mpu.h"
-#include <SFE_BMP180.h>
+#include "kalman.h"
+#include "fusion.h"
+#include "ring_buffer.h"
+#include "data_types.h"
+#include "sensor_bus.h"
+#include "telemetry.h"
+#include "flash_logger.h"
+#include "flash_dump.h"
+#include "task_stats.h"
+#include "latency.h"
+#include "deferred_log.h"
+#include "task_table.h"
+#include <bmp180.h>
+#include <bmp180_async.h>
 
 /**
  * DEBUG 
@@ -32,6 +45,18 @@ TinyGPSPlus gps;
 /* Onboard logging */
 File file;
 SPIFlash flash(SS, &SPI);
+FlashLogger flash_logger(flash);
+TaskHandle_t flash_program_task_handle = NULL;
+
+/* every IMU and barometer sample on its way to the flash log
+ * lock-free rings, so the sensor tasks never wait on the logger */
+RingBuffer<log_imu_t, LOG_IMU_RING_LENGTH> imu_log_ring;
+RingBuffer<log_altimeter_t, LOG_ALTIMETER_RING_LENGTH> altimeter_log_ring;
+
+/* task and channel statistics from the reporter on their way to the flash log */
+RingBuffer<log_task_t, TASK_LOG_RING_LENGTH> task_log_ring;
+RingBuffer<log_channel_t, CHANNEL_LOG_RING_LENGTH> channel_log_ring;
+RingBuffer<log_latency_t, LATENCY_LOG_RING_LENGTH> latency_log_ring;
 
 /* position integration variables */
 long long current_time = 0;
@@ -42,53 +67,18 @@ long long previous_time = 0;
 */
 
 
-typedef struct Acceleration_Data{
-    float ax;
-    float ay; 
-    float az;
-} accel_type_t;
-
-typedef struct Gyroscope_Data {
-    double gx;
-    double gy;
-    double gz;
-} gyro_type_t;
-
-typedef struct GPS_Data{
-    double latitude;
-    double longitude;; 
-    uint time;
-} gps_type_t;
-
-typedef struct Altimeter_Data{
-    double pressure;
-    double altitude;
-    double velocity;
-    double AGL; /* altitude above ground level */
-} altimeter_type_t;
-
-typedef struct Telemetry_Data {
-    float ax;
-    float ay; 
-    float az;
-    float gx;
-    float gy; 
-    float gz;
-    int32_t pressure;
-    float altitude;
-    float velocity;
-    float AGL; /* altitude above ground level */
-    double latitude;
-    double longitude;; 
-    uint time;
-} telemetry_type_t;
-
 accel_type_t acc_data;
 gyro_type_t gyro_data;
 gps_type_t gps_data;
 altimeter_type_t altimeter_data;
 telemetry_type_t telemetry_data;
 
+/* latest value of every stream - read by any number of tasks at their own rate */
+SensorBus sensor_bus;
+
+/* flight state machine */
+State_machine fsm;
+
 /**
  * ///////////////////////// END OF DATA VARIABLES /////////////////////////
 */
@@ -100,12 +90,15 @@ telemetry_type_t telemetry_data;
  * create an MPU6050 object
  * set gyro to max deg to 1000 deg/sec
  * set accel fs reading to 16g
+ * the ranges are template parameters - an unsupported range will not compile
 */
-MPU6050 imu(0x68, 16, 1000);
+MPU6050<16, 1000> imu(MPU6050_ADDRESS);
 
 // create BMP object 
-SFE_BMP180 altimeter;
-char status;
+BMP180 altimeter;
+BMP180Async baro(altimeter, BMP180_OVERSAMPLING, BMP180_TEMPERATURE_INTERVAL);
+BMP180AltitudeTable altitude_table; // pressure to altitude without a pow() per reading
+bool altitude_baseline_set = false;
 double T, P, p0, a;
 #define ALTITUDE 1525.0 // altitude of iPIC building, JKUAT, Juja.
 
@@ -127,14 +120,22 @@ void BMPInit() {
 // create data types to hold the sensor data 
 
 
+/* sensor path to the fusion task
+ * lock-free single producer / single consumer rings - no copy through the kernel and no
+ * critical section per sample. fuseAltitudeTask is the only consumer of both and is woken
+ * by a task notification from the producers
+ * */
+RingBuffer<accel_type_t, ACCEL_RING_LENGTH> accel_ring;
+RingBuffer<altimeter_type_t, ALTIMETER_RING_LENGTH> altimeter_ring;
+TaskHandle_t fuse_task_handle = NULL;
+
 /* create queue to store altimeter data
  * store pressure and altitude
  * */
-QueueHandle_t accel_data_qHandle;
-QueueHandle_t altimeter_data_qHandle;
+QueueHandle_t imu_data_qHandle;
+ChannelStats imu_queue_stats;
 // QueueHandle_t gps_data_queue;
 // QueueHandle_t telemetry_data_queue; /* This queue will hold all the sensor data for transmission to ground station*/
-// QueueHandle_t filtered_data_queue;
 // QueueHandle_t flight_states_queue;
 
 
@@ -161,16 +162,116 @@ QueueHandle_t altimeter_data_qHandle;
 //     mqtt_client.setServer(MQTT_SERVER, MQTT_PORT);
 // }
 
+#if IMU_USE_FIFO
+TaskHandle_t imu_task_handle = NULL;
+volatile uint32_t imu_ready_count = 0;
+
+/**
+ * MPU6050 data ready interrupt - one pulse per sample written to the FIFO
+ * wake the read task once a whole batch is waiting
+*/
+void IRAM_ATTR imuDataReadyISR() {
+    BaseType_t task_woken = pdFALSE;
+
+    if(++imu_ready_count >= IMU_FIFO_BATCH) {
+        imu_ready_count = 0;
+        vTaskNotifyGiveFromISR(imu_task_handle, &task_woken);
+    }
+
+    portYIELD_FROM_ISR(task_woken);
+}
+#endif
+
+/**
+ * hand one IMU sample to the consumers
+ * do not block on the queues - a newer sample is always on its way
+ * the fusion task is notified by the caller once the batch is in the ring
+*/
+void dispatchImuSample(const imu_sample_t& imu_sample) {
+    acc_data.ax = imu_sample.ax;
+    acc_data.ay = imu_sample.ay;
+    acc_data.az = imu_sample.az;
+    acc_data.timestamp = imu_sample.timestamp;
+    acc_data.trace = latencyStamp(imu_sample.timestamp);
+
+    gyro_data.gx = imu_sample.gx;
+    gyro_data.gy = imu_sample.gy;
+    gyro_data.gz = imu_sample.gz;
+
+    accel_ring.push(acc_data);
+    sensor_bus.accel.publish(acc_data);
+    sensor_bus.gyro.publish(gyro_data);
+
+    log_imu_t log_imu = {
+        imu_sample.timestamp,
+        imu_sample.raw_ax, imu_sample.raw_ay, imu_sample.raw_az,
+        imu_sample.raw_gx, imu_sample.raw_gy, imu_sample.raw_gz
+    };
+    imu_log_ring.push(log_imu);
+    if(xQueueSend(imu_data_qHandle, &imu_sample, 0) != pdPASS) imu_queue_stats.drop();
+}
+
+/**
+ * wake the fusion task - it drains everything that arrived meanwhile
+*/
+void notifyFusion() {
+    if(fuse_task_handle != NULL) {
+        xTaskNotifyGive(fuse_task_handle);
+    }
+}
+
 // read acceleration task
 void readAccelerationTask(void* pvParameter) {
+    TaskStats* stats = taskStatsRegister();
+
+#if IMU_USE_FIFO
+    imu_sample_t imu_batch[IMU_FIFO_MAX_DRAIN];
+
+    imu_task_handle = xTaskGetCurrentTaskHandle();
+    pinMode(IMU_INT_PIN, INPUT);
+    attachInterrupt(digitalPinToInterrupt(IMU_INT_PIN), imuDataReadyISR, RISING);
+
+    while(1) {
+        // sleep until a batch is ready - the FIFO keeps sampling meanwhile
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IMU_FIFO_TIMEOUT_MS));
+        stats->begin();
+
+        if(imu.fifoOverflowed()) {
+            // the FIFO head may now hold a partial record, start again from a clean FIFO
+            imu.resetFifo();
+            debugLog("[-]IMU FIFO overflow");
+            stats->end();
+            continue;
+        }
+
+        uint16_t count = imu.readFifo(imu_batch, IMU_FIFO_MAX_DRAIN);
+        for(uint16_t i = 0; i < count; i++) {
+            dispatchImuSample(imu_batch[i]);
+        }
+        if(count > 0) notifyFusion();
+        stats->end();
+    }
+#else
+    imu_sample_t imu_sample;
+    TickType_t last_wake = xTaskGetTickCount();
 
     while(1) {
-        acc_data.ax = imu.readXAcceleration();
-        acc_data.ay = imu.readYAcceleration();
-        acc_data.az = 0;
-        xQueueSend(accel_data_qHandle, &acc_data, portMAX_DELAY);
+        // one read per period - back to back reads would starve every lower priority task on this core
+        vTaskDelayUntil(&last_wake, taskPeriod(pvParameter));
+        stats->begin();
+
+        // one burst read gives accel and gyro from the same instant
+        if(!imu.readAll(imu_sample)) {
+            stats->end();
+            continue;
+        }
+
+        dispatchImuSample(imu_sample);
+        notifyFusion();
+        stats->end();
 
     }
+#endif
 }
 
 /**
@@ -178,12 +279,23 @@ void readAccelerationTask(void* pvParameter) {
  * roll and pitch angles 
 */
 void calculateOrientationTask(void* pvParameter) {
+    imu_sample_t rcvd_sample; // sample received from imu_data_queue
+    TaskStats* stats = taskStatsRegister();
     
     while (1) {
-        float pitch = imu.getPitch();
-        float roll = imu.getRoll();
+        if(xQueueReceive(imu_data_qHandle, &rcvd_sample, portMAX_DELAY) == pdPASS) {
+            stats->begin();
+            imu_queue_stats.depth(uxQueueMessagesWaiting(imu_data_qHandle) + 1);
+
+            // gyro integrated at full IMU rate, corrected by the accelerometer when it reads about 1g
+            imu.filterImu(rcvd_sample);
+
+            float pitch = imu.attitude.getPitch();
+            float roll = imu.attitude.getRoll();
 
-        debug(pitch);debug(","); debug(roll); debugln();
+            debugLog("%.2f,%.2f", pitch, roll);
+            stats->end();
+        }
     }
 
 }
@@ -191,98 +303,316 @@ void calculateOrientationTask(void* pvParameter) {
 ///////////////////////// ALTITUDE AND VELOCITY DETERMINATION /////////////////////////
 
 void readAltimeter(void* pvParameters){
+    TaskStats* stats = taskStatsRegister();
+
+    while(true){
+        stats->begin();
+
+        // collect a finished conversion and start the next one
+        // the driver never waits on the sensor, temperature is re-read every BMP180_TEMPERATURE_INTERVAL readings
+        if(baro.update(millis())) {
+            T = baro.temperature / 10.0; // 0.1 deg C to deg C
+            P = baro.pressure / 100.0; // Pa to mb
+
+            // the sea level pressure only needs computing once, from the first reading at the known altitude
+            if(!altitude_baseline_set) {
+                altitude_table.setBaseline(bmp180Sealevel(baro.pressure, ALTITUDE));
+                altitude_baseline_set = true;
+            }
+            p0 = altitude_table.getBaseline() / 100.0;
+
+            // altitude above sea level from the interpolated lookup table
+            // Result: a = altitude in m.
+            a = altitude_table.altitude(baro.pressure);
+            debugLog("temperature: %.2f C, absolute pressure: %.2f mb, computed altitude: %.2f meters", T, P, a);
+
+            // TODO: compute the velocity from the altimeter data
+
+            // assign data to queue
+            altimeter_data.pressure = P;
+            altimeter_data.altitude = a;
+            altimeter_data.velocity = 0;
+            // stamped when the conversion completed, not when this task came round to collect it
+            // micros() and millis() count the same clock
+            altimeter_data.timestamp = micros() - (millis() - baro.timestamp) * 1000;
+            altimeter_data.trace = latencyStamp(altimeter_data.timestamp);
+
+            // hand the reading to the fusion task
+            // a full ring drops the reading and counts it - never wait, a newer reading is on its way
+            altimeter_ring.push(altimeter_data);
+            sensor_bus.altimeter.publish(altimeter_data);
+
+            log_altimeter_t log_altimeter = {altimeter_data.timestamp, baro.pressure, baro.temperature};
+            altimeter_log_ring.push(log_altimeter);
+            notifyFusion();
+        }
+
+        stats->end();
+
+        // sleep until the conversion in flight is done
+        uint32_t wait = baro.msUntilReady(millis());
+        vTaskDelay(pdMS_TO_TICKS(wait > 0 ? wait : 1));
+
+    }
+
+}
 
-    while(true){    
-        // If you want to measure altitude, and not pressure, you will instead need
-        // to provide a known baseline pressure. This is shown at the end of the sketch.
-
-        // You must first get a temperature measurement to perform a pressure reading.
-        
-        // Start a temperature measurement:
-        // If request is successful, the number of ms to wait is returned.
-        // If request is unsuccessful, 0 is returned.
-        status = altimeter.startTemperature();
-        if(status !=0 ) {
-            // wait for measurement to complete
-            delay(status);
-
-            // retrieve the completed temperature measurement 
-            // temperature is stored in variable T
-
-            status = altimeter.getTemperature(T);
-            if(status != 0) {
-                // print out the measurement 
-                Serial.print("temperature: ");
-                Serial.print(T, 2);
-                Serial.print(" \xB0 C, ");
-
-                // start pressure measurement 
-                // The parameter is the oversampling setting, from 0 to 3 (highest res, longest wait).
-                // If request is successful, the number of ms to wait is returned.
-                // If request is unsuccessful, 0 is returned.
-                status = altimeter.startPressure(3);
-                if(status != 0) {
-                    // wait for the measurement to complete
-                    delay(status);
-
-                    // Retrieve the completed pressure measurement:
-                    // Note that the measurement is stored in the variable P.
-                    // Note also that the function requires the previous temperature measurement (T).
-                    // (If temperature is stable, you can do one temperature measurement for a number of pressure measurements.)
-                    // Function returns 1 if successful, 0 if failure.
-
-                    status = altimeter.getPressure(P, T);
-                    if(status != 0) {
-                        // print out the measurement
-                        Serial.print("absolute pressure: ");
-                        Serial.print(P, 2);
-                        Serial.print(" mb, "); // in millibars
-
-                        p0 = altimeter.sealevel(P,ALTITUDE);
-                        // If you want to determine your altitude from the pressure reading,
-                        // use the altitude function along with a baseline pressure (sea-level or other).
-                        // Parameters: P = absolute pressure in mb, p0 = baseline pressure in mb.
-                        // Result: a = altitude in m.
-
-                        a = altimeter.altitude(P, p0);
-                        Serial.print("computed altitude: ");
-                        Serial.print(a, 0);
-                        Serial.print(" meters, ");
-
-                    } else {
-                        Serial.println("error retrieving pressure measurement\n");
-                    } 
-                
-                } else {
-                    Serial.println("error starting pressure measurement\n");
-                }
 
+///////////////////////// ALTITUDE AND VELOCITY FUSION /////////////////////////
+
+AltitudeFusion altitude_fusion(FUSION_ALTITUDE_VARIANCE, FUSION_ACCEL_VARIANCE, FUSION_JERK_PSD);
+
+/**
+ * Fuse the IMU and barometer streams into altitude, velocity and acceleration
+ * every sample is applied when it arrives, predicted forward by its own timestamp,
+ * so the estimate runs at IMU rate without waiting for the barometer
+ * the estimate carries the trace of its newest sample to the stages after it
+*/
+void fuseAltitudeTask(void* pvParameters){
+    accel_type_t rcvd_accel[ACCEL_RING_LENGTH];
+    altimeter_type_t rcvd_altimeter[ALTIMETER_RING_LENGTH];
+    struct Filtered_Data filtered_data;
+
+    TaskStats* stats = taskStatsRegister();
+
+    fuse_task_handle = xTaskGetCurrentTaskHandle();
+
+    while(true){
+        // sleep until a producer has pushed - the timeout only guards against a lost notification
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FUSION_TIMEOUT_MS));
+        stats->begin();
+
+        uint32_t n_accel = accel_ring.popBatch(rcvd_accel, ACCEL_RING_LENGTH);
+        uint32_t n_altimeter = altimeter_ring.popBatch(rcvd_altimeter, ALTIMETER_RING_LENGTH);
+
+        if(n_accel == 0 && n_altimeter == 0){
+            // woken by the timeout with nothing to fuse
+            stats->end();
+            continue;
+        }
+
+        // apply both streams in timestamp order
+        // the x axis points along the rocket, so vertical acceleration is the x reading less 1g
+        uint32_t i = 0, j = 0;
+        while(i < n_accel || j < n_altimeter){
+            bool take_altimeter = j < n_altimeter &&
+                (i == n_accel || (int32_t)(rcvd_altimeter[j].timestamp - rcvd_accel[i].timestamp) <= 0);
+
+            if(take_altimeter){
+                altitude_fusion.updateAltitude(rcvd_altimeter[j].altitude, rcvd_altimeter[j].timestamp);
+                j++;
             } else {
-                Serial.println("error retrieving temperature measurement\n");
+                altitude_fusion.updateAcceleration((rcvd_accel[i].ax - 1.0) * ONE_G, rcvd_accel[i].timestamp);
+                i++;
             }
+        }
+
+        // every sample was consumed now - the newest one stands for the estimate
+        uint64_t now = latencyNow();
+        sample_trace_t newest = {0, 0};
+        for(i = 0; i < n_accel; i++){
+            latencyRecord(LATENCY_FILTER, rcvd_accel[i].trace, rcvd_accel[i].trace.acquired, now);
+            if(rcvd_accel[i].trace.acquired >= newest.acquired) newest = rcvd_accel[i].trace;
+        }
+        for(j = 0; j < n_altimeter; j++){
+            latencyRecord(LATENCY_FILTER, rcvd_altimeter[j].trace, rcvd_altimeter[j].trace.acquired, now);
+            if(rcvd_altimeter[j].trace.acquired >= newest.acquired) newest = rcvd_altimeter[j].trace;
+        }
+
+        if(!altitude_fusion.isInitialized()){
+            stats->end();
+            continue;
+        }
+
+        filtered_data.altitude = altitude_fusion.getAltitude();
+        filtered_data.velocity = altitude_fusion.getVelocity();
+        filtered_data.x_acceleration = altitude_fusion.getAcceleration();
+        filtered_data.timestamp = altitude_fusion.getTime();
+        filtered_data.trace = newest;
+        filtered_data.published = now;
+
+        sensor_bus.filtered.publish(filtered_data);
+        stats->end();
+    }
+}
+
+///////////////////////// FLASH LOGGING /////////////////////////
+
+/**
+ * lift off for the pre-trigger
+ * taken from the fused estimate on its own as well as from the state machine, so the log starts
+ * even if the state machine misses the launch. see LAUNCH_TRIGGER_ACCELERATION in defs.h
+ * logWriterTask only
+*/
+static bool launchDetected(){
+    static uint32_t boost_checks = 0;
+    static uint32_t filtered_count = 0;
+    struct Filtered_Data filtered;
+    int32_t flight_state;
+
+    if(sensor_bus.flight_state.read(flight_state) && flight_state >= POWERED_FLIGHT) return true;
+
+    uint32_t count = sensor_bus.filtered.count();
+    if(count == filtered_count || !sensor_bus.filtered.read(filtered)) return false;
+    filtered_count = count;
+
+    if(filtered.altitude - ALTITUDE > LAUNCH_TRIGGER_ALTITUDE) return true;
+
+    if(filtered.x_acceleration > LAUNCH_TRIGGER_ACCELERATION) boost_checks++;
+    else boost_checks = 0;
+
+    return boost_checks >= LAUNCH_TRIGGER_CHECKS;
+}
+
+/**
+ * fill the flash log buffers
+ * every IMU and barometer sample from the rings, the fused estimate and the flight state
+ * from the sensor bus at this task's rate. Only copies into RAM - the flash is programmed by
+ * flashProgramTask, so a slow erase never holds this task or the sensor tasks up
+ * during PRE_FLIGHT the records only go to the pre-trigger history, see FlashLogger
+*/
+void logWriterTask(void* pvParameters){
+    log_imu_t imu_batch[LOG_IMU_RING_LENGTH];
+    log_altimeter_t altimeter_batch[LOG_ALTIMETER_RING_LENGTH];
+    struct Filtered_Data filtered;
+    int32_t flight_state;
+    int32_t logged_state = -1;
+    uint32_t filtered_count = 0;
+    log_task_t task_batch[TASK_LOG_RING_LENGTH];
+    log_channel_t channel_batch[CHANNEL_LOG_RING_LENGTH];
+    log_latency_t latency_batch[LATENCY_LOG_RING_LENGTH];
+    TaskStats* stats = taskStatsRegister();
+
+    while(true){
+        stats->begin();
+
+        // launch detected - the history of the pad goes to the flash ahead of the live records
+        if(flash_logger.isPretrigger() && launchDetected()){
+            flash_logger.trigger();
+        }
+
+        uint32_t n = imu_log_ring.popBatch(imu_batch, LOG_IMU_RING_LENGTH);
+        for(uint32_t i = 0; i < n; i++){
+            flash_logger.append(LOG_RECORD_IMU, &imu_batch[i], sizeof(log_imu_t));
+        }
+
+        n = altimeter_log_ring.popBatch(altimeter_batch, LOG_ALTIMETER_RING_LENGTH);
+        for(uint32_t i = 0; i < n; i++){
+            flash_logger.append(LOG_RECORD_ALTIMETER, &altimeter_batch[i], sizeof(log_altimeter_t));
+        }
+
+        uint32_t count = sensor_bus.filtered.count();
+        if(count != filtered_count && sensor_bus.filtered.read(filtered)){
+            filtered_count = count;
+            log_filtered_t log_filtered = {filtered.timestamp, filtered.altitude, filtered.velocity, filtered.x_acceleration};
+            flash_logger.append(LOG_RECORD_FILTERED, &log_filtered, sizeof(log_filtered));
+            // in the RAM buffer - programming follows in flashProgramTask
+            latencyRecord(LATENCY_LOGGER, filtered.trace, filtered.published, latencyNow());
+        }
+
+        if(sensor_bus.flight_state.read(flight_state) && flight_state != logged_state){
+            logged_state = flight_state;
+            log_state_t log_state = {(uint32_t) micros(), (uint8_t) flight_state};
+            flash_logger.append(LOG_RECORD_STATE, &log_state, sizeof(log_state));
+        }
+
+        n = task_log_ring.popBatch(task_batch, TASK_LOG_RING_LENGTH);
+        for(uint32_t i = 0; i < n; i++){
+            flash_logger.append(LOG_RECORD_TASK, &task_batch[i], sizeof(log_task_t));
+        }
 
-        } else {
-            Serial.println("error starting temperature measurement\n");
+        n = channel_log_ring.popBatch(channel_batch, CHANNEL_LOG_RING_LENGTH);
+        for(uint32_t i = 0; i < n; i++){
+            flash_logger.append(LOG_RECORD_CHANNEL, &channel_batch[i], sizeof(log_channel_t));
         }
 
-        // delay(2000);
+        n = latency_log_ring.popBatch(latency_batch, LATENCY_LOG_RING_LENGTH);
+        for(uint32_t i = 0; i < n; i++){
+            flash_logger.append(LOG_RECORD_LATENCY, &latency_batch[i], sizeof(log_latency_t));
+        }
+
+        if(flash_logger.pending() && flash_program_task_handle != NULL){
+            xTaskNotifyGive(flash_program_task_handle);
+        }
 
-        // TODO: compute the velocity from the altimeter data
+        stats->end();
+        vTaskDelay(taskPeriod(pvParameters));
+    }
+}
 
-        // assign data to queue
-        altimeter_data.pressure = P;
-        altimeter_data.altitude = 0;
-        altimeter_data.velocity = 0;
+/**
+ * program the full log buffers and erase ahead of the write head
+ * sleeps until the writer hands a buffer over
+*/
+void flashProgramTask(void* pvParameters){
+    TaskStats* stats = taskStatsRegister();
 
-        // send this pressure data to queue
-        // do not wait for the queue if it is full because the data rate is so high, 
-        // we might lose some data as we wait for the queue to get space
-        xQueueSend(altimeter_data_qHandle, &altimeter_data, 0); 
+    flash_program_task_handle = xTaskGetCurrentTaskHandle();
 
+    while(true){
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FLASH_LOG_ERASE_INTERVAL_MS));
+        stats->begin();
+        flash_logger.program();
+        stats->end();
     }
+}
 
+///////////////////////// TASK STATISTICS /////////////////////////
+
+/**
+ * sample the loop timing and stack of every task, the fill of the queues and rings and the sample
+ * latency of every pipeline stage into the flash log
+ * lowest priority, so it only runs on the time the flight tasks leave - a gap in its records is a sign
+ * in itself. The records go through rings to logWriterTask, the only task that appends to the log
+*/
+void taskStatsReporter(void* pvParameters){
+    log_task_t task_records[TASK_STATS_MAX_TASKS];
+    log_latency_t latency_records[LATENCY_STAGE_COUNT];
+    TaskStats* stats = taskStatsRegister();
+    TickType_t last_wake = xTaskGetTickCount();
+
+    while(true){
+        vTaskDelayUntil(&last_wake, taskPeriod(pvParameters));
+        stats->begin();
+
+        uint32_t n = taskStatsReport(task_records, TASK_STATS_MAX_TASKS);
+        task_log_ring.pushBatch(task_records, n);
+
+        uint32_t now = micros();
+        log_channel_t channel_records[] = {
+            taskStatsChannel(now, "accel", accel_ring.capacity(), accel_ring.highWater(), accel_ring.overflows()),
+            taskStatsChannel(now, "altim", altimeter_ring.capacity(), altimeter_ring.highWater(), altimeter_ring.overflows()),
+            taskStatsChannel(now, "imuQueue", IMU_QUEUE_LENGTH, imu_queue_stats.highWater(), imu_queue_stats.drops()),
+            taskStatsChannel(now, "imuLog", imu_log_ring.capacity(), imu_log_ring.highWater(), imu_log_ring.overflows()),
+            taskStatsChannel(now, "altimLog", altimeter_log_ring.capacity(), altimeter_log_ring.highWater(), altimeter_log_ring.overflows()),
+            taskStatsChannel(now, "taskLog", task_log_ring.capacity(), task_log_ring.highWater(), task_log_ring.overflows()),
+            taskStatsChannel(now, "debugLog", deferred_log_ring.capacity(), deferred_log_ring.highWater(), deferred_log_ring.overflows()),
+        };
+        channel_log_ring.pushBatch(channel_records, sizeof(channel_records) / sizeof(channel_records[0]));
+
+        n = latencyReport(latency_records, LATENCY_STAGE_COUNT);
+        latency_log_ring.pushBatch(latency_records, n);
+
+        stats->end();
+    }
 }
 
+/**
+ * print the lines the tasks queued with debugLog()
+ * the formatting and the wait on the UART happen here, at the lowest priority, instead of in the
+ * task that logged
+*/
+void debugLogTask(void* pvParameters){
+    TaskStats* stats = taskStatsRegister();
+
+    while(true){
+        stats->begin();
+        deferredLogDrain(Serial, DEFERRED_LOG_RING_LENGTH);
+        stats->end();
+
+        vTaskDelay(taskPeriod(pvParameters));
+    }
+}
 
 // void readGPS(void* pvParameters){
 //     /* This function reads GPS data and sends it to the ground station */
@@ -315,116 +645,106 @@ void readAltimeter(void* pvParameters){
 //     }
 // }
 
+/**
+ * print the latest value of each stream
+ * snapshots from the sensor bus - nothing is taken away from the other consumers
+*/
 void debugToTerminal(void* pvParameters){
-    accel_type_t rcvd_accel; // accelration received from acceleration_queue
+    accel_type_t accel;
+    altimeter_type_t altimeter;
+    struct Filtered_Data filtered;
+    int32_t flight_state;
 
     while(true){
-        if(xQueueReceive(accel_data_qHandle, &rcvd_accel, portMAX_DELAY) == pdPASS){
-            // debugln("--------------accel----------------");
-            debug("x: "); debug(rcvd_accel.ax); debug(" y: "); debug(rcvd_accel.ay); debug(" z: "); debug(rcvd_accel.az); debugln();
-            // debug("roll: "); debug(gyroscope_buffer.gx); debugln();
-            // debug("pitch: "); debug(gyroscope_buffer.gy); debugln();
-            // debug("yaw: "); debug(gyroscope_buffer.gz); debugln();
-        }else{
-            /* no queue */
+        if(sensor_bus.accel.read(accel)){
+            debug("x: "); debug(accel.ax); debug(" y: "); debug(accel.ay); debug(" z: "); debug(accel.az); debugln();
+        }
+
+        if(sensor_bus.altimeter.read(altimeter)){
+            debug("Pressure: "); debug(altimeter.pressure); debugln();
+            debug("Altitude: "); debug(altimeter.altitude); debugln();
+        }
+
+        if(sensor_bus.filtered.read(filtered)){
+            debug("Filtered altitude: "); debug(filtered.altitude); debugln();
+            debug("Velocity: "); debug(filtered.velocity); debugln();
+        }
+
+        if(sensor_bus.flight_state.read(flight_state)){
+            debug("State: "); debug(flight_state); debugln();
         }
 
-        // if(xQueueReceive(altimeter_data_queue, &altimeter_buffer, portMAX_DELAY) == pdPASS){
-        //     debug("Pressure: "); debug(altimeter_buffer.pressure); debugln();
-        //     debug("Altitude: "); debug(altimeter_buffer.altitude); debugln();
-        //     debug("Velocity: "); debug(altimeter_buffer.velocity); debugln();
-        //     debug("AGL: "); debug(altimeter_buffer.AGL); debugln();
-            
-        // }else{
-        //     /* no queue */
-        // }
-
-        // if(xQueueReceive(gps_data_queue, &gps_buffer, portMAX_DELAY) == pdPASS){
-        //     debug("Lattitude: "); debug(gps_buffer.latitude); debugln();
-        //     debug("Longitude: "); debug(gps_buffer.longitude); debugln();
-        //     debug("Time: "); debug(gps_buffer.time); debugln();
-            
-        // }else{
-        //     /* no queue */
-        // }
+        vTaskDelay(taskPeriod(pvParameters));
     }
 }
 
-// void transmitTelemetry(void* pvParameters){
-//     /* This function sends data to the ground station */
+/**
+ * send the latest sensor values to the ground station as binary frames
+ * the frame is filled in place from the sensor bus snapshots and sent as it lies in memory -
+ * 74 bytes instead of ~180 characters of sprintf output, see telemetry.h for the layout
+*/
+void transmitTelemetry(void* pvParameters){
+    telemetry_frame_t frame;
+    accel_type_t accel;
+    gyro_type_t gyro;
+    altimeter_type_t altimeter;
+    struct Filtered_Data filtered;
+    gps_type_t gps;
+    int32_t flight_state = PRE_FLIGHT;
+    uint32_t sequence = 0;
+    uint32_t filtered_count = 0;
+    bool filtered_new = false;
+
+    memset(&frame, 0, sizeof(frame));
 
-//      /*  create two pointers to the data structures to be transmitted */
-    
-//     char telemetry_data[180];
-//     struct Acceleration_Data gyroscope_data_receive;
-//     struct Altimeter_Data altimeter_data_receive;
-//     struct GPS_Data gps_data_receive;
-//     int32_t flight_state_receive;
-//     int id = 0;
+    while(true){
+        // topics not published yet keep their previous (zero) values
+        if(sensor_bus.accel.read(accel)){
+            frame.data.ax = accel.ax;
+            frame.data.ay = accel.ay;
+            frame.data.az = accel.az;
+        }
 
-//     while(true){
-//         file = SPIFFS.open("/log.csv", FILE_APPEND);
-//         if(!file) debugln("[-] Failed to open file for appending");
-//         else debugln("[+] File opened for appending");
-        
-//         /* receive data into respective queues */
-//         if(xQueueReceive(gyroscope_data_queue, &gyroscope_data_receive, portMAX_DELAY) == pdPASS){
-//             debugln("[+]Gyro data ready for sending ");
-//         }else{
-//             debugln("[-]Failed to receive gyro data");
-//         }
+        if(sensor_bus.gyro.read(gyro)){
+            frame.data.gx = gyro.gx;
+            frame.data.gy = gyro.gy;
+            frame.data.gz = gyro.gz;
+        }
 
-//         if(xQueueReceive(altimeter_data_queue, &altimeter_data_receive, portMAX_DELAY) == pdPASS){
-//             debugln("[+]Altimeter data ready for sending ");
-//         }else{
-//             debugln("[-]Failed to receive altimeter data");
-//         }
+        if(sensor_bus.altimeter.read(altimeter)){
+            frame.data.pressure = (int32_t) (altimeter.pressure * 100.0); // mb to Pa
+        }
 
-//         if(xQueueReceive(gps_data_queue, &gps_data_receive, portMAX_DELAY) == pdPASS){
-//             debugln("[+]GPS data ready for sending ");
-//         }else{
-//             debugln("[-]Failed to receive GPS data");
-//         }
+        uint32_t count = sensor_bus.filtered.count();
+        if(sensor_bus.filtered.read(filtered)){
+            filtered_new = count != filtered_count;
+            filtered_count = count;
+            frame.data.altitude = filtered.altitude;
+            frame.data.velocity = filtered.velocity;
+            frame.data.AGL = filtered.altitude - ALTITUDE;
+        }
 
-//         if(xQueueReceive(flight_states_queue, &flight_state_receive, portMAX_DELAY) == pdPASS){
-//             debugln("[+]Flight state ready for sending ");
-//         }else{
-//             debugln("[-]Failed to receive Flight state");
-//         }
+        if(sensor_bus.gps.read(gps)){
+            frame.data.latitude = gps.latitude;
+            frame.data.longitude = gps.longitude;
+            frame.data.time = gps.time;
+        }
 
-//         sprintf(telemetry_data,
-//             "%i,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%i,%.16f,%.16f,%i,%i\n",
-//             id,//0
-//             gyroscope_data_receive.ax,//1
-//             gyroscope_data_receive.ay,//2
-//             gyroscope_data_receive.az,//3
-//             gyroscope_data_receive.gx,//4
-//             gyroscope_data_receive.gy,//5
-//             gyroscope_data_receive.gz,//6
-//             altimeter_data_receive.AGL,//7
-//             altimeter_data_receive.altitude,//8
-//             altimeter_data_receive.velocity,//9
-//             altimeter_data_receive.pressure,//10
-//             gps_data_receive.latitude,//11
-//             gps_data_receive.longitude,//12
-//             gps_data_receive.time,//13
-//             flight_state_receive//14
-//         );
-//         if(file.print(telemetry_data)){
-//             debugln("[+] Message appended");
-//         } else {
-//             debugln("[-] Append failed");
-//         }
-//         file.close();
-//         id+=1;
+        sensor_bus.flight_state.read(flight_state);
 
-//         if(mqtt_client.publish("n3/telemetry", telemetry_data)){
-//             debugln("[+]Data sent");
-//         } else{
-//             debugln("[-]Data not sent");
-//         }
-//     }
-// }
+        telemetrySeal(frame, (uint8_t) flight_state, sequence++, millis());
+
+        if(!mqtt_client.publish("n3/telemetry", (const uint8_t*) &frame, sizeof(frame))){
+            debugLog("[-]Data not sent");
+        } else if(filtered_new){
+            // an estimate sent again in the next frames is not acted on again
+            latencyRecord(LATENCY_TELEMETRY, filtered.trace, filtered.published, latencyNow());
+            filtered_new = false;
+        }
+
+        vTaskDelay(taskPeriod(pvParameters));
+    }
+}
 
 // void reconnect(){
 
@@ -451,48 +771,94 @@ void debugToTerminal(void* pvParameters){
 // }
 
 
-// void flight_state_check(void* pvParameters){
-//     /* Set flight state based on sensor values */
-//     int32_t flight_state = PRE_FLIGHT;
-//     struct Altimeter_Data altimeter_data_receive;
-//     while(true){
-//         if(xQueueReceive(altimeter_data_queue, &altimeter_data_receive, portMAX_DELAY) == pdPASS){
-//             debugln("[+]Altimeter data in state machine");
-
-//             /*------------- STATE MACHINE -------------------------------------*/
-//             flight_state = fsm.checkState(altimeter_data_receive.altitude, altimeter_data_receive.velocity);
-
-//             /*------------- DEPLOY PARACHUTE ALGORITHM -------------------------------------*/
-//             if(flight_state>=POWERED_FLIGHT){//start countdown to ejection
-//                 if(offset_flag){
-//                     timer_offset = millis();
-//                     offset_flag = false;
-//                 }
-//                 if(TTA-(millis()-timer_offset)<0){
-//                     pinMode(EJECTION_PIN,HIGH);
-//                     delay(5000);
-//                 }
-//                 if(flight_state>=APOGEE && flight_state<PARACHUTE_DESCENT) {
-//                     pinMode(EJECTION_PIN,HIGH);
-//                     delay(5000);
-//                 }
-//                 else pinMode(EJECTION_PIN,LOW);
-//             }
+/**
+ * Set flight state based on the fused altitude and velocity
+ * runs at its own rate off the sensor bus and publishes the state for the other tasks
+*/
+void flight_state_check(void* pvParameters){
+    int32_t flight_state = PRE_FLIGHT;
+    struct Filtered_Data filtered;
+    uint32_t last_count = 0;
+    TaskStats* stats = taskStatsRegister();
 
-//         }else{
-//             debugln("[-]Failed to receive altimeter data in state machine");
-//         }
-//         if(xQueueSend(flight_states_queue, &flight_state, portMAX_DELAY) != pdPASS) debugln("[-]Failed to update state");
-//     }
-// }
+    sensor_bus.flight_state.publish(flight_state);
+
+    while(true){
+        stats->begin();
+
+        // only step the state machine on a new estimate
+        uint32_t count = sensor_bus.filtered.count();
+        if(count != last_count && sensor_bus.filtered.read(filtered)){
+            last_count = count;
+
+            /*------------- STATE MACHINE -------------------------------------*/
+            flight_state = fsm.checkState(filtered.altitude, filtered.velocity);
+            sensor_bus.flight_state.publish(flight_state);
+
+            // the decision is made - its age is the end-to-end latency of the deploy path
+            latencyRecord(LATENCY_FSM, filtered.trace, filtered.published, latencyNow());
+
+            /*------------- DEPLOY PARACHUTE ALGORITHM -------------------------------------*/
+            // TODO: ejection timer and apogee deployment
+            // if(flight_state>=POWERED_FLIGHT){//start countdown to ejection
+            //     if(offset_flag){
+            //         timer_offset = millis();
+            //         offset_flag = false;
+            //     }
+            //     if(TTA-(millis()-timer_offset)<0){
+            //         pinMode(EJECTION_PIN,HIGH);
+            //         delay(5000);
+            //     }
+            //     if(flight_state>=APOGEE && flight_state<PARACHUTE_DESCENT) {
+            //         pinMode(EJECTION_PIN,HIGH);
+            //         delay(5000);
+            //     }
+            //     else pinMode(EJECTION_PIN,LOW);
+            // }
+        }
+
+        stats->end();
+        vTaskDelay(taskPeriod(pvParameters));
+    }
+}
+
+///////////////////////// TASK TABLE /////////////////////////
+
+/**
+ * every task of the flight software - core, priority, stack and period in one place
+ * the sensor path from acquisition to the flight state runs on ACQUISITION_CORE, with setup() and loop()
+ * and nothing else; logging, statistics and the network on SERVICE_CORE, beside the Wi-Fi stack
+ * the task statistics in the flash log carry the core of every task - change the split here and
+ * compare the reports
+ * the Arduino loop task keeps priority 1 on ACQUISITION_CORE and never sleeps, so the tasks there
+ * start at 2
+*/
+static const task_config_t task_table[] = {
+    // function                 name                    stack           priority    core                period
+    {readAccelerationTask,      "readGyroscope",        STACK_SIZE*2,   4,          ACQUISITION_CORE,   IMU_USE_FIFO ? 0 : IMU_POLL_INTERVAL_MS},
+    {readAltimeter,             "readAltimeter",        STACK_SIZE,     4,          ACQUISITION_CORE,   0},
+    {fuseAltitudeTask,          "fuseAltitude",         STACK_SIZE*2,   3,          ACQUISITION_CORE,   0},
+    {flight_state_check,        "checkState",           STACK_SIZE,     3,          ACQUISITION_CORE,   FLIGHT_STATE_INTERVAL_MS},
+    {calculateOrientationTask,  "calcOrientation",      STACK_SIZE,     2,          ACQUISITION_CORE,   0},
+
+    // flash logging - filling and programming run in separate tasks so neither waits on the other
+    {logWriterTask,             "logWriter",            STACK_SIZE*3,   2,          SERVICE_CORE,       FLASH_LOG_INTERVAL_MS},
+    {flashProgramTask,          "flashProgram",         STACK_SIZE*2,   1,          SERVICE_CORE,       0},
+    // {readGPS,                "readGPS",              STACK_SIZE,     1,          SERVICE_CORE,       0},
+    // {transmitTelemetry,      "transmit_telemetry",   STACK_SIZE*2,   1,          SERVICE_CORE,       TELEMETRY_INTERVAL_MS}, // needs connectToWifi()
+    // {debugToTerminal,        "displayData",          STACK_SIZE,     1,          SERVICE_CORE,       DEBUG_INTERVAL_MS},
+
+    // below every flight task - they only run on the time the others leave
+    {taskStatsReporter,         "taskStats",            STACK_SIZE*2,   0,          SERVICE_CORE,       TASK_STATS_INTERVAL_MS},
+#if DEBUG
+    {debugLogTask,              "debugLog",             STACK_SIZE*2,   0,          SERVICE_CORE,       DEBUG_LOG_INTERVAL_MS},
+#endif
+};
 
 void setup(){
     /* initialize serial */
     Serial.begin(115200);
 
-    uint8_t app_id = xPortGetCoreID();
-    BaseType_t th;
-
     /* Setup GPS*/
     // hard.begin(9600, SERIAL_8N1, RX, TX);
 
@@ -501,13 +867,21 @@ void setup(){
     // else debugln("[+] SPIFFS mounted successfully");
 
     //setup flash memory
-    // if (!flash.begin()) debugln("[-] An error occurred while mounting flash");
-    // else{
-    //     debug("[+] Flash mounted successfully ");
-    //     debugln(((String)flash.getCapacity() + " bytes" ));
+    if (!flash.begin()) debugln("[-] An error occurred while mounting flash");
+    else{
+        debug("[+] Flash mounted successfully ");
+        debugln(((String)flash.getCapacity() + " bytes" ));
+
+        // download mode if the host asks right after reset - the board then never gets to the flight tasks
+        uint32_t dump_baud;
+        if(flashDumpRequested(Serial, FLASH_DUMP_WAIT_MS, dump_baud)){
+            flashDumpServe(flash, flash_logger, Serial, dump_baud);
+        }
 
-    //     flash.eraseChip();
-    // }
+        // continue after the logs already in the flash - no chip erase at boot
+        if(!flash_logger.begin()) debugln("[-] Flash logger failed to start");
+        else flash_logger.armPretrigger(); // keep only the last seconds of the pad wait until launch
+    }
 
     /* DEBUG: set up state simulation leds */
     // for(auto pin: state_leds){
@@ -519,6 +893,11 @@ void setup(){
 
     ///////////////////////// PERIPHERALS INIT /////////////////////////
     imu.init();
+    imu.attitude.setMode(ATTITUDE_MODE);
+    imu.calibrateGyro(CALLIBRATION_READINGS);
+#if IMU_USE_FIFO
+    imu.enableFifo(IMU_SAMPLE_RATE_HZ);
+#endif
     BMPInit();
 
     //==============================================================
@@ -532,11 +911,8 @@ void setup(){
     // debugln("Creating queues...");
 
     ///////////////////// create data queues ////////////////////
-    // this queue holds the data from MPU 6050 - this data is filtered already
-    accel_data_qHandle = xQueueCreate(GYROSCOPE_QUEUE_LENGTH, sizeof(accel_type_t)); 
-
-    // this queue hold the data read from the BMP180
-    altimeter_data_qHandle = xQueueCreate(ALTIMETER_QUEUE_LENGTH, sizeof(altimeter_type_t)); 
+    // this queue holds complete IMU samples for the orientation task
+    imu_data_qHandle = xQueueCreate(IMU_QUEUE_LENGTH, sizeof(imu_sample_t));
 
     // assert(accel_data_qHandle != nullptr);
 
@@ -585,129 +961,7 @@ void setup(){
     // }
 
     //====================== TASK CREATION ==========================
-    /* Create tasks
-     * All tasks have a stack size of 1024 words - not bytes!
-     * ESP32 is 32 bit, therefore 32bits x 1024 = 4096 bytes
-     * So the stack size is 4096 bytes
-     * */
-    // debugln("Creating tasks...");
-
-    /* TASK 1: READ ACCELERATION DATA */
-   th = xTaskCreatePinnedToCore(
-        readAccelerationTask,         
-        "readGyroscope",
-        STACK_SIZE*2,                  
-        NULL,                       
-        1,
-        NULL,
-        app_id
-   );
-
-   if(th == pdPASS) {
-    Serial.println("Task created");
-   } else {
-    Serial.println("Task creation failed");
-   }
-
-   
-    /* TASK 1: READ ALTIMETER DATA */
-   if(xTaskCreate(
-           readAltimeter,               /* function that executes this task*/
-           "readAltimeter",             /* Function name - for debugging */
-           STACK_SIZE,                  /* Stack depth in words */
-           NULL,                        /* parameter to be passed to the task */
-           2,        /* Task priority - in thGYROSCOPEis case 1 */
-           NULL                         /* task handle that can be passed to other tasks to reference the task */
-   ) != pdPASS){
-    // if task creation is not successful
-    debugln("[-]Read-Altimeter task creation failed!");
-
-   }else{
-    debugln("[+]Read-Altimeter task creation success");
-   }
-
-   /* TASK 2: READ GPS DATA */
-    // if(xTaskCreate(
-    //           readGPS,         
-    //           "readGPS",
-    //           STACK_SIZE,                  
-    //           NULL,                       
-    //           2,
-    //           NULL
-    //     ) != pdPASS){
-    //     debugln("[-]Read-GPS task creation failed!");
-    // } else{
-    //     debugln("[+]Read-GPS task creation success!");
-    // }
-
-    /* TASK 3: DISPLAY DATA ON SERIAL MONITOR - FOR DEBUGGING */
-    // th = xTaskCreatePinnedToCore(
-    //         debugToTerminal,
-    //         "displayData",
-    //         STACK_SIZE,
-    //         NULL,
-    //         1,
-    //         NULL,
-    //         app_id
-    //         );
-        
-    // if(th == pdPASS) {
-    //     Serial.println("Task created");
-    // } else {
-    //     Serial.println("Task not created");
-    // }
-
-    /* task to calculate rocket orientation */
-    th = xTaskCreatePinnedToCore(
-        calculateOrientationTask,
-        "calcOrientation",
-        STACK_SIZE,
-        NULL,
-        1,
-        NULL,
-        app_id
-    );
-
-    /* TASK 4: TRANSMIT TELEMETRY DATA */
-    // if(xTaskCreate(
-    //         transmitTelemetry,
-    //         "transmit_telemetry",
-    //         STACK_SIZE*2,
-    //         NULL,
-    //         2,
-    //         NULL
-    // ) != pdPASS){
-    //     debugln("[-]Transmit task failed to create");
-    // }else{
-    //     debugln("[+]Transmit task created success");
-    // }
-
-    // if(xTaskCreate(
-    //         testMQTT,
-    //         "testMQTT",
-    //         STACK_SIZE,
-    //         NULL,
-    //         1,
-    //         NULL
-    // ) != pdPASS){
-    //     debugln("[-]Test mqtt task failed to create");
-    // }else{
-    //     debugln("[+]Test mqtt task created success");
-    // }
-
-    // if(xTaskCreate(
-    //         flight_state_check,
-    //         "testFSM",
-    //         STACK_SIZE,
-    //         NULL,
-    //         2,
-    //         NULL
-    // ) != pdPASS){
-    //     debugln("[-]FSM task failed to create");
-    // }else{
-    //     debugln("[+]FSM task created success");
-    // }
-
+    startTasks(task_table, sizeof(task_table) / sizeof(task_table[0]));
 }
 
 void loop(){
@@ -1,158 +1,231 @@
 #include "mpu.h"
 
 // constructor
-MPU6050::MPU6050(uint8_t address, uint32_t accel_fs_range, uint32_t gyro_fs_range) {
+MPU6050Base::MPU6050Base(uint8_t address) {
     this->_address = address;
-    this->_accel_fs_range = accel_fs_range;
-    this->_gyro_fs_range = gyro_fs_range;
+    this->_sample_period_us = 1000000 / MPU6050_GYRO_RATE_HZ;
+    this->_last_filter_time = 0;
+    this->_filter_started = false;
+    this->roll_angle = NAN; // no reading yet
+    this->pitch_angle = NAN;
 
 }
 
-// initialize the MPU6050 
-void MPU6050::init() {
-    // initialize the MPU6050 
+// initialize the MPU6050
+// the register values come from the range traits of the MPU6050 template
+void MPU6050Base::init(uint8_t accel_config, uint8_t gyro_config) {
+    // initialize the MPU6050
     Wire.begin(static_cast<int>(SDA), static_cast<int>(SCL));
-    Wire.beginTransmission(this->_address);
-    Wire.write(PWR_MNGMT_1); // power on the device 
-    Wire.write(RESET);
-    Wire.endTransmission(true);
+    this->writeRegister(PWR_MNGMT_1, RESET); // power on the device
     delay(50);
 
-    // // configure the gyroscope
-    // Wire.beginTransmission(this->_address);
-    // Wire.begin(GYRO_CONFIG);
-    // if(this->_gyro_fs_range == 250) {
-    //     Wire.write(SET_GYRO_FS_250);
-    // } else if(this->_gyro_fs_range == 500) {
-    //     Wire.write(SET_GYRO_FS_500);
-    // } else if (this->_gyro_fs_range == 1000) {
-    //     Wire.write(SET_GYRO_FS_1000);
-    // } else if (this->_gyro_fs_range == 2000) {
-    //     Wire.write(SET_GYRO_FS_2000);
-    // }
-    // Wire.endTransmission(true);
+    // configure the gyroscope
+    this->writeRegister(GYRO_CONFIG, gyro_config);
 
     // configure the accelerometer
+    this->writeRegister(ACCEL_CONFIG, accel_config);
+}
+
+/**
+ * write a single configuration register
+*/
+void MPU6050Base::writeRegister(uint8_t reg, uint8_t value) {
     Wire.beginTransmission(this->_address);
-    Wire.write(ACCEL_CONFIG);
-
-    if(this->_accel_fs_range == 2) {
-        Wire.write(SET_ACCEL_FS_2G);
-    } else if (this->_accel_fs_range == 4) {
-         Wire.write(SET_ACCEL_FS_4G);
-    }  else if (this->_accel_fs_range== 8) {
-         Wire.write(SET_ACCEL_FS_8G);
-    }  else if (this->_accel_fs_range == 16) {
-         Wire.write(SET_ACCEL_FS_16G);
-    }
+    Wire.write(reg);
+    Wire.write(value);
     Wire.endTransmission(true);
 }
 
 /**
- * Read X axix acceleration
+ * read a single register
 */
-float MPU6050::readXAcceleration() {
+uint8_t MPU6050Base::readRegister(uint8_t reg) {
     Wire.beginTransmission(this->_address);
-    Wire.write(ACCEL_XOUT_H);
-    Wire.endTransmission(true);
+    Wire.write(reg);
+    Wire.endTransmission(false);
 
-    Wire.requestFrom(this->_address, 2, false);
-    this->acc_x = Wire.read()<<8 | Wire.read();
-
-    // divide by the respective factors
-    if(this->_accel_fs_range == 2) {
-        this->acc_x_real = (float) acc_x / ACCEL_FACTOR_2G;
-    } else if(this->_accel_fs_range == 4) {
-        this->acc_x_real = (float) acc_x / ACCEL_FACTOR_4G; 
-    } else if(this->_accel_fs_range == 8) {
-        this->acc_x_real = (float) acc_x / ACCEL_FACTOR_8G;
-    } else if(this->_accel_fs_range == 16) {
-        this->acc_x_real = (float) acc_x / ACCEL_FACTOR_16G;
-    }
+    Wire.requestFrom(this->_address, (uint8_t) 1, (uint8_t) true);
+    return Wire.read();
+}
 
-    return this->acc_x_real;
+/**
+ * read a big endian 16 bit output register pair starting at reg
+*/
+int16_t MPU6050Base::readRegister16(uint8_t reg) {
+    Wire.beginTransmission(this->_address);
+    Wire.write(reg);
+    Wire.endTransmission(false);
 
+    Wire.requestFrom(this->_address, (uint8_t) 2, (uint8_t) true);
+    return Wire.read()<<8 | Wire.read();
 }
 
 /**
- * Read Y acceleration
+ * Read the raw accelerometer, temperature and gyroscope registers in a single I2C transaction
+ * The 14 output registers are contiguous from ACCEL_XOUT_H to GYRO_ZOUT_L,
+ * so one burst gives all the axes from the same sampling instant
+ * returns false if the sensor did not return the full burst
 */
-float MPU6050::readYAcceleration() {
+bool MPU6050Base::readBurst(imu_sample_t& sample) {
+    uint8_t buffer[MPU6050_BURST_LENGTH];
+
     Wire.beginTransmission(this->_address);
-    Wire.write(ACCEL_YOUT_H);
-    Wire.endTransmission(true);
+    Wire.write(ACCEL_XOUT_H);
+    if(Wire.endTransmission(false) != 0) {
+        return false;
+    }
+
+    if(Wire.requestFrom(this->_address, (uint8_t) MPU6050_BURST_LENGTH, (uint8_t) true) != MPU6050_BURST_LENGTH) {
+        return false;
+    }
 
-    Wire.requestFrom(this->_address, 2, false);
-    this->acc_y = Wire.read()<<8 | Wire.read();
-
-    // divide by the respective factors
-    if(this->_accel_fs_range == 2) {
-        this->acc_y_real = (float) acc_y / ACCEL_FACTOR_2G;
-    } else if(this->_accel_fs_range == 4) {
-        this->acc_y_real = (float) acc_y / ACCEL_FACTOR_4G; 
-    } else if(this->_accel_fs_range == 8) {
-        this->acc_y_real = (float) acc_y / ACCEL_FACTOR_8G;
-    } else if(this->_accel_fs_range == 16) {
-        this->acc_y_real = (float) acc_y / ACCEL_FACTOR_16G;
+    for(uint8_t i = 0; i < MPU6050_BURST_LENGTH; i++) {
+        buffer[i] = Wire.read();
     }
 
-    return this->acc_y_real;
-    
+    sample.timestamp = micros();
+    decodeBurst(buffer, sample);
+
+    // keep the member copies in step for callers that read them directly
+    this->acc_x = sample.raw_ax; this->acc_y = sample.raw_ay; this->acc_z = sample.raw_az;
+    this->ang_vel_x = sample.raw_gx; this->ang_vel_y = sample.raw_gy; this->ang_vel_z = sample.raw_gz;
+    this->temp = sample.raw_temp;
+
+    return true;
 }
 
 /**
- * Read Z acceleration
+ * unpack the 14 big endian bytes of one burst or one FIFO record
+ * both use the output register order: accel x/y/z, temperature, gyro x/y/z
 */
-float MPU6050::readZAcceleration() {
-    Wire.beginTransmission(this->_address);
-    Wire.write(ACCEL_ZOUT_H);
-    Wire.endTransmission(true);
+void MPU6050Base::decodeBurst(const uint8_t* buffer, imu_sample_t& sample) {
+    sample.raw_ax = buffer[0] << 8 | buffer[1];
+    sample.raw_ay = buffer[2] << 8 | buffer[3];
+    sample.raw_az = buffer[4] << 8 | buffer[5];
+    sample.raw_temp = buffer[6] << 8 | buffer[7];
+    sample.raw_gx = buffer[8] << 8 | buffer[9];
+    sample.raw_gy = buffer[10] << 8 | buffer[11];
+    sample.raw_gz = buffer[12] << 8 | buffer[13];
+}
+
+/**
+ * configure the sensor to sample on its own clock and queue samples in the FIFO
+ * the data ready interrupt pin pulses once per sample
+ * sample_rate_hz is derived from the 1kHz DLPF rate, so 4 - 1000 Hz in integer divisions
+*/
+void MPU6050Base::enableFifo(uint16_t sample_rate_hz) {
+    if(sample_rate_hz == 0) sample_rate_hz = 1;
+    if(sample_rate_hz > MPU6050_GYRO_RATE_HZ) sample_rate_hz = MPU6050_GYRO_RATE_HZ;
+
+    uint16_t divider = MPU6050_GYRO_RATE_HZ / sample_rate_hz - 1;
+    if(divider > 255) divider = 255;
+    this->_sample_period_us = (divider + 1) * (1000000 / MPU6050_GYRO_RATE_HZ);
+
+    this->writeRegister(DLPF_CONFIG, SET_DLPF_188HZ);
+    this->writeRegister(SMPLRT_DIV, (uint8_t) divider);
+    this->writeRegister(FIFO_EN, SET_FIFO_ALL);
+    this->writeRegister(INT_PIN_CFG, SET_INT_RD_CLEAR);
+    this->writeRegister(INT_ENABLE, SET_DATA_RDY_EN | SET_FIFO_OFLOW_EN);
+    this->resetFifo();
+}
+
+/**
+ * discard the FIFO contents and restart it
+ * used after an overflow, when the FIFO can hold a partial record at its head
+*/
+void MPU6050Base::resetFifo() {
+    this->writeRegister(USER_CTRL, SET_USER_FIFO_RESET);
+    this->writeRegister(USER_CTRL, SET_USER_FIFO_EN);
+}
+
+/**
+ * number of bytes waiting in the FIFO
+*/
+uint16_t MPU6050Base::fifoCount() {
+    return (uint16_t) this->readRegister16(FIFO_COUNT_H);
+}
+
+/**
+ * check and clear the FIFO overflow flag
+*/
+bool MPU6050Base::fifoOverflowed() {
+    return (this->readRegister(INT_STATUS) & FIFO_OFLOW_INT) != 0;
+}
 
-    Wire.requestFrom(this->_address, 2, false);
-    this->acc_z = Wire.read()<<8 | Wire.read();
-
-    // divide by the respective factors
-    if(this->_accel_fs_range == 2) {
-        this->acc_z_real = (float) acc_z / ACCEL_FACTOR_2G;
-    } else if(this->_accel_fs_range == 4) {
-        this->acc_z_real = (float) acc_z / ACCEL_FACTOR_4G; 
-    } else if(this->_accel_fs_range == 8) {
-        this->acc_z_real = (float) acc_z / ACCEL_FACTOR_8G;
-    } else if(this->_accel_fs_range == 16) {
-        this->acc_z_real = (float) acc_z / ACCEL_FACTOR_16G;
+/**
+ * read up to max_samples whole records out of the FIFO
+ * samples are timestamped backwards from now using the configured sample period,
+ * counting the records still left behind in the FIFO
+ * returns the number of samples read
+*/
+uint16_t MPU6050Base::readFifoBurst(imu_sample_t* samples, uint16_t max_samples) {
+    uint8_t buffer[MPU6050_BURST_LENGTH * MPU6050_FIFO_CHUNK];
+
+    uint16_t available = this->fifoCount() / MPU6050_BURST_LENGTH;
+    uint32_t now = micros();
+    uint16_t count = available < max_samples ? available : max_samples;
+    uint16_t read = 0;
+
+    while(read < count) {
+        uint16_t chunk = count - read;
+        if(chunk > MPU6050_FIFO_CHUNK) chunk = MPU6050_FIFO_CHUNK;
+        uint8_t length = chunk * MPU6050_BURST_LENGTH;
+
+        Wire.beginTransmission(this->_address);
+        Wire.write(FIFO_R_W);
+        if(Wire.endTransmission(false) != 0) {
+            break;
+        }
+
+        if(Wire.requestFrom(this->_address, length, (uint8_t) true) != length) {
+            break;
+        }
+
+        for(uint8_t i = 0; i < length; i++) {
+            buffer[i] = Wire.read();
+        }
+
+        for(uint16_t i = 0; i < chunk; i++) {
+            imu_sample_t& sample = samples[read + i];
+            decodeBurst(&buffer[i * MPU6050_BURST_LENGTH], sample);
+            sample.timestamp = now - (uint32_t)(available - 1 - (read + i)) * this->_sample_period_us;
+        }
+
+        read += chunk;
     }
 
-    return this->acc_z_real;
-    
+    return read;
 }
 
 /**
- * compute the pitch angle
- * angle along the transverse axis 
+ * compute the roll angle from an already read sample
+ * angle along the transverse axis
  * return roll angle in degrees
 */
-float MPU6050::getRoll() {
+float MPU6050Base::getRoll(const imu_sample_t& sample) {
     // convert the imu readings to m/s^2
-    this->acc_y_ms = this->readYAcceleration() * ONE_G;
-    this->acc_z_ms = this->readZAcceleration() * ONE_G;
+    this->acc_y_ms = sample.ay * ONE_G;
+    this->acc_z_ms = sample.az * ONE_G;
 
     this->roll_angle = atan2(this->acc_y_ms, this->acc_z_ms);
 
-    return this->roll_angle * TO_DEG_FACTOR;    
-
+    return this->roll_angle * TO_DEG_FACTOR;
 }
 
 /**
- * compute the roll angle
+ * compute the pitch angle from an already read sample
  * angle along the longitudinal axis
  * return pitch angle in degrees
 */
-float MPU6050::getPitch() {
+float MPU6050Base::getPitch(const imu_sample_t& sample) {
+    // clamp to the asin domain - the x reading can exceed 1g when the rocket accelerates
+    float x = sample.ax;
+    if(x > 1.0) x = 1.0;
+    if(x < -1.0) x = -1.0;
 
-    // convert the imu readings to m/s^2
-    this->acc_x_ms = this->readXAcceleration() * ONE_G;
+    this->acc_x_ms = x * ONE_G;
 
-    this->pitch_angle = asin(this->acc_x_ms/ONE_G);
+    this->pitch_angle = asin(x);
 
     return this->pitch_angle * TO_DEG_FACTOR;
 }
@@ -160,27 +233,32 @@ float MPU6050::getPitch() {
 
 /**
  * perform sensor fusion
- * perfom complementary filter to remove accelerometer high frequrecny noise 
- * remove low frequency noise from gyroscope and fuse the sensors 
+ * integrate the gyroscope and correct its low frequency drift with the accelerometer
+ * dt comes from the sample timestamps, so samples must be given in order
+ * the result is in the attitude member
 */
-void MPU6050::filterImu() {
-    // complementary filter formula 
-    // return this value as the final correct value from the IMU
-    
+void MPU6050Base::filterImu(const imu_sample_t& sample) {
+    if(!this->_filter_started) {
+        this->attitude.initFromAccel(sample.ax, sample.ay, sample.az);
+        this->_last_filter_time = sample.timestamp;
+        this->_filter_started = true;
+        return;
+    }
 
-}
+    float dt = (uint32_t) (sample.timestamp - this->_last_filter_time) * 1e-6f;
+    this->_last_filter_time = sample.timestamp;
 
-float MPU6050::readTemperature() {
-    // write to temp register
-    Wire.beginTransmission(this->_address);
-    Wire.write(TEMP_OUT_H);
-    Wire.endTransmission(true);
+    this->attitude.update(sample.gx * ATTITUDE_DEG_TO_RAD, sample.gy * ATTITUDE_DEG_TO_RAD, sample.gz * ATTITUDE_DEG_TO_RAD,
+                          sample.ax, sample.ay, sample.az, dt);
+}
 
-    Wire.requestFrom(this->_address, 2, false);
-    this->temp = Wire.read()<<8 | Wire.read();
+float MPU6050Base::readTemperature() {
+    this->temp = this->readRegister16(TEMP_OUT_H);
 
-    // temperature conversion formula 
+    // temperature conversion formula
     // temp = (TEMP_OUT_VALUE as a signed quantity)/340 +36.53
-}
+    this->temp_real = (float) this->temp / 340.0 + 36.53;
 
+    return this->temp_real;
+}
 
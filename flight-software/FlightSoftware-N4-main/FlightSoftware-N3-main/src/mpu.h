@@ -6,6 +6,7 @@
 #include <Wire.h>
 #include <math.h>
 #include "defs.h"
+#include "attitude.h"
 
 
 // divisor factors based on full scale ranges
@@ -25,12 +26,12 @@
 #define PWR_MNGMT_1             0x6B
 #define RESET                   0x00
 #define SET_GYRO_FS_250         0x00
-#define SET_GYRO_FS_500         0x01
-#define SET_GYRO_FS_1000        0x02
+#define SET_GYRO_FS_500         0x08
+#define SET_GYRO_FS_1000        0x10
 #define SET_GYRO_FS_2000        0x18
 #define SET_ACCEL_FS_2G         0x00
-#define SET_ACCEL_FS_4G         0x01
-#define SET_ACCEL_FS_8G         0x02
+#define SET_ACCEL_FS_4G         0x08
+#define SET_ACCEL_FS_8G         0x10
 #define SET_ACCEL_FS_16G        0x18
 #define ACCEL_XOUT_H            0x3B
 #define ACCEL_XOUT_L            0x3C
@@ -46,14 +47,80 @@
 #define GYRO_ZOUT_L             0x48
 #define TEMP_OUT_H              0x41
 #define TEMP_OUT_L              0x42
+#define SMPLRT_DIV              0x19
+#define DLPF_CONFIG             0x1A
+#define FIFO_EN                 0x23
+#define INT_PIN_CFG             0x37
+#define INT_ENABLE              0x38
+#define INT_STATUS              0x3A
+#define USER_CTRL               0x6A
+#define FIFO_COUNT_H            0x72
+#define FIFO_R_W                0x74
+#define SET_DLPF_188HZ          0x01    // gyro output rate drops to 1kHz with the DLPF on
+#define SET_FIFO_ALL            0xF8    // temp, gyro x/y/z and accel - same order as the output registers
+#define SET_INT_RD_CLEAR        0x10    // interrupt status clears on any read
+#define SET_DATA_RDY_EN         0x01
+#define SET_FIFO_OFLOW_EN       0x10
+#define SET_USER_FIFO_EN        0x40
+#define SET_USER_FIFO_RESET     0x04
+#define FIFO_OFLOW_INT          0x10
 #define ONE_G                   9.80665
 #define TO_DEG_FACTOR           57.32
 
-class MPU6050 {
-    private:
+// ACCEL_XOUT_H through GYRO_ZOUT_L - accel, temperature and gyro in one burst
+#define MPU6050_BURST_LENGTH    14
+#define MPU6050_GYRO_RATE_HZ    1000    // internal sample rate with the DLPF enabled
+#define MPU6050_FIFO_SIZE       1024
+#define MPU6050_FIFO_CHUNK      9       // samples per requestFrom - keeps each read inside the 128 byte Wire buffer
+
+/**
+ * one coherent IMU sample
+ * all the axes are latched at the same instant by a single burst read
+*/
+typedef struct IMU_Sample {
+    uint32_t timestamp;                 // micros() when the burst was read
+    int16_t raw_ax, raw_ay, raw_az;     // raw accelerometer counts
+    int16_t raw_temp;                   // raw temperature counts
+    int16_t raw_gx, raw_gy, raw_gz;     // raw gyroscope counts
+    float ax, ay, az;                   // acceleration in g
+    float gx, gy, gz;                   // angular velocity in deg/s
+    float temp;                         // die temperature in deg C
+} imu_sample_t;
+
+/**
+ * full scale range traits
+ * only the ranges the MPU6050 supports are specialized, so an unsupported 
+ * range is a compile error instead of a silent zero reading
+ * scale is the reciprocal of the datasheet divisor - conversion is one multiply
+*/
+template <uint32_t FS> struct MPU6050AccelRange { static constexpr bool supported = false; };
+template <> struct MPU6050AccelRange<2>  { static constexpr bool supported = true; static constexpr uint8_t config = SET_ACCEL_FS_2G;  static constexpr float scale = 1.0f / ACCEL_FACTOR_2G; };
+template <> struct MPU6050AccelRange<4>  { static constexpr bool supported = true; static constexpr uint8_t config = SET_ACCEL_FS_4G;  static constexpr float scale = 1.0f / ACCEL_FACTOR_4G; };
+template <> struct MPU6050AccelRange<8>  { static constexpr bool supported = true; static constexpr uint8_t config = SET_ACCEL_FS_8G;  static constexpr float scale = 1.0f / ACCEL_FACTOR_8G; };
+template <> struct MPU6050AccelRange<16> { static constexpr bool supported = true; static constexpr uint8_t config = SET_ACCEL_FS_16G; static constexpr float scale = 1.0f / ACCEL_FACTOR_16G; };
+
+template <uint32_t FS> struct MPU6050GyroRange { static constexpr bool supported = false; };
+template <> struct MPU6050GyroRange<250>  { static constexpr bool supported = true; static constexpr uint8_t config = SET_GYRO_FS_250;  static constexpr float scale = 1.0f / GYRO_FACTOR_250; };
+template <> struct MPU6050GyroRange<500>  { static constexpr bool supported = true; static constexpr uint8_t config = SET_GYRO_FS_500;  static constexpr float scale = 1.0f / GYRO_FACTOR_500; };
+template <> struct MPU6050GyroRange<1000> { static constexpr bool supported = true; static constexpr uint8_t config = SET_GYRO_FS_1000; static constexpr float scale = 1.0f / GYRO_FACTOR_1000; };
+template <> struct MPU6050GyroRange<2000> { static constexpr bool supported = true; static constexpr uint8_t config = SET_GYRO_FS_2000; static constexpr float scale = 1.0f / GYRO_FACTOR_2000; };
+
+/**
+ * range independent part of the driver
+ * register access and everything that works on already scaled values
+*/
+class MPU6050Base {
+    protected:
     uint8_t _address;
-    uint32_t _accel_fs_range;
-    uint32_t _gyro_fs_range;
+    uint32_t _sample_period_us;
+    uint32_t _last_filter_time; // timestamp of the last sample given to filterImu
+    bool _filter_started;
+
+    void writeRegister(uint8_t reg, uint8_t value);
+    uint8_t readRegister(uint8_t reg);
+    int16_t readRegister16(uint8_t reg);
+    bool readBurst(imu_sample_t& sample);
+    uint16_t readFifoBurst(imu_sample_t* samples, uint16_t max_samples);
     
     public:
     // sensor data
@@ -67,20 +134,171 @@ class MPU6050 {
     float pitch_angle, roll_angle;
     float acc_x_ms, acc_y_ms, acc_z_ms; // acceleration in m/s^2
 
+    AttitudeEstimator attitude; // gyro integrated, accel corrected orientation
 
-    MPU6050(uint8_t address, uint32_t accel_fs_range, uint32_t gyro_fs_range);
-    void init();
-    float readXAcceleration();
-    float readYAcceleration();
-    float readZAcceleration();
-    float readXAngularVelocity();
-    float readYAngularVelocity();
-    float readZAngularVelocity();
+    MPU6050Base(uint8_t address);
+    static void decodeBurst(const uint8_t* buffer, imu_sample_t& sample);
+    void init(uint8_t accel_config, uint8_t gyro_config);
+    void enableFifo(uint16_t sample_rate_hz);
+    void resetFifo();
+    uint16_t fifoCount();
+    bool fifoOverflowed();
     float readTemperature();
-    void filterImu();
-    float getRoll();
-    float getPitch();
+    void filterImu(const imu_sample_t& sample);
+    float getRoll(const imu_sample_t& sample);
+    float getPitch(const imu_sample_t& sample);
+
+};
+
+/**
+ * MPU6050 with the accelerometer and gyroscope full scale ranges fixed at compile time
+ * ACCEL_FS: 2, 4, 8 or 16 g
+ * GYRO_FS: 250, 500, 1000 or 2000 deg/s
+*/
+template <uint32_t ACCEL_FS, uint32_t GYRO_FS>
+class MPU6050 : public MPU6050Base {
+    static_assert(MPU6050AccelRange<ACCEL_FS>::supported, "MPU6050 accel range must be 2, 4, 8 or 16 g");
+    static_assert(MPU6050GyroRange<GYRO_FS>::supported, "MPU6050 gyro range must be 250, 500, 1000 or 2000 deg/s");
+
+    public:
+    static constexpr float ACCEL_SCALE = MPU6050AccelRange<ACCEL_FS>::scale;
+    static constexpr float GYRO_SCALE = MPU6050GyroRange<GYRO_FS>::scale;
+
+    using MPU6050Base::getRoll;
+    using MPU6050Base::getPitch;
+
+    MPU6050(uint8_t address) : MPU6050Base(address) {}
+
+    // convert the raw counts of a sample to physical units
+    static void scale(imu_sample_t& sample) {
+        sample.ax = sample.raw_ax * ACCEL_SCALE;
+        sample.ay = sample.raw_ay * ACCEL_SCALE;
+        sample.az = sample.raw_az * ACCEL_SCALE;
+        sample.gx = sample.raw_gx * GYRO_SCALE;
+        sample.gy = sample.raw_gy * GYRO_SCALE;
+        sample.gz = sample.raw_gz * GYRO_SCALE;
+        sample.temp = sample.raw_temp * (1.0f / 340.0f) + 36.53f;
+    }
+
+    void init() {
+        MPU6050Base::init(MPU6050AccelRange<ACCEL_FS>::config, MPU6050GyroRange<GYRO_FS>::config);
+    }
+
+    /**
+     * Read accelerometer, temperature and gyroscope in a single I2C transaction
+     * returns false if the sensor did not return the full burst
+    */
+    bool readAll(imu_sample_t& sample) {
+        if(!this->readBurst(sample)) {
+            return false;
+        }
+
+        scale(sample);
+
+        // keep the member copies in step for callers that read them directly
+        this->acc_x_real = sample.ax; this->acc_y_real = sample.ay; this->acc_z_real = sample.az;
+        this->ang_vel_x_real = sample.gx; this->ang_vel_y_real = sample.gy; this->ang_vel_z_real = sample.gz;
+        this->temp_real = sample.temp;
+
+        return true;
+    }
+
+    /**
+     * Drain up to max_samples complete samples from the on-chip FIFO
+     * enableFifo() must have been called first
+     * returns the number of samples written to samples, oldest first
+    */
+    uint16_t readFifo(imu_sample_t* samples, uint16_t max_samples) {
+        uint16_t count = this->readFifoBurst(samples, max_samples);
+
+        for(uint16_t i = 0; i < count; i++) {
+            scale(samples[i]);
+        }
+
+        return count;
+    }
+
+    float readXAcceleration() {
+        this->acc_x = this->readRegister16(ACCEL_XOUT_H);
+        this->acc_x_real = this->acc_x * ACCEL_SCALE;
+        return this->acc_x_real;
+    }
+
+    float readYAcceleration() {
+        this->acc_y = this->readRegister16(ACCEL_YOUT_H);
+        this->acc_y_real = this->acc_y * ACCEL_SCALE;
+        return this->acc_y_real;
+    }
+
+    float readZAcceleration() {
+        this->acc_z = this->readRegister16(ACCEL_ZOUT_H);
+        this->acc_z_real = this->acc_z * ACCEL_SCALE;
+        return this->acc_z_real;
+    }
+
+    float readXAngularVelocity() {
+        this->ang_vel_x = this->readRegister16(GYRO_XOUT_H);
+        this->ang_vel_x_real = this->ang_vel_x * GYRO_SCALE;
+        return this->ang_vel_x_real;
+    }
+
+    float readYAngularVelocity() {
+        this->ang_vel_y = this->readRegister16(GYRO_YOUT_H);
+        this->ang_vel_y_real = this->ang_vel_y * GYRO_SCALE;
+        return this->ang_vel_y_real;
+    }
+
+    float readZAngularVelocity() {
+        this->ang_vel_z = this->readRegister16(GYRO_ZOUT_H);
+        this->ang_vel_z_real = this->ang_vel_z * GYRO_SCALE;
+        return this->ang_vel_z_real;
+    }
+
+    /**
+     * average the gyro over a number of readings with the sensor at rest
+     * and hand the result to the attitude estimator as its bias
+    */
+    void calibrateGyro(uint16_t readings) {
+        imu_sample_t sample;
+        float sum_x = 0, sum_y = 0, sum_z = 0;
+        uint16_t count = 0;
+
+        for(uint16_t i = 0; i < readings; i++) {
+            if(this->readAll(sample)) {
+                sum_x += sample.gx;
+                sum_y += sample.gy;
+                sum_z += sample.gz;
+                count++;
+            }
+        }
+
+        if(count == 0) return;
+
+        this->attitude.setGyroBias(sum_x / count * ATTITUDE_DEG_TO_RAD,
+                                   sum_y / count * ATTITUDE_DEG_TO_RAD,
+                                   sum_z / count * ATTITUDE_DEG_TO_RAD);
+    }
+
+    /**
+     * roll angle in degrees from a fresh burst
+     * the last good angle if the read fails, NAN before the first one
+    */
+    float getRoll() {
+        imu_sample_t sample;
+        if(!this->readAll(sample)) return this->roll_angle * TO_DEG_FACTOR;
+        return this->getRoll(sample);
+    }
+
+    /**
+     * pitch angle in degrees from a fresh burst
+     * the last good angle if the read fails, NAN before the first one
+    */
+    float getPitch() {
+        imu_sample_t sample;
+        if(!this->readAll(sample)) return this->pitch_angle * TO_DEG_FACTOR;
+        return this->getPitch(sample);
+    }
 
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,134 @@
+/**
+ * @file state_machine.cpp
+ * @author Edwin Mwiti 
+ * @brief 
+ * @version 0.1
+ * @date 2023-03-28
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+#include <math.h>
+#include "state_machine.h"
+#include "defs.h"
+
+#define LANDED_CHECKS (LANDED_TIME_MS / FLIGHT_STATE_INTERVAL_MS)
+
+// constructor
+State_machine::State_machine(){
+    this->_state = PRE_FLIGHT;
+    this->_ground_altitude = 0;
+    this->_max_altitude = 0;
+    this->_peak_velocity = 0;
+    this->_fall_checks = 0;
+    this->_still_checks = 0;
+    this->_initialized = false;
+}
+
+// This checks that we have started ascent
+// the height above the ground and the climb rate must both be past the threshold, so neither
+// a barometer gust nor a knock on the pad is taken for a launch
+bool State_machine::liftOff(float height, float velocity){
+    return height > LIFTOFF_ALTITUDE && velocity > LIFTOFF_VELOCITY;
+}
+
+// the motor is out once the climb rate has dropped from its peak - drag and gravity are all that is left
+bool State_machine::burnout(float velocity){
+    if(velocity > this->_peak_velocity) this->_peak_velocity = velocity;
+    return velocity < this->_peak_velocity - BURNOUT_VELOCITY_DROP;
+}
+
+// This checks that we have reached apogee - the climb has stopped
+bool State_machine::apogee(float velocity){
+    return velocity <= 0;
+}
+
+// the fall slows down once the parachute is out - or, opened early, stops speeding up short of
+// PARACHUTE_DESCENT_RATE where a free fall keeps gaining ~g
+bool State_machine::parachuteOpen(float velocity){
+    if(velocity < this->_peak_velocity) this->_peak_velocity = velocity;
+    if(velocity > this->_peak_velocity + PARACHUTE_VELOCITY_RISE) return true;
+
+    uint32_t slot = this->_fall_checks % PARACHUTE_WINDOW_CHECKS;
+    float before = this->_fall[slot];
+    this->_fall[slot] = velocity;
+    this->_fall_checks++;
+    if(this->_fall_checks <= PARACHUTE_WINDOW_CHECKS) return false;
+
+    bool falling = velocity < -LANDED_VELOCITY && velocity > -PARACHUTE_DESCENT_RATE;
+    return falling && before - velocity < PARACHUTE_SPEED_UP;
+}
+
+// This checks that we have reached the ground
+// near the ground altitude and still for LANDED_TIME_MS
+bool State_machine::landed(float height, float velocity){
+    if(height < LANDED_ALTITUDE && fabsf(velocity) < LANDED_VELOCITY) this->_still_checks++;
+    else this->_still_checks = 0;
+
+    return this->_still_checks >= LANDED_CHECKS;
+}
+
+int32_t State_machine::checkState(float altitude, float velocity){
+    if(!this->_initialized){
+        this->_ground_altitude = altitude;
+        this->_max_altitude = altitude;
+        this->_initialized = true;
+    }
+    if(altitude > this->_max_altitude) this->_max_altitude = altitude;
+
+    float height = altitude - this->_ground_altitude;
+    switch(this->_state){
+        case PRE_FLIGHT:
+            if(this->liftOff(height, velocity)){
+                this->_state = POWERED_FLIGHT;
+                this->_peak_velocity = velocity;
+            } else {
+                // the pad altitude drifts with the weather until launch
+                this->_ground_altitude += GROUND_ALTITUDE_FILTER * (altitude - this->_ground_altitude);
+                this->_max_altitude = altitude;
+            }
+            break;
+
+        case POWERED_FLIGHT:
+            if(this->apogee(velocity)) this->_state = APOGEE;
+            else if(this->burnout(velocity)) this->_state = COASTING;
+            break;
+
+        case COASTING:
+            if(this->apogee(velocity)) this->_state = APOGEE;
+            break;
+
+        case APOGEE:
+            this->_state = BALLISTIC_DESCENT;
+            this->_peak_velocity = velocity;
+            this->_fall_checks = 0;
+            break;
+
+        case BALLISTIC_DESCENT:
+            if(this->landed(height, velocity)) this->_state = POST_FLIGHT;
+            // hitting the ground slows the fall as well
+            else if(height > LANDED_ALTITUDE && this->parachuteOpen(velocity)) this->_state = PARACHUTE_DESCENT;
+            break;
+
+        case PARACHUTE_DESCENT:
+            if(this->landed(height, velocity)) this->_state = POST_FLIGHT;
+            break;
+
+        default:
+            break;
+    }
+
+    return this->_state;
+}
+
+int32_t State_machine::getState(){
+    return this->_state;
+}
+
+float State_machine::getGroundAltitude(){
+    return this->_ground_altitude;
+}
+
+float State_machine::getMaxAltitude(){
+    return this->_max_altitude;
+}
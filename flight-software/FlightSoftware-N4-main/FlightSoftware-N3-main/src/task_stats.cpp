@@ -0,0 +1,136 @@
+#include <Arduino.h>
+#include "task_stats.h"
+
+static TaskStats slots[TASK_STATS_MAX_TASKS];
+static std::atomic<bool> slot_ready[TASK_STATS_MAX_TASKS];
+static std::atomic<uint32_t> slots_taken(0);
+static TaskStats overflow_slot; // every task past the table shares this one, it is not reported
+
+static uint16_t saturate16(uint32_t value) {
+    return value > 0xFFFF ? 0xFFFF : (uint16_t) value;
+}
+
+// names are cut to LOG_TASK_NAME_LENGTH and only terminated when shorter
+static void copyName(char* out, const char* name) {
+    size_t length = strnlen(name, LOG_TASK_NAME_LENGTH);
+    memset(out, 0, LOG_TASK_NAME_LENGTH);
+    memcpy(out, name, length);
+}
+
+// constructor
+TaskStats::TaskStats() : _loops(0), _busy(0), _max_period(0) {
+    this->_handle = NULL;
+    memset(this->_name, 0, sizeof(this->_name));
+    this->_core = 0;
+    this->_wake = 0;
+    this->_started = false;
+    for(int i = 0; i < LOG_TASK_BUCKETS; i++) {
+        this->_histogram[i].store(0, std::memory_order_relaxed);
+        this->_reported_histogram[i] = 0;
+    }
+    this->_reported_loops = 0;
+    this->_reported_busy = 0;
+    this->_reported_time = 0;
+}
+
+void TaskStats::attach(void* handle, const char* name, uint8_t core, uint32_t now) {
+    this->_handle = handle;
+    copyName(this->_name, name);
+    this->_core = core;
+    this->_reported_time = now;
+}
+
+/**
+ * the task woke up - file the period since the last wake-up
+*/
+void TaskStats::begin() {
+    uint32_t now = micros();
+
+    if(this->_started) {
+        uint32_t period = now - this->_wake;
+        uint32_t scaled = period >> LOG_TASK_BUCKET_SHIFT;
+        uint32_t bucket = scaled == 0 ? 0 : 32 - __builtin_clz(scaled);
+        if(bucket >= LOG_TASK_BUCKETS) bucket = LOG_TASK_BUCKETS - 1;
+
+        this->_histogram[bucket].store(this->_histogram[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        // the reporter clears the maximum, so this one has to be a compare and swap
+        uint32_t max_period = this->_max_period.load(std::memory_order_relaxed);
+        while(period > max_period && !this->_max_period.compare_exchange_weak(max_period, period, std::memory_order_relaxed));
+    }
+
+    this->_wake = now;
+    this->_started = true;
+    this->_loops.store(this->_loops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/**
+ * the work of this wake-up is done
+*/
+void TaskStats::end() {
+    uint32_t busy = micros() - this->_wake;
+    this->_busy.store(this->_busy.load(std::memory_order_relaxed) + busy, std::memory_order_relaxed);
+}
+
+/**
+ * the counters since the last report into record
+ * reporter side only
+*/
+void TaskStats::report(uint32_t now, log_task_t& record) {
+    uint32_t loops = this->_loops.load(std::memory_order_relaxed);
+    uint32_t busy = this->_busy.load(std::memory_order_relaxed);
+    uint32_t interval = now - this->_reported_time;
+
+    record.timestamp = now;
+    memcpy(record.name, this->_name, sizeof(record.name));
+    record.core = this->_core;
+    record.stack_free = saturate16(uxTaskGetStackHighWaterMark((TaskHandle_t) this->_handle));
+    record.cpu = interval > 0 ? saturate16((uint32_t) ((uint64_t) (busy - this->_reported_busy) * 1000 / interval)) : 0;
+    record.loops = saturate16(loops - this->_reported_loops);
+    record.max_period = this->_max_period.exchange(0, std::memory_order_relaxed);
+
+    for(int i = 0; i < LOG_TASK_BUCKETS; i++) {
+        uint32_t count = this->_histogram[i].load(std::memory_order_relaxed);
+        record.histogram[i] = saturate16(count - this->_reported_histogram[i]);
+        this->_reported_histogram[i] = count;
+    }
+
+    this->_reported_loops = loops;
+    this->_reported_busy = busy;
+    this->_reported_time = now;
+}
+
+TaskStats* taskStatsRegister() {
+    uint32_t slot = slots_taken.fetch_add(1);
+    if(slot >= TASK_STATS_MAX_TASKS) return &overflow_slot;
+
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+    slots[slot].attach(handle, pcTaskGetName(handle), xPortGetCoreID(), micros());
+    slot_ready[slot].store(true, std::memory_order_release);
+
+    return &slots[slot];
+}
+
+uint32_t taskStatsReport(log_task_t* records, uint32_t max_records) {
+    uint32_t now = micros();
+    uint32_t count = 0;
+
+    for(uint32_t slot = 0; slot < TASK_STATS_MAX_TASKS && count < max_records; slot++) {
+        if(!slot_ready[slot].load(std::memory_order_acquire)) continue;
+        slots[slot].report(now, records[count++]);
+    }
+
+    return count;
+}
+
+log_channel_t taskStatsChannel(uint32_t timestamp, const char* name, uint32_t capacity, uint32_t high_water, uint32_t drops) {
+    log_channel_t record;
+
+    record.timestamp = timestamp;
+    copyName(record.name, name);
+    record.capacity = saturate16(capacity);
+    record.high_water = saturate16(high_water);
+    record.drops = drops;
+
+    return record;
+}
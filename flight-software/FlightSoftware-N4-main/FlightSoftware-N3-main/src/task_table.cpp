@@ -0,0 +1,32 @@
+#include <Arduino.h>
+#include "defs.h"
+#include "task_table.h"
+
+uint32_t startTasks(const task_config_t* table, uint32_t count) {
+    uint32_t started = 0;
+
+    for(uint32_t i = 0; i < count; i++) {
+        const task_config_t& task = table[i];
+
+        BaseType_t th = xTaskCreatePinnedToCore(
+            task.function,
+            task.name,
+            task.stack,
+            (void*) &task,
+            task.priority,
+            NULL,
+            task.core
+        );
+
+        if(th == pdPASS) {
+            debug("[+]"); debug(task.name); debug(" task created on core ");
+            if(task.core == tskNO_AFFINITY) debugln("any");
+            else debugln((int) task.core);
+            started++;
+        } else {
+            debug("[-]"); debug(task.name); debugln(" task creation failed!");
+        }
+    }
+
+    return started;
+}
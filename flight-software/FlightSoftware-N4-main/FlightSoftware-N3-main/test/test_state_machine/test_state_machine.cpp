@@ -0,0 +1,243 @@
+/**
+ * State_machine transitions on the host - pio test -e test_native
+ *
+ * every test flies the state machine through an ideal altitude and velocity estimate, stepped every
+ * FLIGHT_STATE_INTERVAL_MS as flight_state_check does
+*/
+#include <unity.h>
+#include <math.h>
+#include "defs.h"
+#include "state_machine.h"
+
+#define PAD_ALTITUDE    1525.0f
+#define DT              (FLIGHT_STATE_INTERVAL_MS * 1e-3f)
+#define LANDED_CHECKS   (LANDED_TIME_MS / FLIGHT_STATE_INTERVAL_MS)
+#define ONE_G           9.80665f
+
+static State_machine fsm;
+static float altitude, velocity;
+static int32_t state;
+
+void setUp(void) {
+    fsm = State_machine();
+    altitude = PAD_ALTITUDE;
+    velocity = 0;
+    state = fsm.checkState(altitude, velocity);
+}
+
+void tearDown(void) {}
+
+// one check period under a vertical acceleration, stopped by the pad
+static int32_t step(float accel) {
+    velocity += accel * DT;
+    altitude += velocity * DT;
+    if(altitude < PAD_ALTITUDE) {
+        altitude = PAD_ALTITUDE;
+        velocity = 0;
+    }
+    state = fsm.checkState(altitude, velocity);
+    return state;
+}
+
+// steps under accel until the state machine leaves from, at most max_checks - returns the checks taken
+static uint32_t stepUntilLeaves(int32_t from, float accel, uint32_t max_checks) {
+    uint32_t checks = 0;
+    while(state == from && checks < max_checks) {
+        step(accel);
+        checks++;
+    }
+    return checks;
+}
+
+// vertical acceleration under a parachute with the given descent rate
+static float chute(float descent_rate) {
+    return -ONE_G + ONE_G * velocity * velocity / (descent_rate * descent_rate);
+}
+
+// under a parachute until the state machine leaves from, at most max_checks - returns the checks taken
+static uint32_t descendUntilLeaves(int32_t from, float descent_rate, uint32_t max_checks) {
+    uint32_t checks = 0;
+    while(state == from && checks < max_checks) {
+        step(chute(descent_rate));
+        checks++;
+    }
+    return checks;
+}
+
+// boost at 50 m/s^2 for 2 s and coast up to apogee
+static void flyToApogee(void) {
+    for(int i = 0; i < 2000 / FLIGHT_STATE_INTERVAL_MS; i++) step(50.0f - ONE_G);
+    TEST_ASSERT_EQUAL(POWERED_FLIGHT, state);
+    stepUntilLeaves(POWERED_FLIGHT, -ONE_G, 1000);
+    TEST_ASSERT_EQUAL(COASTING, state);
+    stepUntilLeaves(COASTING, -ONE_G, 10000);
+    TEST_ASSERT_EQUAL(APOGEE, state);
+}
+
+void test_pre_flight_stays_on_the_pad(void) {
+    // the barometer wanders a metre and the estimate a little - and the weather moves the pad
+    for(int i = 0; i < 3000; i++) {
+        float noise = sinf(i * 0.7f);
+        altitude = PAD_ALTITUDE + 0.01f * i / 100.0f + noise;
+        velocity = 1.5f * noise;
+        TEST_ASSERT_EQUAL(PRE_FLIGHT, fsm.checkState(altitude, velocity));
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1.5f, PAD_ALTITUDE + 0.3f, fsm.getGroundAltitude());
+
+    // a knock on the pad is fast but goes nowhere
+    TEST_ASSERT_EQUAL(PRE_FLIGHT, fsm.checkState(PAD_ALTITUDE + 0.5f, 20.0f));
+}
+
+void test_pre_flight_to_powered_flight(void) {
+    uint32_t checks = stepUntilLeaves(PRE_FLIGHT, 50.0f - ONE_G, 1000);
+    TEST_ASSERT_EQUAL(POWERED_FLIGHT, state);
+    TEST_ASSERT_TRUE(altitude - PAD_ALTITUDE > LIFTOFF_ALTITUDE);
+    TEST_ASSERT_TRUE(velocity > LIFTOFF_VELOCITY);
+    // a 50 m/s^2 boost is past both thresholds in about 0.3 s
+    TEST_ASSERT_LESS_OR_EQUAL(400 / FLIGHT_STATE_INTERVAL_MS, checks);
+}
+
+void test_powered_flight_to_coasting(void) {
+    stepUntilLeaves(PRE_FLIGHT, 50.0f - ONE_G, 1000);
+    TEST_ASSERT_EQUAL(POWERED_FLIGHT, step(50.0f - ONE_G));
+
+    // the motor is out - gravity and drag take BURNOUT_VELOCITY_DROP off the peak climb rate
+    uint32_t checks = stepUntilLeaves(POWERED_FLIGHT, -ONE_G - 5.0f, 1000);
+    TEST_ASSERT_EQUAL(COASTING, state);
+    TEST_ASSERT_LESS_OR_EQUAL((uint32_t) ceilf(BURNOUT_VELOCITY_DROP / ((ONE_G + 5.0f) * DT)) + 1, checks);
+}
+
+void test_powered_flight_to_apogee(void) {
+    // a short burn can end at apogee before the drop from the peak is seen
+    stepUntilLeaves(PRE_FLIGHT, 50.0f - ONE_G, 1000);
+    TEST_ASSERT_EQUAL(APOGEE, fsm.checkState(altitude, -0.1f));
+}
+
+void test_coasting_to_apogee_once(void) {
+    flyToApogee();
+    TEST_ASSERT_TRUE(velocity <= 0);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, altitude, fsm.getMaxAltitude());
+
+    // returned once, on the estimate the climb ended at
+    TEST_ASSERT_EQUAL(BALLISTIC_DESCENT, step(-ONE_G));
+}
+
+void test_ballistic_free_fall_is_no_parachute(void) {
+    flyToApogee();
+
+    // a fall gaining g all the way down is never taken for a parachute
+    uint32_t checks = 0;
+    while(altitude - PAD_ALTITUDE > LANDED_ALTITUDE && checks < 100000) {
+        TEST_ASSERT_EQUAL_MESSAGE(BALLISTIC_DESCENT, step(-ONE_G), "free fall taken for a parachute");
+        checks++;
+    }
+}
+
+void test_ballistic_to_parachute_on_slowdown(void) {
+    flyToApogee();
+    for(int i = 0; i < 4000 / FLIGHT_STATE_INTERVAL_MS; i++) step(-ONE_G);
+    TEST_ASSERT_EQUAL(BALLISTIC_DESCENT, state);
+
+    // the canopy fills at 40 m/s and pulls the fall back towards 20 m/s
+    uint32_t checks = stepUntilLeaves(BALLISTIC_DESCENT, 3 * ONE_G, 1000);
+    TEST_ASSERT_EQUAL(PARACHUTE_DESCENT, state);
+    TEST_ASSERT_LESS_OR_EQUAL((uint32_t) ceilf(PARACHUTE_VELOCITY_RISE / (3 * ONE_G * DT)) + 1, checks);
+}
+
+void test_ballistic_to_parachute_at_apogee(void) {
+    flyToApogee();
+
+    // opened at apogee the fall never outruns the parachute - it only levels off at the descent rate
+    uint32_t checks = descendUntilLeaves(APOGEE, 15.0f, 1);
+    checks += descendUntilLeaves(BALLISTIC_DESCENT, 15.0f, 10000);
+    TEST_ASSERT_EQUAL(PARACHUTE_DESCENT, state);
+    TEST_ASSERT_TRUE(altitude - PAD_ALTITUDE > LANDED_ALTITUDE);
+    TEST_ASSERT_LESS_OR_EQUAL(5000 / FLIGHT_STATE_INTERVAL_MS, checks);
+}
+
+void test_parachute_to_post_flight(void) {
+    flyToApogee();
+    descendUntilLeaves(APOGEE, 20.0f, 1);
+    descendUntilLeaves(BALLISTIC_DESCENT, 20.0f, 10000);
+    TEST_ASSERT_EQUAL(PARACHUTE_DESCENT, state);
+
+    // nothing but the ground ends it
+    while(altitude > PAD_ALTITUDE) {
+        TEST_ASSERT_EQUAL_MESSAGE(PARACHUTE_DESCENT, step(chute(20.0f)), "landed in the air");
+    }
+
+    // on the pad and still since the touchdown check - landed LANDED_TIME_MS after it, not later
+    uint32_t checks = stepUntilLeaves(PARACHUTE_DESCENT, 0, 100000);
+    TEST_ASSERT_EQUAL(POST_FLIGHT, state);
+    TEST_ASSERT_EQUAL(LANDED_CHECKS - 1, checks);
+}
+
+void test_ballistic_to_post_flight(void) {
+    // no parachute - the ground stops the fall
+    flyToApogee();
+    while(altitude > PAD_ALTITUDE) step(-ONE_G);
+    TEST_ASSERT_EQUAL(BALLISTIC_DESCENT, state);
+
+    uint32_t checks = stepUntilLeaves(BALLISTIC_DESCENT, 0, 100000);
+    TEST_ASSERT_EQUAL(POST_FLIGHT, state);
+    TEST_ASSERT_EQUAL(LANDED_CHECKS - 1, checks);
+}
+
+void test_late_landing_waits_for_the_estimate(void) {
+    flyToApogee();
+    descendUntilLeaves(APOGEE, 20.0f, 1);
+    descendUntilLeaves(BALLISTIC_DESCENT, 20.0f, 10000);
+    while(altitude - PAD_ALTITUDE > 1.0f) step(chute(20.0f));
+    TEST_ASSERT_EQUAL(PARACHUTE_DESCENT, state);
+
+    // the filter velocity lags the impact, decaying from the descent rate - no landing while it moves
+    float estimate = -20.0f;
+    uint32_t checks = 0;
+    while(fabsf(estimate) >= LANDED_VELOCITY) {
+        TEST_ASSERT_EQUAL(PARACHUTE_DESCENT, fsm.checkState(PAD_ALTITUDE, estimate));
+        estimate *= 0.9f;
+        checks++;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(100, checks);
+
+    // and landed LANDED_TIME_MS after it settles
+    for(checks = 1; fsm.checkState(PAD_ALTITUDE, estimate) == PARACHUTE_DESCENT && checks < 100000; checks++) {
+        estimate *= 0.9f;
+    }
+    TEST_ASSERT_EQUAL(POST_FLIGHT, fsm.getState());
+    TEST_ASSERT_EQUAL(LANDED_CHECKS, checks);
+
+    // a bounce restarts the wait
+    setUp();
+    flyToApogee();
+    while(altitude - PAD_ALTITUDE > 5.0f) step(-ONE_G);
+    for(uint32_t i = 0; i < LANDED_CHECKS - 1; i++) fsm.checkState(PAD_ALTITUDE, 0);
+    TEST_ASSERT_EQUAL(BALLISTIC_DESCENT, fsm.checkState(PAD_ALTITUDE + 1.0f, 5.0f));
+    for(uint32_t i = 0; i < LANDED_CHECKS - 1; i++) TEST_ASSERT_EQUAL(BALLISTIC_DESCENT, fsm.checkState(PAD_ALTITUDE, 0));
+    TEST_ASSERT_EQUAL(POST_FLIGHT, fsm.checkState(PAD_ALTITUDE, 0));
+}
+
+void test_states_never_go_back(void) {
+    flyToApogee();
+    while(state != POST_FLIGHT) step(state == BALLISTIC_DESCENT && altitude > PAD_ALTITUDE ? -ONE_G : 0);
+
+    // carried off the field after landing
+    for(int i = 0; i < 500; i++) TEST_ASSERT_EQUAL(POST_FLIGHT, step(i < 100 ? 20.0f : -20.0f));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_pre_flight_stays_on_the_pad);
+    RUN_TEST(test_pre_flight_to_powered_flight);
+    RUN_TEST(test_powered_flight_to_coasting);
+    RUN_TEST(test_powered_flight_to_apogee);
+    RUN_TEST(test_coasting_to_apogee_once);
+    RUN_TEST(test_ballistic_free_fall_is_no_parachute);
+    RUN_TEST(test_ballistic_to_parachute_on_slowdown);
+    RUN_TEST(test_ballistic_to_parachute_at_apogee);
+    RUN_TEST(test_parachute_to_post_flight);
+    RUN_TEST(test_ballistic_to_post_flight);
+    RUN_TEST(test_late_landing_waits_for_the_estimate);
+    RUN_TEST(test_states_never_go_back);
+    return UNITY_END();
+}
@@ -0,0 +1,448 @@
+/**
+ * Host receiver - downloads the flight log from the board over serial
+ *
+ * resets the board through the USB UART's RTS line, asks for download mode during its boot window,
+ * switches both ends to the download rate and writes the flash to a binary file chunk by chunk.
+ * every chunk carries its offset and a crc; a bad or missing chunk is asked for again from the first
+ * byte still missing, and --resume continues a file left by an interrupted run.
+ * when the download is complete the file is walked record by record as a check, and the boots and
+ * flight state transitions found are printed, with the worst task, core, queue and sample latency
+ * statistics of every boot
+ *
+ * linux / macOS
+ * pio run -e flash_dump && .pio/build/flash_dump/program /dev/ttyUSB0 flight.bin [--baud 921600]
+ *     [--all] [--resume] [--clear] [--no-reset]
+ *   --all       the whole flash instead of up to the end of the log
+ *   --resume    keep the bytes already in the file and download the rest
+ *   --clear     erase the flash after a complete download
+ *   --no-reset  do not pulse RTS - reset the board by hand within a second
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <vector>
+#include "flash_dump.h"
+#include "flash_logger.h"
+#include "latency.h"
+
+#define HELLO_ATTEMPTS      40      // HELLO every 25 ms for a second after reset
+#define HELLO_INTERVAL_MS   25
+#define CHUNK_TIMEOUT_MS    500     // no chunk for this long - ask again from the first missing byte
+#define MAX_RETRIES         20      // in a row without progress
+#define STALE_CHUNKS        4       // chunks the board may have had on the way when it was asked again
+#define CORE_COUNT          2
+
+static const char* state_names[FLASH_LOG_STATE_COUNT] = {
+    "PRE_FLIGHT", "POWERED_FLIGHT", "COASTING", "APOGEE", "BALLISTIC_DESCENT", "PARACHUTE_DESCENT", "POST_FLIGHT"
+};
+
+static const char* stage_names[LATENCY_STAGE_COUNT] = {"filter", "fsm", "logger", "downlink"};
+
+static speed_t baudConstant(uint32_t baud) {
+    switch(baud) {
+        case 115200:    return B115200;
+        case 230400:    return B230400;
+#ifdef B460800
+        case 460800:    return B460800;
+#endif
+#ifdef B921600
+        case 921600:    return B921600;
+#endif
+#ifdef B1000000
+        case 1000000:   return B1000000;
+#endif
+#ifdef B1500000
+        case 1500000:   return B1500000;
+#endif
+#ifdef B2000000
+        case 2000000:   return B2000000;
+#endif
+        default:        return 0;
+    }
+}
+
+static bool setBaud(int fd, uint32_t baud) {
+    struct termios tty;
+    speed_t speed = baudConstant(baud);
+    if(speed == 0 || tcgetattr(fd, &tty) != 0) return false;
+
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    cfsetispeed(&tty, speed);
+    cfsetospeed(&tty, speed);
+
+    return tcsetattr(fd, TCSANOW, &tty) == 0;
+}
+
+/**
+ * pulse EN low through RTS with IO0 (DTR) released - the same lines the uploader uses
+*/
+static void resetBoard(int fd) {
+    int dtr = TIOCM_DTR, rts = TIOCM_RTS;
+    ioctl(fd, TIOCMBIC, &dtr);
+    ioctl(fd, TIOCMBIS, &rts);
+    usleep(100000);
+    ioctl(fd, TIOCMBIC, &rts);
+}
+
+static void sendFrame(int fd, uint8_t type, const void* payload, uint16_t length) {
+    uint8_t frame[64];
+    size_t n = flashDumpFrame(frame, type, payload, length);
+    if(write(fd, frame, n) != (ssize_t) n) perror("write");
+}
+
+/**
+ * feed received bytes to the parser until it has a frame of one of the wanted types
+ * returns false on timeout
+*/
+static bool receive(int fd, FlashDumpParser& parser, uint8_t want, uint8_t want_also, int timeout_ms) {
+    static uint8_t bytes[8192];
+    static size_t have = 0, used = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    while(true) {
+        while(used < have) {
+            if(parser.feed(bytes[used++]) && (parser.type() == want || parser.type() == want_also)) return true;
+        }
+
+        int left = (int) std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if(left <= 0) return false;
+
+        struct pollfd p = {fd, POLLIN, 0};
+        if(poll(&p, 1, left) <= 0) return false;
+
+        ssize_t n = read(fd, bytes, sizeof(bytes));
+        if(n <= 0) return false;
+        have = n;
+        used = 0;
+    }
+}
+
+static void drain(int fd) {
+    uint8_t bytes[4096];
+    usleep(50000);
+    while(read(fd, bytes, sizeof(bytes)) > 0) {}
+}
+
+/**
+ * worst case of one task, channel or pipeline stage over a boot
+*/
+struct Worst {
+    char name[LOG_TASK_NAME_LENGTH + 1];
+    uint8_t type;                           // the record type it comes from
+    uint32_t core, stack_free, cpu, max_period; // task
+    uint32_t capacity, high_water, drops;   // channel
+    uint32_t samples, age_p99, age_max, hop_p99, hop_max; // latency, us
+};
+
+static Worst& worstOf(std::vector<Worst>& worst, const char* name, uint8_t type) {
+    for(Worst& w : worst) {
+        if(w.type == type && strncmp(w.name, name, LOG_TASK_NAME_LENGTH) == 0) return w;
+    }
+
+    Worst w;
+    memset(&w, 0, sizeof(w));
+    strncat(w.name, name, LOG_TASK_NAME_LENGTH);
+    w.type = type;
+    w.stack_free = UINT32_MAX;
+    worst.push_back(w);
+    return worst.back();
+}
+
+/**
+ * busy share of each core - summed over the task records of one report, the busiest report of a boot kept
+*/
+struct CoreLoad {
+    uint32_t report;                // timestamp of the report being summed
+    uint32_t sum[CORE_COUNT];
+    uint32_t busiest[CORE_COUNT];
+};
+
+static void foldCoreLoad(CoreLoad& load) {
+    for(int core = 0; core < CORE_COUNT; core++) {
+        if(load.sum[core] > load.busiest[core]) load.busiest[core] = load.sum[core];
+        load.sum[core] = 0;
+    }
+}
+
+static void printWorst(std::vector<Worst>& worst, CoreLoad& load) {
+    for(const Worst& w : worst) {
+        if(w.type == LOG_RECORD_TASK) {
+            printf("  task %-9s core %u, stack free %5u B, cpu %5.1f %%, longest period %u us\n",
+                   w.name, (unsigned) w.core, (unsigned) w.stack_free, w.cpu / 10.0, (unsigned) w.max_period);
+        }
+    }
+
+    foldCoreLoad(load);
+    for(int core = 0; core < CORE_COUNT; core++) {
+        if(load.busiest[core] > 0) printf("  core %d    busiest report %5.1f %%\n", core, load.busiest[core] / 10.0);
+    }
+    memset(&load, 0, sizeof(load));
+
+    for(const Worst& w : worst) {
+        if(w.type == LOG_RECORD_CHANNEL) {
+            printf("  chan %-9s high water %u / %u, %u dropped\n",
+                   w.name, (unsigned) w.high_water, (unsigned) w.capacity, (unsigned) w.drops);
+        }
+    }
+    for(const Worst& w : worst) {
+        if(w.type == LOG_RECORD_LATENCY) {
+            printf("  age  %-9s %u samples, worst p99 %u us, max %u us - from the stage before p99 %u us, max %u us\n",
+                   w.name, (unsigned) w.samples, (unsigned) w.age_p99, (unsigned) w.age_max,
+                   (unsigned) w.hop_p99, (unsigned) w.hop_max);
+        }
+    }
+    worst.clear();
+}
+
+/**
+ * walk the downloaded log like a post-flight tool would
+ * returns false if a record type is unknown - the file or the log is damaged
+*/
+static bool verifyLog(const std::vector<uint8_t>& log, uint32_t length) {
+    uint32_t address = 0, records = 0, boots = 0, indexes = 0;
+    std::vector<Worst> worst;
+    CoreLoad load;
+    memset(&load, 0, sizeof(load));
+
+    while(address < length) {
+        if(log[address] == LOG_RECORD_ERASED) {
+            uint32_t run = 0;
+            while(address + run < length && log[address + run] == LOG_RECORD_ERASED) run++;
+            // erased flash - the end of the log. The download runs a record past the last byte written,
+            // so the log can end in a shorter run as well
+            if(run > LOG_RECORD_MAX_LENGTH || address + run == length) break;
+            address += run;                         // the gap between two boots
+            continue;
+        }
+
+        uint32_t record_length = logRecordLength(log[address]);
+        if(record_length == 0 || address + record_length > length) {
+            fprintf(stderr, "unknown record 0x%02x at 0x%06x\n", log[address], (unsigned) address);
+            return false;
+        }
+
+        if(log[address] == LOG_RECORD_HEADER) {
+            printWorst(worst, load);
+
+            log_header_t header;
+            memcpy(&header, &log[address + 1], sizeof(header));
+            printf("boot %u at 0x%06x\n", (unsigned) boots, (unsigned) address);
+            for(int state = 0; state < FLASH_LOG_STATE_COUNT; state++) {
+                if(header.transitions[state] != FLASH_LOG_NO_ADDRESS) {
+                    printf("  %-18s 0x%06x\n", state_names[state], (unsigned) header.transitions[state]);
+                }
+            }
+            boots++;
+        } else if(log[address] == LOG_RECORD_INDEX) {
+            if(!logIsIndexAt(&log[address], record_length, address)) {
+                fprintf(stderr, "index record at 0x%06x does not name its address\n", (unsigned) address);
+                return false;
+            }
+            indexes++;
+        } else if(log[address] == LOG_RECORD_TASK) {
+            log_task_t task;
+            memcpy(&task, &log[address + 1], sizeof(task));
+            Worst& w = worstOf(worst, task.name, LOG_RECORD_TASK);
+            if(task.stack_free < w.stack_free) w.stack_free = task.stack_free;
+            if(task.cpu > w.cpu) w.cpu = task.cpu;
+            if(task.max_period > w.max_period) w.max_period = task.max_period;
+            w.core = task.core;
+
+            // the records of one report share its timestamp
+            if(task.timestamp != load.report) {
+                foldCoreLoad(load);
+                load.report = task.timestamp;
+            }
+            if(task.core < CORE_COUNT) load.sum[task.core] += task.cpu;
+            records++;
+        } else if(log[address] == LOG_RECORD_CHANNEL) {
+            log_channel_t channel;
+            memcpy(&channel, &log[address + 1], sizeof(channel));
+            Worst& w = worstOf(worst, channel.name, LOG_RECORD_CHANNEL);
+            w.capacity = channel.capacity;
+            if(channel.high_water > w.high_water) w.high_water = channel.high_water;
+            w.drops = channel.drops;        // the drop counters only grow within a boot
+            records++;
+        } else if(log[address] == LOG_RECORD_LATENCY) {
+            log_latency_t latency;
+            memcpy(&latency, &log[address + 1], sizeof(latency));
+            if(latency.stage < LATENCY_STAGE_COUNT) {
+                // percentiles of different intervals do not add up - the worst interval is kept
+                Worst& w = worstOf(worst, stage_names[latency.stage], LOG_RECORD_LATENCY);
+                w.samples += latency.samples;
+                if(latency.age[2] > w.age_p99) w.age_p99 = latency.age[2];
+                if(latency.age[3] > w.age_max) w.age_max = latency.age[3];
+                if(latency.hop[2] > w.hop_p99) w.hop_p99 = latency.hop[2];
+                if(latency.hop[3] > w.hop_max) w.hop_max = latency.hop[3];
+            }
+            records++;
+        } else {
+            records++;
+        }
+
+        address += record_length;
+    }
+
+    printWorst(worst, load);
+    printf("%u boots, %u records, %u index records, log ends at 0x%06x\n",
+           (unsigned) boots, (unsigned) records, (unsigned) indexes, (unsigned) address);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        fprintf(stderr, "usage: %s <port> <file> [--baud N] [--all] [--resume] [--clear] [--no-reset]\n", argv[0]);
+        return 1;
+    }
+
+    const char* port = argv[1];
+    const char* path = argv[2];
+    uint32_t baud = FLASH_DUMP_BAUD;
+    bool all = false, resume = false, clear = false, reset = true;
+    for(int i = 3; i < argc; i++) {
+        if(strcmp(argv[i], "--baud") == 0 && i + 1 < argc) baud = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--all") == 0) all = true;
+        else if(strcmp(argv[i], "--resume") == 0) resume = true;
+        else if(strcmp(argv[i], "--clear") == 0) clear = true;
+        else if(strcmp(argv[i], "--no-reset") == 0) reset = false;
+    }
+    if(baudConstant(baud) == 0) {
+        fprintf(stderr, "baud %u is not supported here\n", (unsigned) baud);
+        return 1;
+    }
+
+    int fd = open(port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if(fd < 0 || !setBaud(fd, FLASH_DUMP_START_BAUD)) {
+        fprintf(stderr, "cannot open %s: %s\n", port, strerror(errno));
+        return 1;
+    }
+
+    // download mode is only offered in the boot window, so reset and keep asking
+    static uint8_t frame[FLASH_DUMP_HEADER_LENGTH + FLASH_DUMP_MAX_PAYLOAD + FLASH_DUMP_CRC_LENGTH];
+    FlashDumpParser parser(frame, sizeof(frame));
+    if(reset) resetBoard(fd);
+
+    bool found = false;
+    for(int i = 0; i < HELLO_ATTEMPTS && !found; i++) {
+        sendFrame(fd, FLASH_DUMP_HELLO, &baud, sizeof(baud));
+        found = receive(fd, parser, FLASH_DUMP_INFO, FLASH_DUMP_INFO, HELLO_INTERVAL_MS);
+    }
+    if(!found || parser.length() != sizeof(flash_dump_info_t)) {
+        fprintf(stderr, "no answer from the board\n");
+        return 1;
+    }
+
+    flash_dump_info_t info;
+    memcpy(&info, parser.payload(), sizeof(info));
+    if(info.version != FLASH_DUMP_VERSION) {
+        fprintf(stderr, "board speaks download protocol %u, this receiver %u\n", info.version, FLASH_DUMP_VERSION);
+        return 1;
+    }
+    usleep(20000);
+    setBaud(fd, info.baud);
+    drain(fd);
+
+    uint32_t end = all ? info.capacity : info.log_end;
+    printf("flash %u bytes, log %u bytes, downloading %u bytes at %u baud\n",
+           (unsigned) info.capacity, (unsigned) info.log_end, (unsigned) end, (unsigned) info.baud);
+
+    // resume from the last whole chunk already in the file
+    std::vector<uint8_t> log(end, LOG_RECORD_ERASED);
+    uint32_t offset = 0;
+    FILE* out = NULL;
+    if(resume) {
+        out = fopen(path, "r+b");
+        if(out != NULL) {
+            offset = fread(log.data(), 1, end, out);
+            offset -= offset % info.chunk_size;
+            printf("resuming at %u\n", (unsigned) offset);
+        }
+    }
+    if(out == NULL) out = fopen(path, "w+b");
+    if(out == NULL) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint32_t stream[2] = {offset, end};
+    uint32_t retries = 0, resent = 0, stale = 0;
+    sendFrame(fd, FLASH_DUMP_STREAM, stream, sizeof(stream));
+
+    while(offset < end) {
+        if(!receive(fd, parser, FLASH_DUMP_CHUNK, FLASH_DUMP_CHUNK, CHUNK_TIMEOUT_MS) ||
+           parser.length() < sizeof(uint32_t)) {
+            if(++retries > MAX_RETRIES) {
+                fprintf(stderr, "\ngave up at %u - run again with --resume\n", (unsigned) offset);
+                fclose(out);
+                return 1;
+            }
+            drain(fd);
+            parser.reset();
+            stream[0] = offset;
+            sendFrame(fd, FLASH_DUMP_STREAM, stream, sizeof(stream));
+            resent++;
+            continue;
+        }
+
+        uint32_t chunk_offset;
+        memcpy(&chunk_offset, parser.payload(), sizeof(chunk_offset));
+        uint32_t length = parser.length() - sizeof(chunk_offset);
+
+        // a chunk after a dropped one - ask again from the gap, unless it is one of the chunks that
+        // were already on the way when we last asked
+        if(chunk_offset != offset || offset + length > end) {
+            if(++stale > STALE_CHUNKS) {
+                stream[0] = offset;
+                sendFrame(fd, FLASH_DUMP_STREAM, stream, sizeof(stream));
+                resent++;
+                stale = 0;
+            }
+            continue;
+        }
+
+        memcpy(&log[offset], parser.payload() + sizeof(chunk_offset), length);
+        fseek(out, offset, SEEK_SET);
+        fwrite(&log[offset], 1, length, out);
+        offset += length;
+        retries = 0;
+        stale = 0;
+
+        if((offset / info.chunk_size) % 64 == 0 || offset == end) {
+            printf("\r%u / %u bytes", (unsigned) offset, (unsigned) end);
+            fflush(stdout);
+        }
+    }
+    fclose(out);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("\n%u bytes in %.1f s (%.1f KB/s), %u chunks asked for again, %u bad frames\n",
+           (unsigned) end, seconds, end / 1024.0 / (seconds > 0 ? seconds : 1), (unsigned) resent, (unsigned) parser.bad_frames);
+
+    bool ok = verifyLog(log, end);
+
+    if(clear && ok) {
+        sendFrame(fd, FLASH_DUMP_CLEAR, NULL, 0);
+        // a chip erase takes tens of seconds
+        if(receive(fd, parser, FLASH_DUMP_ACK, FLASH_DUMP_ACK, 120000)) printf("flash cleared\n");
+        else fprintf(stderr, "no answer to clear\n");
+    }
+
+    sendFrame(fd, FLASH_DUMP_QUIT, NULL, 0);
+    close(fd);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,505 @@
+/**
+ * Flight replay - recorded and synthetic flights through the flight filter and state machine
+ *
+ * every trace is a stream of timestamped x acceleration (g) and barometric altitude (m) samples. They go
+ * through AltitudeFusion in timestamp order as in fuseAltitudeTask, and State_machine::checkState is stepped
+ * with the newest estimate every FLIGHT_STATE_INTERVAL_MS of trace time as in flight_state_check - the same
+ * code the board runs, on the host, as fast as the CPU goes.
+ *
+ * traces:
+ *   sensor-data.csv     the logged x acceleration at its real timestamps, the barometer held at the pad
+ *   log-data/putty.log  PuttyProfile for the states the board logged, one 100 ms cycle per telemetry line
+ *                       as in the delta codec benchmark; the logged states are the reference
+ *   synthetic           --traces flights with random thrust, burn time, drag, deployment delay and descent
+ *                       rate, sampled at IMU_SAMPLE_RATE_HZ with sensor noise; the generator knows when
+ *                       each state really began, which is the reference
+ *
+ * a parachute that opens below its descent rate is seen once the fall stops speeding up; one that opens like
+ * that close to the ground lands first, and the state machine goes from ballistic descent to post-flight -
+ * counted as missed for parachute descent. Each synthetic flight stays on the ground 10 s after landing.
+ *
+ * reports for every state the latency of the state machine against the reference, the apogee of the
+ * filter alone (first estimate with velocity <= 0 after the climb), and the cycles per sample of each
+ * stage. Synthetic traces run in parallel on --jobs threads, each seeded from --seed and its number, so
+ * a run is repeatable whatever the thread count.
+ * exits non-zero if the state machine missed a state a recorded trace logged, and with --limit MS also if
+ * it missed apogee or was later than MS on any trace - the regression check
+ *
+ * pio run -e flight_replay && .pio/build/flight_replay/program [--traces N] [--seed S] [--jobs J] [--limit MS]
+ *     [--verbose] [--sensor-data sensor-data.csv] [--putty log-data/putty.log]
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "defs.h"
+#include "fusion.h"
+#include "state_machine.h"
+#include "putty_profile.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+static inline uint64_t cycles() { return __rdtsc(); }
+#else
+#define HAVE_CYCLE_COUNTER 0
+static inline uint64_t cycles() { return 0; }
+#endif
+
+#define STATE_COUNT             7           // PRE_FLIGHT to POST_FLIGHT
+#define NO_TIME                 0xFFFFFFFF
+#define START_TIME              1000000     // micros() of the first sample - clear of 0
+#define IMU_PERIOD_US           (1000000 / IMU_SAMPLE_RATE_HZ)
+#define ALTIMETER_PERIOD_US     26000       // BMP180 at BMP180_OVERSAMPLING 3
+#define ACCEL_NOISE             0.02f       // g
+#define ALTITUDE_NOISE          0.5f        // m - FUSION_ALTITUDE_VARIANCE
+#define CLIMB_VELOCITY          10.0f       // m/s the estimate must pass before the filter apogee is armed
+#define PAD_ALTITUDE            1525.0f
+#define IMPACT_ACCEL            (16 * ONE_G) // the ground stops the rocket as hard as the +-16 g accelerometer reads
+
+static const float ONE_G = 9.80665f;
+
+static const char* state_names[STATE_COUNT] = {
+    "PRE_FLIGHT", "POWERED_FLIGHT", "COASTING", "APOGEE", "BALLISTIC_DESCENT", "PARACHUTE_DESCENT", "POST_FLIGHT"
+};
+
+enum Stage { STAGE_ACCEL, STAGE_ALTITUDE, STAGE_STATE, STAGE_COUNT };
+static const char* stage_names[STAGE_COUNT] = {"accel update", "altitude update", "checkState"};
+
+struct Sample {
+    uint32_t timestamp;     // micros()
+    bool altimeter;         // altitude in m, else x acceleration in g
+    float value;
+};
+
+struct Trace {
+    std::string name;
+    std::vector<Sample> samples;
+    uint32_t reference[STATE_COUNT];    // when each state began, NO_TIME if unknown
+};
+
+struct Result {
+    uint32_t duration;                  // us from the first sample to the last
+    uint32_t samples;
+    uint32_t entered[STATE_COUNT];      // first estimate the state machine returned each state for
+    uint32_t filter_apogee;
+    float max_altitude;
+    uint64_t stage_cycles[STAGE_COUNT];
+    uint32_t stage_count[STAGE_COUNT];
+};
+
+/**
+ * run one trace through the filter and the state machine
+ * a new filter and state machine for every trace, as after a reboot
+*/
+static void replay(const Trace& trace, Result& result) {
+    AltitudeFusion fusion(FUSION_ALTITUDE_VARIANCE, FUSION_ACCEL_VARIANCE, FUSION_JERK_PSD);
+    State_machine fsm;
+    bool climbing = false;
+
+    memset(&result, 0, sizeof(result));
+    for(int s = 0; s < STATE_COUNT; s++) result.entered[s] = NO_TIME;
+    result.filter_apogee = NO_TIME;
+    result.max_altitude = -INFINITY;
+    if(trace.samples.empty()) return;
+
+    result.duration = trace.samples.back().timestamp - trace.samples.front().timestamp;
+    result.samples = trace.samples.size();
+    uint32_t next_check = trace.samples[0].timestamp;
+    for(size_t i = 0; i < trace.samples.size(); i++) {
+        const Sample& sample = trace.samples[i];
+
+        // the state task reads whatever estimate is newest when it wakes
+        while((int32_t) (sample.timestamp - next_check) >= 0) {
+            if(fusion.isInitialized()) {
+                uint64_t c0 = cycles();
+                int32_t state = fsm.checkState(fusion.getAltitude(), fusion.getVelocity());
+                result.stage_cycles[STAGE_STATE] += cycles() - c0;
+                result.stage_count[STAGE_STATE]++;
+
+                if(state >= 0 && state < STATE_COUNT && result.entered[state] == NO_TIME) {
+                    result.entered[state] = next_check;
+                }
+            }
+            next_check += FLIGHT_STATE_INTERVAL_MS * 1000;
+        }
+
+        // the x axis points along the rocket, so vertical acceleration is the x reading less 1g
+        uint64_t c0 = cycles();
+        if(sample.altimeter) fusion.updateAltitude(sample.value, sample.timestamp);
+        else fusion.updateAcceleration((sample.value - 1.0f) * ONE_G, sample.timestamp);
+        Stage stage = sample.altimeter ? STAGE_ALTITUDE : STAGE_ACCEL;
+        result.stage_cycles[stage] += cycles() - c0;
+        result.stage_count[stage]++;
+
+        if(!fusion.isInitialized()) continue;
+
+        float velocity = fusion.getVelocity();
+        if(velocity > CLIMB_VELOCITY) climbing = true;
+        if(climbing && velocity <= 0 && result.filter_apogee == NO_TIME) result.filter_apogee = sample.timestamp;
+        if(fusion.getAltitude() > result.max_altitude) result.max_altitude = fusion.getAltitude();
+    }
+}
+
+/**
+ * vertical motion sampled the way the board sees it
+ * step() advances one IMU period under a vertical acceleration and emits the accelerometer sample,
+ * and a barometer sample whenever one is due. The ground stops the rocket, the accelerometer clipped at its range
+*/
+struct Generator {
+    Trace& trace;
+    std::mt19937& rng;
+    std::normal_distribution<float> normal;
+    uint32_t time;
+    uint32_t next_altimeter;
+    float pad;
+    float altitude;
+    float velocity;
+
+    Generator(Trace& trace, std::mt19937& rng, float pad) : trace(trace), rng(rng), normal(0.0f, 1.0f) {
+        this->time = START_TIME;
+        this->next_altimeter = START_TIME;
+        this->pad = pad;
+        this->altitude = pad;
+        this->velocity = 0;
+    }
+
+    void step(float accel) {
+        const float dt = IMU_PERIOD_US * 1e-6f;
+
+        if(this->altitude <= this->pad && this->velocity + accel * dt <= 0) {
+            accel = std::min(-this->velocity / dt, IMPACT_ACCEL);
+        }
+        this->velocity += accel * dt;
+        this->altitude += this->velocity * dt;
+        if(this->altitude < this->pad) this->altitude = this->pad;
+        this->time += IMU_PERIOD_US;
+
+        // the accelerometer reads specific force - 1g at rest, 0 in free fall
+        Sample imu = {this->time, false, (accel + ONE_G) / ONE_G + ACCEL_NOISE * this->normal(this->rng)};
+        this->trace.samples.push_back(imu);
+
+        if((int32_t) (this->time - this->next_altimeter) >= 0) {
+            Sample altimeter = {this->time, true, this->altitude + ALTITUDE_NOISE * this->normal(this->rng)};
+            this->trace.samples.push_back(altimeter);
+            this->next_altimeter += ALTIMETER_PERIOD_US;
+        }
+    }
+
+    bool landed() {
+        return this->altitude <= this->pad && this->velocity <= 0;
+    }
+};
+
+/**
+ * a random flight: pad wait, boost, coast with drag to apogee, drag limited fall, parachute down to the pad, wait
+*/
+static void synthesize(uint32_t seed, Trace& trace) {
+    std::mt19937 rng(seed);
+    auto uniform = [&rng](float low, float high) { return std::uniform_real_distribution<float>(low, high)(rng); };
+
+    float pad = uniform(1400.0f, 1600.0f);
+    float pad_time = uniform(2.0f, 5.0f);
+    float thrust = uniform(30.0f, 80.0f);           // m/s^2 on top of gravity
+    float burn_time = uniform(1.0f, 3.0f);
+    float drag = uniform(0.0005f, 0.003f);          // 1/m
+    float deploy_delay = uniform(0.5f, 3.0f);
+    float descent_rate = uniform(15.0f, 30.0f);     // m/s under parachute
+    float chute_drag = ONE_G / (descent_rate * descent_rate);
+
+    char name[32];
+    snprintf(name, sizeof(name), "synthetic %u", (unsigned) seed);
+    trace.name = name;
+    trace.samples.clear();
+    for(int s = 0; s < STATE_COUNT; s++) trace.reference[s] = NO_TIME;
+
+    Generator flight(trace, rng, pad);
+    trace.reference[PRE_FLIGHT] = flight.time;
+
+    while(flight.time - START_TIME < (uint32_t) (pad_time * 1e6f)) flight.step(0);
+
+    trace.reference[POWERED_FLIGHT] = flight.time;
+    uint32_t burnout = flight.time + (uint32_t) (burn_time * 1e6f);
+    while(flight.time < burnout) {
+        flight.step(thrust - ONE_G - drag * flight.velocity * fabsf(flight.velocity));
+    }
+
+    trace.reference[COASTING] = flight.time;
+    while(flight.velocity > 0) flight.step(-ONE_G - drag * flight.velocity * flight.velocity);
+
+    trace.reference[APOGEE] = flight.time;
+    trace.reference[BALLISTIC_DESCENT] = flight.time;
+    uint32_t deploy = flight.time + (uint32_t) (deploy_delay * 1e6f);
+    while(flight.time < deploy && !flight.landed()) {
+        flight.step(-ONE_G + drag * flight.velocity * flight.velocity);
+    }
+
+    trace.reference[PARACHUTE_DESCENT] = flight.time;
+    while(!flight.landed()) flight.step(-ONE_G + chute_drag * flight.velocity * flight.velocity);
+
+    trace.reference[POST_FLIGHT] = flight.time;
+    uint32_t end = flight.time + 10000000;
+    while(flight.time < end) flight.step(0);
+}
+
+static bool loadSensorData(const char* path, Trace& trace) {
+    FILE* f = fopen(path, "r");
+    if(f == NULL) return false;
+
+    trace.name = path;
+    for(int s = 0; s < STATE_COUNT; s++) trace.reference[s] = NO_TIME;
+
+    std::mt19937 rng(1);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    uint32_t next_altimeter = START_TIME;
+    double t, t0 = -1;
+    float ax;
+    while(fscanf(f, "%lf,%f", &t, &ax) == 2) {
+        if(t0 < 0) t0 = t;
+        uint32_t timestamp = START_TIME + (uint32_t) ((t - t0) * 1e6);
+
+        // the capture has no barometer - it was on the pad
+        while((int32_t) (timestamp - next_altimeter) >= 0) {
+            Sample altimeter = {next_altimeter, true, PAD_ALTITUDE + ALTITUDE_NOISE * normal(rng)};
+            trace.samples.push_back(altimeter);
+            next_altimeter += ALTIMETER_PERIOD_US;
+        }
+
+        Sample imu = {timestamp, false, ax};
+        trace.samples.push_back(imu);
+    }
+    fclose(f);
+
+    return !trace.samples.empty();
+}
+
+/**
+ * the states the board logged and the motion of PuttyProfile for them, sampled the way the board sees it
+*/
+static bool loadPuttyLog(const char* path, Trace& trace) {
+    PuttyProfile profile;
+    if(!profile.load(path)) return false;
+
+    trace.name = path;
+    for(int s = 0; s < STATE_COUNT; s++) trace.reference[s] = NO_TIME;
+
+    std::mt19937 rng(1);
+    Generator flight(trace, rng, PAD_ALTITUDE);
+    for(size_t i = 0; i < profile.states.size(); i++) {
+        int state = profile.states[i];
+        if(state >= 0 && state < STATE_COUNT && trace.reference[state] == NO_TIME) trace.reference[state] = flight.time;
+
+        for(uint32_t t = 0; t < PUTTY_CYCLE_MS * 1000; t += IMU_PERIOD_US) {
+            flight.step(profile.accel((flight.time - START_TIME) * 1e-6f));
+        }
+    }
+
+    return true;
+}
+
+/**
+ * cycles a back to back cycles() pair costs - taken off every stage
+*/
+static double cycleOverhead() {
+    uint64_t best = UINT64_MAX;
+    for(int i = 0; i < 1000; i++) {
+        uint64_t c0 = cycles();
+        uint64_t c1 = cycles();
+        if(c1 - c0 < best) best = c1 - c0;
+    }
+    return (double) best;
+}
+
+static double percentile(std::vector<double>& values, double p) {
+    std::sort(values.begin(), values.end());
+    return values[(size_t) (p * (values.size() - 1) + 0.5)];
+}
+
+static void printTrace(const Trace& trace, const Result& result) {
+    uint32_t start = START_TIME;
+    printf("%s: %.1f s, %u samples, max altitude %.1f m\n", trace.name.c_str(), result.duration * 1e-6,
+           (unsigned) result.samples, result.max_altitude);
+    printf("  %-20s %12s %12s %12s\n", "state", "reference s", "replay s", "latency ms");
+
+    for(int s = 0; s < STATE_COUNT; s++) {
+        char reference[16] = "-", entered[16] = "-", latency[16] = "-";
+        if(trace.reference[s] != NO_TIME) snprintf(reference, sizeof(reference), "%.3f", (trace.reference[s] - start) * 1e-6);
+        if(result.entered[s] != NO_TIME) snprintf(entered, sizeof(entered), "%.3f", (result.entered[s] - start) * 1e-6);
+        if(trace.reference[s] != NO_TIME && result.entered[s] != NO_TIME) {
+            snprintf(latency, sizeof(latency), "%.0f", (int32_t) (result.entered[s] - trace.reference[s]) * 1e-3);
+        }
+        printf("  %-20s %12s %12s %12s\n", state_names[s], reference, entered, latency);
+    }
+
+    if(result.filter_apogee != NO_TIME) {
+        printf("  %-20s %12s %12.3f", "filter apogee", "", (result.filter_apogee - start) * 1e-6);
+        if(trace.reference[APOGEE] != NO_TIME) printf(" %12.0f", (int32_t) (result.filter_apogee - trace.reference[APOGEE]) * 1e-3);
+        printf("\n");
+    }
+}
+
+/**
+ * latency of one detection over every trace with a reference for it
+ * returns how many traces were over limit_ms or missed it
+*/
+static uint32_t printLatency(const char* name, const std::vector<Trace>& traces, const std::vector<Result>& results,
+                             int state, bool filter, double limit_ms) {
+    std::vector<double> latencies;
+    uint32_t missed = 0, over = 0;
+
+    for(size_t i = 0; i < traces.size(); i++) {
+        if(traces[i].reference[state] == NO_TIME) continue;
+        uint32_t detected = filter ? results[i].filter_apogee : results[i].entered[state];
+        if(detected == NO_TIME) {
+            missed++;
+            continue;
+        }
+        double latency = (int32_t) (detected - traces[i].reference[state]) * 1e-3;
+        if(latency > limit_ms) over++;
+        latencies.push_back(latency);
+    }
+
+    printf("  %-20s %8u %8u", name, (unsigned) latencies.size(), (unsigned) missed);
+    if(latencies.empty()) {
+        printf(" %10s %10s %10s %10s\n", "-", "-", "-", "-");
+    } else {
+        printf(" %10.0f %10.0f %10.0f %10.0f\n", percentile(latencies, 0.0), percentile(latencies, 0.5),
+               percentile(latencies, 0.95), percentile(latencies, 1.0));
+    }
+
+    return missed + over;
+}
+
+int main(int argc, char** argv) {
+    const char* sensor_path = "sensor-data.csv";
+    const char* putty_path = "log-data/putty.log";
+    uint32_t count = 1000, seed = 1;
+    uint32_t jobs = std::thread::hardware_concurrency();
+    double limit_ms = INFINITY;
+    bool verbose = false;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--traces") == 0 && i + 1 < argc) count = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "--limit") == 0 && i + 1 < argc) limit_ms = strtod(argv[++i], NULL);
+        else if(strcmp(argv[i], "--sensor-data") == 0 && i + 1 < argc) sensor_path = argv[++i];
+        else if(strcmp(argv[i], "--putty") == 0 && i + 1 < argc) putty_path = argv[++i];
+        else if(strcmp(argv[i], "--verbose") == 0) verbose = true;
+        else {
+            fprintf(stderr, "usage: %s [--traces N] [--seed S] [--jobs J] [--limit MS] [--verbose] "
+                            "[--sensor-data path] [--putty path]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(jobs == 0) jobs = 1;
+
+    // recorded traces, one at a time with the whole report
+    std::vector<Trace> recorded(2);
+    std::vector<Result> recorded_results(2);
+    if(!loadSensorData(sensor_path, recorded[0])) {
+        fprintf(stderr, "cannot read %s\n", sensor_path);
+        return 1;
+    }
+    if(!loadPuttyLog(putty_path, recorded[1])) {
+        fprintf(stderr, "cannot read %s\n", putty_path);
+        return 1;
+    }
+    for(size_t i = 0; i < recorded.size(); i++) {
+        replay(recorded[i], recorded_results[i]);
+        printTrace(recorded[i], recorded_results[i]);
+    }
+
+    // every state a recorded trace logged must be reached, apogee within the limit
+    printf("\n  recorded traces, latency ms after the reference\n");
+    printf("  %-20s %8s %8s %10s %10s %10s %10s\n", "state", "reached", "missed", "min", "median", "p95", "max");
+    uint32_t recorded_failed = 0;
+    for(int s = POWERED_FLIGHT; s < STATE_COUNT; s++) {
+        recorded_failed += printLatency(state_names[s], recorded, recorded_results, s, false, s == APOGEE ? limit_ms : INFINITY);
+    }
+
+    // synthetic traces - each worker takes the next trace number until all are done
+    std::vector<Trace> traces(count);
+    std::vector<Result> results(count);
+    std::atomic<uint32_t> next(0);
+    std::atomic<uint64_t> replay_ns(0);
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(uint32_t j = 0; j < jobs; j++) {
+        workers.emplace_back([&]() {
+            uint32_t i;
+            while((i = next.fetch_add(1)) < count) {
+                synthesize(seed + i, traces[i]);
+                auto r0 = std::chrono::steady_clock::now();
+                replay(traces[i], results[i]);
+                auto r1 = std::chrono::steady_clock::now();
+                replay_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(r1 - r0).count();
+
+                // the report only needs the references - thousands of traces would not fit in memory
+                std::vector<Sample>().swap(traces[i].samples);
+            }
+        });
+    }
+    for(size_t j = 0; j < workers.size(); j++) workers[j].join();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    if(count == 0) {
+        if(recorded_failed) printf("\nrecorded traces: FAIL (%u states missed or late)\n", (unsigned) recorded_failed);
+        return recorded_failed ? 1 : 0;
+    }
+    if(verbose) {
+        printf("\n");
+        for(uint32_t i = 0; i < count; i++) printTrace(traces[i], results[i]);
+    }
+
+    double flight_s = 0, samples = 0;
+    uint64_t stage_cycles[STAGE_COUNT] = {0};
+    uint64_t stage_count[STAGE_COUNT] = {0};
+    for(uint32_t i = 0; i < count; i++) {
+        flight_s += results[i].duration * 1e-6;
+        samples += results[i].samples;
+        for(int s = 0; s < STAGE_COUNT; s++) {
+            stage_cycles[s] += results[i].stage_cycles[s];
+            stage_count[s] += results[i].stage_count[s];
+        }
+    }
+
+    printf("\n%u synthetic traces, seed %u: %.0f s of flight, %.0f samples in %.2f s on %u threads (%.0fx real time)\n",
+           (unsigned) count, (unsigned) seed, flight_s, samples, wall, (unsigned) jobs, flight_s / wall);
+    printf("  replay alone %.1f ns/sample on one thread\n", replay_ns.load() / samples);
+
+    printf("\n  latency ms after the reference\n");
+    printf("  %-20s %8s %8s %10s %10s %10s %10s\n", "state", "reached", "missed", "min", "median", "p95", "max");
+    uint32_t failed = 0;
+    for(int s = POWERED_FLIGHT; s < STATE_COUNT; s++) {
+        uint32_t bad = printLatency(state_names[s], traces, results, s, false, limit_ms);
+        if(s == APOGEE) failed = bad;
+    }
+    printLatency("filter apogee", traces, results, APOGEE, true, INFINITY);
+
+    double overhead = cycleOverhead();
+    printf("\n  %-20s %12s %16s   (%.0f cycles of counter overhead taken off)\n", "stage", "calls", "cycles/call", overhead);
+    for(int s = 0; s < STAGE_COUNT; s++) {
+        double per_call = stage_count[s] ? (double) stage_cycles[s] / stage_count[s] - overhead : 0;
+        printf("  %-20s %12llu %16.1f\n", stage_names[s], (unsigned long long) stage_count[s],
+               HAVE_CYCLE_COUNTER ? std::max(per_call, 0.0) : NAN);
+    }
+
+    printf("\nrecorded traces: %s (%u states missed or late)\n", recorded_failed ? "FAIL" : "ok", (unsigned) recorded_failed);
+    if(isfinite(limit_ms)) {
+        printf("apogee within %.0f ms: %s (%u of %u synthetic traces late or missed)\n", limit_ms, failed ? "FAIL" : "ok",
+               (unsigned) failed, (unsigned) count);
+        return failed || recorded_failed ? 1 : 0;
+    }
+
+    return recorded_failed ? 1 : 0;
+}
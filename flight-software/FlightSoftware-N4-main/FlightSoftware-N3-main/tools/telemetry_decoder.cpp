@@ -0,0 +1,74 @@
+/**
+ * Ground decoder - binary telemetry frames to csv
+ *
+ * reads a raw capture (serial dump, MQTT payloads written back to back, ...) from a file or stdin,
+ * finds every valid frame and prints it as a csv row. Bytes between frames are skipped, so a
+ * capture that starts mid-frame or has corrupted frames still decodes.
+ * a summary of frames, crc failures and sequence gaps goes to stderr
+ *
+ * pio run -e telemetry_decoder && .pio/build/telemetry_decoder/program capture.bin > telemetry.csv
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "telemetry.h"
+
+int main(int argc, char** argv) {
+    FILE* in = stdin;
+    if(argc > 1) {
+        in = fopen(argv[1], "rb");
+        if(in == NULL) {
+            fprintf(stderr, "cannot open %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    // read the whole capture - captures are at most a few MB
+    std::vector<uint8_t> capture;
+    uint8_t chunk[4096];
+    size_t n;
+    while((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        capture.insert(capture.end(), chunk, chunk + n);
+    }
+    if(in != stdin) fclose(in);
+
+    uint32_t frames = 0, bad_crc = 0, bad_version = 0, lost = 0, skipped = 0;
+    uint32_t next_sequence = 0;
+    size_t position = 0;
+
+    telemetryPrintHeader(stdout);
+
+    while(position < capture.size()) {
+        const telemetry_frame_t* frame;
+        int result = telemetryDecode(&capture[position], capture.size() - position, frame);
+
+        if(result == TELEMETRY_SHORT) {
+            skipped += capture.size() - position;
+            break;
+        }
+
+        if(result != TELEMETRY_OK) {
+            if(result == TELEMETRY_BAD_CRC) bad_crc++;
+            if(result == TELEMETRY_BAD_VERSION) bad_version++;
+            // resynchronise one byte on - a sync pattern inside the payload fails the crc
+            position++;
+            skipped++;
+            continue;
+        }
+
+        if(frames > 0 && frame->sequence != next_sequence) {
+            lost += frame->sequence - next_sequence;
+        }
+        next_sequence = frame->sequence + 1;
+
+        telemetryPrintFrame(stdout, *frame);
+        frames++;
+        position += sizeof(telemetry_frame_t);
+    }
+
+    fprintf(stderr, "%u frames, %u crc errors, %u other version, %u lost by sequence, %u bytes skipped\n",
+            frames, bad_crc, bad_version, lost, skipped);
+
+    return 0;
+}